@@ -33,6 +33,15 @@
 
   DATE    BY        PURPOSE
 -------  ----   ------------------------------------------------
+10/14/26  JPL   added per channel correction records, cal235
+          JPL   added DMA status values and ping-pong state to the cblk235
+          JPL   added the DMA completion wait modes
+          JPL   added the shadow registers, cnfgdiff235
+          JPL   added the DN lookup tables, lut235
+          JPL   added the sample memory windows
+          JPL   added E_NOT_PERMITTED
+          JPL   split the cblk235 into hot and cold parts, removed ideal_buf
+          JPL   added the trace ring
 
 {-D}
 */
@@ -49,6 +58,7 @@
 /* ////////////////////////////////////////////////////////////////// */
 #define BUILDING_FOR_A64 0
 
+#include "apcal.h"
 
 
 
@@ -100,7 +110,9 @@
 #define AXIBAR_0	0x80000	/* AXIBAR_0 base address */
 
 #define DMAMAX_TRIES	300000
+#define DMATIMEOUT_NS	100000000L	/* longest wait for a DMA transfer to complete, see dmawait235 */
 #define MAXSAMPLES	4096	/* individual channel data buffer size */
+#define SAMPLEWORDS	65536	/* sample memory size, shared by the channels' FIFOs */
 #define MAX_MEMORY_PAGES (16 * 2) + 2 /* 2 pages per channel x 16 channels */
 
 
@@ -119,6 +131,15 @@
 #define DMAInterruptOnCompleteEnabled	(1 << 12)
 #define DMAInterruptOnDelayTimerEnabled	(1 << 13)
 
+/* DMA status values, see apcommon.h for the others */
+#define E_DMA_TIMEOUT		0x8009	/* DMA transfer did not complete */
+#define E_DMA_NOT_IDLE		0x800A	/* DMA engine not idle after reset */
+#define E_NOT_PERMITTED		0x800B	/* real-time scheduling of the service thread not permitted */
+
+/* DMA completion wait modes, see dmawait235 */
+#define DMA_WAIT_POLL		0	/* poll the status register */
+#define DMA_WAIT_IRQ		1	/* sleep until the interrupt on complete */
+
 /* Interrupt types */
 #define FIFO_SBURST	1
 
@@ -292,33 +313,70 @@ struct chops235 /* Channel Control Register Options */
 
 
 
+/*
+    Defined below is the last configuration written to each channel's registers, used by
+    cnfgdiff235 to write only what changed.
+*/
+
+struct shadow235
+{
+    BOOL Valid;			/* the channel was configured and not reset since */
+    BOOL Irq;			/* the channel interrupt is enabled */
+    uint32_t Direct;		/* WriteControl word last written to DirectAccess */
+    uint32_t Status;		/* last Underflow Clear written to Status */
+    uint32_t Control;		/* last channel Control register value */
+};
+
+
+
 /*
     Defined below is the structure which is used to hold the board's configuration information.
+
+    The members used by every refill and register write come first, those of the waveform
+    pointers and the channel options each starting a cache line; the identification,
+    calibration source data and the like follow.  Allocate it with new_cblk235 so the
+    cache lines are those of the machine.
 */
 
 struct cblk235
 {
+    /* hot: register access and the refill of the FIFOs */
     struct mapap235 *brd_ptr;	/* pointer to base address of board */
     APDATA_STRUCT* pAP;		/* pointer to AP data structure */
-    uint32_t FPGAAdrData[10];	/* FPGA address & data order:0,1,2,20 thru 26 */
+    short (*pcor_buf)[16][MAXSAMPLES]; /* pointer to allocated corrected data storage area */
     int nHandle;		/* handle to an open board */
-    BOOL bAP;			/* flag indicating a open board */
-    BOOL bInitialized;          /* flag indicating ready to talk to board */
-    struct chops235 opts;	/* DAC control register options */
+    BOOL DMABusy;		/* a DMA transfer was started and not yet seen complete */
+    int DMAWaitMode;		/* DMA_WAIT_POLL or DMA_WAIT_IRQ */
+    uint32_t PendingStatus;	/* channel interrupts seen while waiting for a DMA interrupt */
+    BOOL UseLUT;		/* DN writes go through lut235 */
+    struct aptrace *trace;	/* ring the outputs are recorded in, NULL when not tracing */
+    uint32_t TimerDivider;	/* Timer Register Value */
+    uint32_t TriggerDirection;	/* Trigger direction */
+    short *head_ptr[16] AP_CACHE_ALIGNED;	/* head pointer of write buffer */
+    short *tail_ptr[16];	/* tail pointer of write buffer */
+    short *current_ptr[16];	/* current data pointer of write buffer */
+    uint32_t SampleCount[16];	/* number of samples in buffer for each Channel */
+    unsigned int DMAPingPong[16]; /* page of pcor_buf the next DMA transfer reads, per channel */
+    uint32_t WinStart[16];	/* first sample memory word of each channel's FIFO, see partition235 */
+    uint32_t WinSize[16];	/* sample memory words of each channel's FIFO, 0 for MAXSAMPLES */
+    struct chops235 opts AP_CACHE_ALIGNED;	/* DAC control register options */
+    APCAL cal235[16] AP_CACHE_ALIGNED;	/* correction for each channel at its range, see cal235 */
+
+    /* cold: configuration, identification and calibration source data */
+    struct shadow235 shadow[16] AP_CACHE_ALIGNED; /* registers last written by cnfg235 or cnfgdiff235 */
+    BOOL ShadowCommon;		/* ShadowTimer and ShadowTrigger are valid */
+    uint32_t ShadowTimer;	/* TimerDivider last written */
+    uint32_t ShadowTrigger;	/* TriggerDirection last written */
+    uint32_t ChStatus[16];	/* Channel status values for each output */
+    APLUT lut235[16];		/* DN -> code table for each channel, see lut235 */
     short ogc235[16][8][2];	/* offset & gain correction pairs[2] for each range[8] for each channel[16] */
     double (*pIdealCode)[8][7];	/* pointer to Ideal Zero, Slope, endpoint, and clip constants */
+    uint32_t FPGAAdrData[10];	/* FPGA address & data order:0,1,2,20 thru 26 */
     unsigned char IDbuf[32];	/* storage for APxxx ID string */
-    uint32_t ChStatus[16];	/* Channel status values for each output */
-    uint32_t TimerDivider;	/* Timer Register Value */
-    uint32_t TriggerDirection;	/* Trigger direction */
     uint32_t revision;		/* Firmware Revision */
     ushort location;		/* AP location */
-    uint32_t SampleCount[16];	/* number of samples in buffer for each Channel */
-    short ideal_buf[16][MAXSAMPLES]; /* allocate ideal data storage area */
-    short (*pcor_buf)[16][MAXSAMPLES]; /* pointer to allocated corrected data storage area */
-    short *head_ptr[16];	/* head pointer of write buffer */
-    short *tail_ptr[16];	/* tail pointer of write buffer */
-    short *current_ptr[16];	/* current data pointer of write buffer */
+    BOOL bAP;			/* flag indicating a open board */
+    BOOL bInitialized;          /* flag indicating ready to talk to board */
 };
 
 
@@ -332,9 +390,14 @@ void selectch235(int *current_channel);
 void scfg235(struct cblk235 *c_blk, int channel);
 void DMA_sandbox(struct cblk235 *c_blk, int channel);
 void cnfg235(struct cblk235 *c_blk, int channel); /* configure channel */
+void cnfgdiff235(struct cblk235 *c_blk, uint32_t mask); /* configure changes to channels */
 void fifowro235( struct cblk235 *c_blk, int channel ); /* performs the write output function */
-void fifodmawro235(struct cblk235 *c_blk, int channel);/* performs the DMA output function */
+int fifodmawro235(struct cblk235 *c_blk, int channel);/* performs the DMA output function */
+int dmawait235(struct cblk235 *c_blk);		/* wait for the DMA transfer in progress */
+int dmapoll235(struct cblk235 *c_blk);		/* dmawait235 by polling, whatever the wait mode */
 void cd235(struct cblk235 *c_blk, int channel, double *fb);	/* correct DAC output data */
+APCAL *cal235(struct cblk235 *c_blk, int channel);	/* correction record for a channel */
+const unsigned short *lut235(struct cblk235 *c_blk, int channel);	/* DN -> code table for a channel */
 void simtrig235(struct cblk235 *c_blk);
 
 
@@ -33,6 +33,10 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+10/14/26  JPL	added per channel correction records, cal236
+	  JPL	added the DN lookup tables, lut236
+	  JPL	split the cblk236 into hot and cold parts, removed ideal_buf
+	  JPL	added the trace ring
 
 {-D}
 */
@@ -48,6 +52,8 @@
     DEFINITIONS:
 */
 
+#include "apcal.h"
+
 
 /*
 	AP236 board type
@@ -129,22 +135,31 @@ struct chops236 /* Channel Control Register Options */
 
 /*
     Defined below is the structure which is used to hold the board's configuration information.
+
+    The members used by every output come first, the identification and calibration source
+    data follow.  Allocate it with new_cblk236 so the cache lines are those of the machine.
 */
 
 struct cblk236
 {
+    /* hot: the outputs */
     struct map236 *brd_ptr;	/* pointer to base address of board */
-    uint32_t FPGAAdrData[10];	/* FPGA address & data order:0,1,2,20 thru 26 */
     int nHandle;	        /* handle to an open board */
-    BOOL bAP;			/* flag indicating a board is open */
-    BOOL bInitialized;		/* flag indicating board is Initialized */
+    BOOL UseLUT;		/* DN writes go through lut236 */
+    struct aptrace *trace;	/* ring the outputs are recorded in, NULL when not tracing */
+    short cor_buf[8];		/* corrected buffer start */
     struct chops236 opts;	/* DAC control register options */
+    APCAL cal236[8] AP_CACHE_ALIGNED;	/* correction for each channel at its range, see cal236 */
+
+    /* cold: identification and calibration source data */
+    APLUT lut236[8] AP_CACHE_ALIGNED;	/* DN -> code table for each channel, see lut236 */
     short ogc236[8][8][2];	/* storage for offset & gain correction pairs[2] for each range[8] for each channel[8] */
     double (*pIdealCode)[8][7];	/* pointer to Ideal Zero, Slope, endpoint, and clip constants */
-    short cor_buf[8];		/* corrected buffer start */
-    short ideal_buf[8];		/* ideal buffer start */
+    uint32_t FPGAAdrData[10];	/* FPGA address & data order:0,1,2,20 thru 26 */
     unsigned char IDbuf[32];	/* storage for AP236 ID string */
     uint32_t revision;		/* Firmware Revision */
+    BOOL bAP;			/* flag indicating a board is open */
+    BOOL bInitialized;		/* flag indicating board is Initialized */
 };
 
 /*
@@ -154,6 +169,8 @@ struct cblk236
 int rcc236( struct cblk236 *c_blk );				/* read gain/offset information */
 void wro236(struct cblk236 *c_blk, int channel, word data);	/* performs the write output function */
 void cd236(struct cblk236 *c_blk, int channel, double Volts);	/* correct DAC output data */
+APCAL *cal236(struct cblk236 *c_blk, int channel);		/* correction record for a channel */
+const unsigned short *lut236(struct cblk236 *c_blk, int channel);	/* DN -> code table for a channel */
 void scfg236(struct cblk236 *c_blk, int channel);
 void selectch236(int *current_channel);
 void cnfg236(struct cblk236 *c_blk, int channel); /* configure channel */
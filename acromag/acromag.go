@@ -58,7 +58,7 @@ The DAC modules have a common interface.  Sample usage looks like:
 package acromag
 
 /*
-#cgo LDFLAGS: -lm
+#cgo LDFLAGS: -lm -lpthread
 #include <stdlib.h>
 #include "apcommon.h"
 */
@@ -4,14 +4,20 @@ package acromag
 #include "apcommon.h"
 #include "AP235.h"
 #include "shim235.h"
+#include "svc235.h"
 */
 import "C"
 import (
 	"errors"
 	"fmt"
 	"reflect"
+	"sort"
 	"sync"
+	"sync/atomic"
+	"time"
 	"unsafe"
+
+	"github.com/nasa-jpl/golaborate/pinned"
 )
 
 // AP235 is an acromag 16-bit DAC of the same type
@@ -20,19 +26,39 @@ type AP235 struct {
 
 	cfg *C.struct_cblk235
 
-	// cursors hold the index into buffer
-	// that corresponds to the current sample offset of each channel
-	cursor [16]int
+	// svc is the waveform service thread, which owns the cursors into the
+	// buffers during playback
+	svc *C.struct_svc235
+
+	// serviceCPU is the core svc is pinned to, -1 for none
+	serviceCPU int
 
-	// sample_count holds the number of samples in a supplied waveform
-	// on a per-channel basis
-	sampleCount [16]int
+	// servicePriority is the SCHED_FIFO priority of svc, 0 for none
+	servicePriority int
 
-	// buffers are the sample queues for each channel, owned by C
+	// repeat is the number of times each waveform is played, 0 for forever
+	repeat [16]int
+
+	// buffers are the sample queues for each channel, owned by C.
+	// see WaveformBuffer
 	buffer [16][]uint16
 
-	// cptrs holds the pointers in C to be used to free the buffers later
-	cptr [16]*C.short
+	// pinned holds the page locked buffer of each channel from
+	// pinned.Default, at its full capacity; nil when the channel's waveform
+	// lives in pcor_buf
+	pinned [16][]uint16
+
+	// spare holds the page locked buffer staged waveforms are written to;
+	// spare and pinned trade places once the service thread takes the swap.
+	// See StageWaveform
+	spare [16][]uint16
+
+	// next is the view of the staged waveform of each channel, nil if none
+	next [16][]uint16
+
+	// swapping has bit n set if channel n's staged waveform was handed to
+	// the service thread and the trade is yet to be made, see settle
+	swapping uint32
 
 	cScatterInfo *C.ulong
 
@@ -43,52 +69,191 @@ type AP235 struct {
 	// isWaveform is a fast check for whether each channel is used
 	// for waveform playback
 	isWaveform [16]bool
+
+	// staging is true between BeginConfig and CommitConfig, when
+	// configuration changes are only recorded in staged
+	staging bool
+
+	// staged has bit n set if channel n was changed while staging
+	staged uint32
+
+	// committed has bit n set if channel n's waveform buffer was committed
+	// or it was given a generator
+	committed uint32
+
+	// generating has bit n set if channel n plays generator[n] rather than
+	// its buffer; active is the channels played by the last StartWaveform
+	// and live those of them that play a generator
+	generating uint32
+	active     uint32
+	live       uint32
+	generator  [16]C.APGEN
+
+	// scheduled has bit n set if channel n plays the steps of schedule[n],
+	// scheduleLen long and owned by C, see ScheduleOutputs
+	scheduled   uint32
+	schedule    [16]*C.struct_svcstep
+	scheduleLen [16]int
+
+	// stopSampler and samplerDone stop and wait for the telemetry sampler,
+	// nil if it is not running; telemetry holds its latest *Telemetry
+	stopSampler chan struct{}
+	samplerDone chan struct{}
+	telemetry   atomic.Value
+
+	// tracer empties cfg.trace and traceSvc, the ring of the service
+	// thread; nil when not tracing, see SetTracer
+	tracer   *Tracer
+	traceSvc *C.struct_aptrace
 }
 
 // NewAP235 creates a new instance and opens the connection to the DAC
 func NewAP235(deviceIndex int) (*AP235, error) {
+	return NewAP235WithIO(deviceIndex, IOSyscall)
+}
+
+// NewAP235WithIO is NewAP235 with a choice of register access mode.
+// IOMapped silently falls back to IOSyscall if the board cannot be mapped;
+// check the IOMode method of the returned DAC.  If the error is non-nil,
+// what was acquired of the board is released and Close does nothing
+func NewAP235WithIO(deviceIndex int, mode IOMode) (*AP235, error) {
+	out := &AP235{}
+	err := out.open(deviceIndex, mode)
+	if err != nil {
+		out.release()
+	}
+	return out, err
+}
+
+// open opens the board, initializes it, gets its address, and populates its
+// config
+func (o *AP235) open(deviceIndex int, mode IOMode) error {
 	var (
-		o    AP235
-		out  = &o
 		addr *C.struct_mapap235
 		cs   = C.CString("ap235_") // untyped constant in C needs enforcement in Go
 	)
 	defer C.free(unsafe.Pointer(cs))
 
-	o.cfg = (*C.struct_cblk235)(C.malloc(C.sizeof_struct_cblk235))
+	o.cfg = C.new_cblk235()
+	if o.cfg == nil {
+		return errors.New("unable to allocate the AP235 control block")
+	}
 	o.cfg.pIdealCode = cMkCopyOfIdealData(idealCode)
 
-	// open the board, initialize it, get its address, and populate its config
-	errC := C.APOpen(C.int(deviceIndex), &o.cfg.nHandle, cs)
+	errC := C.APOpenEx(C.int(deviceIndex), &o.cfg.nHandle, cs, C.int(mode), C.sizeof_struct_mapap235)
 	err := enrich(errC, "APOpen")
 	if err != nil {
-		return out, err
+		return err
 	}
 
 	errC = C.APInitialize(o.cfg.nHandle)
 	err = enrich(errC, "APInitialize")
 	if err != nil {
-		return out, err
+		return err
 	}
 	errC = C.GetAPAddress235(o.cfg.nHandle, &addr)
 	err = enrich(errC, "GetAPAddress")
 	if err != nil {
-		return out, err
+		return err
 	}
 	o.cfg.brd_ptr = addr
 	o.cfg.pAP = C.GetAP(o.cfg.nHandle)
 	if o.cfg.pAP == nil {
-		return out, fmt.Errorf("unable to get a pointer to the acropack module")
+		return fmt.Errorf("unable to get a pointer to the acropack module")
 	}
 
 	// assign the buffer pointer
 	ptr := C.Setup_board_corrected_buffer(o.cfg)
 	if ptr == nil {
-		return out, errors.New("error reading calibration data from AP235")
+		return errors.New("error reading calibration data from AP235")
 	}
 	o.cScatterInfo = ptr
-	// binitialize and bAP are set in Setup_board, ditto for rwcc235
-	return out, nil
+	err = o.readCalibration()
+	if err != nil {
+		return err
+	}
+	o.svc = C.svc235_new(o.cfg)
+	if o.svc == nil {
+		return errors.New("unable to allocate the AP235 service thread")
+	}
+	o.serviceCPU = -1
+	for i := range o.repeat {
+		o.repeat[i] = 1
+	}
+	// binitialize and bAP are set in Setup_board
+	return nil
+}
+
+// release frees what a failed open acquired: the service thread, the DMA
+// buffer, the board's handle and the control block
+func (dac *AP235) release() {
+	if dac.cfg == nil {
+		return
+	}
+	if dac.svc != nil {
+		C.svc235_free(dac.svc)
+		dac.svc = nil
+	}
+	if dac.cScatterInfo != nil {
+		C.Teardown_board_corrected_buffer(dac.cfg, dac.cScatterInfo)
+		C.free(unsafe.Pointer(dac.cScatterInfo))
+		dac.cScatterInfo = nil
+	}
+	if dac.cfg.nHandle >= 0 {
+		C.APClose(dac.cfg.nHandle)
+	}
+	C.free_cblk235(dac.cfg)
+	dac.cfg = nil
+}
+
+// readCalibration fills the ID string and calibration coefficients of the
+// board from the calibration cache, or from its flash on a miss
+func (dac *AP235) readCalibration() error {
+	C.rsts235(dac.cfg)
+	key := calibrationKey("ap235", int(dac.cfg.location), uint32(dac.cfg.revision))
+	id := (*[32]byte)(unsafe.Pointer(&dac.cfg.IDbuf))
+	ogc := (*[16 * 8 * 2]int16)(unsafe.Pointer(&dac.cfg.ogc235))[:]
+	if loadCalibration(key, id, ogc) {
+		return nil
+	}
+	if C.read_calibration235(dac.cfg) != 0 {
+		return errors.New("error reading calibration data from AP235")
+	}
+	storeCalibration(key, id, ogc)
+	return nil
+}
+
+// IOMode returns the register access mode the board was opened with
+func (dac *AP235) IOMode() IOMode {
+	return IOMode(C.APGetIOMode(dac.cfg.nHandle))
+}
+
+// SetWriteDelayMode selects how the settling delay after register writes
+// is waited out.  The error is only non-nil if the mode is invalid
+func (dac *AP235) SetWriteDelayMode(mode DelayMode) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if mode < DelaySleep || mode > DelayCoalesce {
+		return fmt.Errorf("write delay mode %d is not allowed", mode)
+	}
+	errC := C.APSetWriteDelayMode(dac.cfg.nHandle, C.int(mode))
+	return enrich(errC, "APSetWriteDelayMode")
+}
+
+// SetDMAWaitMode selects how the refill path waits for a DMA transfer to
+// complete in waveform-dma mode.  The error is only non-nil if the mode is
+// invalid or the DAC is playing back a waveform
+func (dac *AP235) SetDMAWaitMode(mode DMAWaitMode) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if mode != DMAWaitPoll && mode != DMAWaitInterrupt {
+		return fmt.Errorf("DMA wait mode %d is not allowed", mode)
+	}
+	if dac.playingBack {
+		return errors.New("AP235 cannot change DMA wait mode during playback")
+	}
+	dac.cfg.DMAWaitMode = C.int(mode)
+	return nil
 }
 
 // SetRange configures the output range of the DAC
@@ -211,7 +376,7 @@ func (dac *AP235) SetTriggerMode(channel int, triggerMode string) error {
 	dac.cfg.opts._chan[C.int(channel)].TriggerSource = C.int(tm)
 	opMode, _ := dac.GetOperatingMode(channel)
 	dac.sendCfgToBoard(channel)
-	if opMode == "waveform" {
+	if opMode == "waveform" || opMode == "waveform-dma" {
 		if (triggerMode != "external") && (triggerMode != "timer") {
 			return ErrIncompatibleOperatingTrigger
 		}
@@ -236,7 +401,7 @@ func (dac *AP235) SetTriggerDirection(b bool) error {
 		i = 1
 	}
 	dac.cfg.TriggerDirection = C.uint32_t(i)
-	// dac.sendCfgToBoard() TODO: need to send to board?
+	// reaches the board with the next channel configuration
 	return nil
 }
 
@@ -253,7 +418,8 @@ func (dac *AP235) GetTriggerDirection() (bool, error) {
 
 // SetOperatingMode changes the operating mode of the DAC.
 //
-// Valid modes are 'single', 'waveform'.
+// Valid modes are 'single', 'waveform', 'waveform-dma'.  In 'waveform-dma'
+// the FIFO is refilled by the board's DMA engine, see OperatingWaveformDMA.
 //
 // a non-nil error will be generated if the triggering mode
 // for this channel is incomaptible.  The config change will
@@ -263,6 +429,11 @@ func (dac *AP235) GetTriggerDirection() (bool, error) {
 func (dac *AP235) SetOperatingMode(channel int, mode string) error {
 	dac.Lock()
 	defer dac.Unlock()
+	return dac.setOperatingMode(channel, mode)
+}
+
+// setOperatingMode is SetOperatingMode for callers holding the lock
+func (dac *AP235) setOperatingMode(channel int, mode string) error {
 	o, err := ValidateOperatingMode(mode)
 	if err != nil {
 		return err
@@ -270,13 +441,12 @@ func (dac *AP235) SetOperatingMode(channel int, mode string) error {
 	dac.cfg.opts._chan[C.int(channel)].OpMode = C.int(o)
 	trigger, _ := dac.GetTriggerMode(channel)
 	dac.sendCfgToBoard(channel)
-	if mode == "waveform" {
-		dac.isWaveform[channel] = true
+	dac.isWaveform[channel] = o == OperatingWaveform || o == OperatingWaveformDMA
+	if dac.isWaveform[channel] {
 		if (trigger != "external") && (trigger != "timer") {
 			return ErrIncompatibleOperatingTrigger
 		}
 	}
-	dac.isWaveform[channel] = false
 	return nil
 }
 
@@ -362,24 +532,61 @@ func (dac *AP235) GetTimerPeriod() (uint32, error) {
 	return uint32(dac.cfg.TimerDivider) * 32, nil
 }
 
-// sendCfgToBoard updates the configuration on the board
+// BeginConfig starts a configuration transaction.  Until CommitConfig,
+// setters only change the configuration held in memory, so a board can be set
+// up with any number of calls at the cost of one round of register writes.
+// Clear, Reset and CommitWaveformBuffer still reach the board immediately
+func (dac *AP235) BeginConfig() {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.staging = true
+}
+
+// CommitConfig ends a configuration transaction, writing to the board only
+// the registers whose value changed since they were last written.
+// The error is always nil; the API looks this way for symmetry with the setters
+func (dac *AP235) CommitConfig() error {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.staging = false
+	dac.writeCfg(dac.staged)
+	return nil
+}
+
+// sendCfgToBoard updates the configuration on the board, or stages it
+// inside a configuration transaction
 func (dac *AP235) sendCfgToBoard(channel int) {
-	C.cnfg235(dac.cfg, C.int(channel))
-	return
+	if dac.staging {
+		dac.staged |= 1 << uint(channel)
+		return
+	}
+	dac.writeCfg(1 << uint(channel))
 }
 
-// Output writes a voltage to a channel.
-// the error is only non-nil if the value is out of range
+// writeCfg writes the changed configuration of the channels in mask, and
+// the timer and trigger direction, to the board
+func (dac *AP235) writeCfg(mask uint32) {
+	C.cnfgdiff235(dac.cfg, C.uint32_t(mask))
+	traceConfig(dac.cfg.trace, mask)
+	dac.staged &^= mask
+}
+
+// Output writes a voltage to a channel, corrected for the channel's range.
+// the error is only non-nil if the channel is set up for waveform mode;
+// out of range voltages are clipped
 func (dac *AP235) Output(channel int, voltage float64) error {
-	// TODO: look into cd235 C function
-	// this is a hack to improve code reuse, no need to allocate slices here
-	vB := []float64{voltage}
-	vU := []uint16{0}
-	dac.calibrateData(channel, vB, vU)
-	return dac.OutputDN16(channel, vU[0])
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.isWaveform[channel] {
+		return ErrIncompatibleWaveform
+	}
+	C.outv235(dac.cfg, C.int(channel), C.double(voltage))
+	return nil
 }
 
-// OutputDN16 writes a value to the board in DN.
+// OutputDN16 writes a value to the board in DN.  The DN spans the channel's
+// range ideally and is corrected like a voltage would be; see SetDNTable, and
+// OutputCode to write codes that are already corrected.
 //
 // if the channel is set up for waveform mode, an error is generated.
 // otherwise, it is nil.
@@ -389,23 +596,22 @@ func (dac *AP235) OutputDN16(channel int, value uint16) error {
 	if dac.isWaveform[channel] {
 		return ErrIncompatibleWaveform
 	}
-	// going to round trip, since we want to use the DAC in calibrated mode
-	// convert value to a f64
-	rng, _ := dac.GetRange(channel)
-	min, max := RangeToMinMax(rng)
-	step := (max - min) / 65535
-	fV := []float64{min + step*float64(value)}
+	C.outdn235(dac.cfg, C.int(channel), C.ushort(value))
+	return nil
+}
 
-	// set FIFO configuration for this channel to 1 sample
-	cCh := C.int(channel)
-	dac.cfg.SampleCount[cCh] = 1
-	ptr := &dac.cfg.pcor_buf[cCh][0]
-	ptr2 := &dac.cfg.pcor_buf[cCh][1]
-	dac.cfg.current_ptr[cCh] = ptr
-	dac.cfg.head_ptr[cCh] = ptr
-	dac.cfg.tail_ptr[cCh] = ptr2
-	C.cd235(dac.cfg, C.int(channel), (*C.double)(&fV[0]))
-	C.fifowro235(dac.cfg, cCh)
+// OutputCode writes a code, such as one from CalibrateFloat64, to a channel
+// as-is.
+//
+// if the channel is set up for waveform mode, an error is generated.
+// otherwise, it is nil.
+func (dac *AP235) OutputCode(channel int, code uint16) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.isWaveform[channel] {
+		return ErrIncompatibleWaveform
+	}
+	C.out235(dac.cfg, C.int(channel), C.ushort(code))
 	return nil
 }
 
@@ -423,39 +629,15 @@ func (dac *AP235) OutputDN16(channel int, value uint16) error {
 //
 // passing zero length slices will cause a panic.  Slices must be of equal length.
 func (dac *AP235) OutputMulti(channels []int, voltages []float64) error {
-	// how this is different to AP236:
-	// AP236 is immediate output.  Write output -> it happens.
-	// AP235 is waveform and has three triggering modes for each
-	// channel:
-	// 1.  software
-	// 2.  timer
-	// 3.  exterinal input
-	// ensure channels are homogeneous
-	sim, _ := dac.GetOutputSimultaneous(channels[0])
-	for i := 0; i < len(channels); i++ { // old for is faster than range, this code may be hot
-		tm, _ := dac.GetTriggerMode(channels[i])
-		if tm != "software" {
-			return fmt.Errorf("trigger mode must be software.  Channel %d was %s",
-				channels[i], tm)
-		}
-		sim2, _ := dac.GetOutputSimultaneous(channels[i])
-		if sim2 != sim {
-			return fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
-				channels[i], channels[0])
-		}
-		if dac.isWaveform[channels[i]] {
-			return ErrIncompatibleWaveform
-		}
-	}
-
-	for i := 0; i < len(channels); i++ {
-		err := dac.Output(channels[i], voltages[i])
-		if err != nil {
-			return fmt.Errorf("channel %d voltage %f: %w", channels[i], voltages[i], err)
-		}
+	dac.Lock()
+	defer dac.Unlock()
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
 	}
+	dac.writeMulti(channels, voltages)
 	if sim {
-		dac.Flush()
+		dac.flush()
 	}
 	return nil
 }
@@ -463,6 +645,22 @@ func (dac *AP235) OutputMulti(channels []int, voltages []float64) error {
 // OutputMultiDN16 is equivalent to OutputMulti, but with DNs instead of volts.
 // see the docstring of OutputMulti for more information.
 func (dac *AP235) OutputMultiDN16(channels []int, uint16s []uint16) error {
+	dac.Lock()
+	defer dac.Unlock()
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
+	}
+	dac.writeMultiDN16(channels, uint16s)
+	if sim {
+		dac.flush()
+	}
+	return nil
+}
+
+// checkMulti returns whether channels are in simultaneous output mode,
+// and an error if they cannot be written together by OutputMulti
+func (dac *AP235) checkMulti(channels []int) (bool, error) {
 	// how this is different to AP236:
 	// AP236 is immediate output.  Write output -> it happens.
 	// AP235 is waveform and has three triggering modes for each
@@ -475,33 +673,103 @@ func (dac *AP235) OutputMultiDN16(channels []int, uint16s []uint16) error {
 	for i := 0; i < len(channels); i++ { // old for is faster than range, this code may be hot
 		tm, _ := dac.GetTriggerMode(channels[i])
 		if tm != "software" {
-			return fmt.Errorf("trigger mode must be software.  Channel %d was %s",
+			return sim, fmt.Errorf("trigger mode must be software.  Channel %d was %s",
 				channels[i], tm)
 		}
 		sim2, _ := dac.GetOutputSimultaneous(channels[i])
 		if sim2 != sim {
-			return fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
+			return sim, fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
 				channels[i], channels[0])
 		}
 		if dac.isWaveform[channels[i]] {
-			return ErrIncompatibleWaveform
+			return sim, ErrIncompatibleWaveform
 		}
 	}
+	return sim, nil
+}
 
-	for i := 0; i < len(channels); i++ {
-		err := dac.OutputDN16(channels[i], uint16s[i])
-		if err != nil {
-			return fmt.Errorf("channel %d DN %d: %w", channels[i], uint16s[i], err)
+// writeMulti writes voltages to channels, one batch of register writes per
+// (up to) 16 channels, with the lock held
+func (dac *AP235) writeMulti(channels []int, voltages []float64) {
+	var (
+		cch [16]C.int
+		cv  [16]C.double
+	)
+	for start := 0; start < len(channels); start += len(cch) {
+		n := len(channels) - start
+		if n > len(cch) {
+			n = len(cch)
+		}
+		for i := 0; i < n; i++ {
+			cch[i] = C.int(channels[start+i])
+			cv[i] = C.double(voltages[start+i])
 		}
+		C.wromulti235(dac.cfg, C.int(n), &cch[0], &cv[0])
 	}
-	if sim {
-		dac.Flush()
+}
+
+// writeMultiDN16 is writeMulti for DNs
+func (dac *AP235) writeMultiDN16(channels []int, uint16s []uint16) {
+	var (
+		cch [16]C.int
+		cdn [16]C.ushort
+	)
+	for start := 0; start < len(channels); start += len(cch) {
+		n := len(channels) - start
+		if n > len(cch) {
+			n = len(cch)
+		}
+		for i := 0; i < n; i++ {
+			cch[i] = C.int(channels[start+i])
+			cdn[i] = C.ushort(uint16s[start+i])
+		}
+		C.wromultidn235(dac.cfg, C.int(n), &cch[0], &cdn[0])
+	}
+}
+
+// groupChannels, stage, stageDN16 and trigger make the AP235 a GroupMember;
+// the group calls the last three with the lock held
+func (dac *AP235) groupChannels() int {
+	return 16
+}
+
+func (dac *AP235) stage(channels []int, voltages []float64) error {
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
 	}
+	if !sim {
+		return ErrNotSimultaneous
+	}
+	dac.writeMulti(channels, voltages)
+	return nil
+}
+
+func (dac *AP235) stageDN16(channels []int, uint16s []uint16) error {
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
+	}
+	if !sim {
+		return ErrNotSimultaneous
+	}
+	dac.writeMultiDN16(channels, uint16s)
 	return nil
 }
 
+func (dac *AP235) trigger() (C.int, C.APWRITE_OP) {
+	return dac.cfg.nHandle, C.trigger_op235(dac.cfg)
+}
+
 // Flush writes any pending output values to the device
 func (dac *AP235) Flush() {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.flush()
+}
+
+// flush is Flush for callers holding the lock
+func (dac *AP235) flush() {
 	C.simtrig235(dac.cfg)
 }
 
@@ -513,14 +781,74 @@ func (dac *AP235) StartWaveform() error {
 	if dac.playingBack {
 		return errors.New("AP235 is already playing back a waveform")
 	}
-	go dac.serviceInterrupts()
+	err := dac.loadWaveforms()
+	if err != nil {
+		return err
+	}
+	errC := C.svc235_start(dac.svc, C.int(dac.serviceCPU), C.int(dac.servicePriority))
+	if err := enrich(errC, "svc235_start"); err != nil {
+		return err
+	}
 	dac.playingBack = true
 	C.start_waveform(dac.cfg)
 	return nil
 }
 
+// loadWaveforms shares the sample memory among the channels with committed
+// waveforms or generators and sends each its first half FIFO of samples, from
+// the start of its waveform
+func (dac *AP235) loadWaveforms() error {
+	var mask uint32
+	for i := 0; i < 16; i++ {
+		if dac.isWaveform[i] {
+			mask |= dac.committed & (1 << uint(i))
+		}
+	}
+	C.partition235(dac.cfg, C.uint32_t(mask))
+	dac.active = mask
+	dac.live = mask & dac.generating
+	for i := 0; i < 16; i++ {
+		if mask&(1<<uint(i)) == 0 {
+			continue
+		}
+		dac.cfg.DMAPingPong[i] = 0 // first DMA page is the head of pcor_buf
+		if dac.live&(1<<uint(i)) != 0 {
+			errC := C.svc235_generate(dac.svc, C.int(i), &dac.generator[i])
+			if err := enrich(errC, "svc235_generate"); err != nil {
+				return fmt.Errorf("channel %d: %w", i, err)
+			}
+		} else if dac.scheduled&(1<<uint(i)) != 0 {
+			errC := C.svc235_schedule(dac.svc, C.int(i), dac.schedule[i], C.size_t(dac.scheduleLen[i]))
+			if err := enrich(errC, "svc235_schedule"); err != nil {
+				return fmt.Errorf("channel %d: %w", i, err)
+			}
+		} else {
+			head := (*C.short)(unsafe.Pointer(&dac.buffer[i][0]))
+			C.svc235_load(dac.svc, C.int(i), head, C.size_t(len(dac.buffer[i])), C.uint(dac.repeat[i]))
+		}
+		errC := C.svc235_transfer(dac.svc, C.int(i), nil)
+		if err := enrich(errC, "svc235_transfer"); err != nil {
+			return fmt.Errorf("channel %d: %w", i, err)
+		}
+	}
+	return nil
+}
+
+// FIFODepth returns the number of samples of sample memory the FIFO of a
+// channel has.  The channels with committed waveforms share the whole sample
+// memory evenly from StartWaveform on; half the depth is sent per refill
+func (dac *AP235) FIFODepth(channel int) int {
+	dac.Lock()
+	defer dac.Unlock()
+	if n := int(dac.cfg.WinSize[channel]); n != 0 {
+		return n
+	}
+	return MAXSAMPLES
+}
+
 // StopWaveform stops playback on all channels.
-// the error is non-nil only if playback is not occuring
+// the error is non-nil if playback is not occuring, or if a transfer to the
+// board failed during playback (playback is still stopped)
 func (dac *AP235) StopWaveform() error {
 	dac.Lock()
 	defer dac.Unlock()
@@ -528,141 +856,584 @@ func (dac *AP235) StopWaveform() error {
 		return errors.New("AP235 is not playing back a waveform")
 	}
 	dac.playingBack = false
+	C.svc235_stop(dac.svc)
 	C.stop_waveform(dac.cfg)
+	for i := 0; i < 16; i++ {
+		if dac.settle(i) {
+			dac.swapping &^= 1 << uint(i) // never taken, the staged waveform stays staged
+		}
+	}
+	return dac.playbackErrors()
+}
+
+// playbackErrors drains the service thread's events into an error.
+// Only while the thread is stopped
+func (dac *AP235) playbackErrors() error {
+	var (
+		ev    C.struct_svcevent
+		first error
+		n     int
+	)
+	for C.svc235_event(dac.svc, &ev) != 0 {
+		if first == nil {
+			first = fmt.Errorf("channel %d: %w", int(ev.channel), enrich(C.APSTATUS(ev.status), "fifodmawro235"))
+		}
+		n++
+	}
+	n += int(C.svc235_lost(dac.svc))
+	if n > 1 {
+		return fmt.Errorf("%d transfers failed during playback, the first on %w", n, first)
+	}
+	return first
+}
+
+// SetServiceCPU pins the waveform service thread to a core from the next
+// StartWaveform, cpu < 0 lets it run anywhere.  The error is only non-nil if
+// the DAC is playing back a waveform
+func (dac *AP235) SetServiceCPU(cpu int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.playingBack {
+		return errors.New("AP235 cannot change the service CPU during playback")
+	}
+	if cpu < 0 {
+		cpu = -1
+	}
+	dac.serviceCPU = cpu
+	return nil
+}
+
+// SetServicePriority runs the waveform service thread with SCHED_FIFO
+// real-time scheduling at the given priority (1-99) from the next
+// StartWaveform, 0 restores normal scheduling.  StartWaveform fails if the
+// process lacks the privilege (CAP_SYS_NICE or an RLIMIT_RTPRIO) for it.
+// The error is only non-nil if the priority is invalid or the DAC is
+// playing back a waveform
+func (dac *AP235) SetServicePriority(priority int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if priority < 0 || priority > 99 {
+		return fmt.Errorf("service priority %d is not allowed", priority)
+	}
+	if dac.playingBack {
+		return errors.New("AP235 cannot change the service priority during playback")
+	}
+	dac.servicePriority = priority
 	return nil
 }
 
 // need software reset?  drvr235.c, L475
 
-// calibrateData converts a f64 value to uint16.  This is basically cd235
+// CalibrateFloat64 converts volts to DN for the channel at its current range,
+// applying the board's offset and gain corrections exactly as cd235 does.
+// It panics if len(dn) < len(volts) or the channel does not exist.
+func (dac *AP235) CalibrateFloat64(channel int, volts []float64, dn []uint16) {
+	checkCalibrate(channel, len(volts), len(dn))
+	if len(volts) == 0 {
+		return
+	}
+	dac.Lock()
+	defer dac.Unlock()
+	dac.calibrate(channel, volts, dn)
+}
+
+// checkCalibrate panics before C writes past the output of a conversion of n
+// values or past the channels
+func checkCalibrate(channel, n, out int) {
+	if channel < 0 || channel > 15 {
+		panic(fmt.Sprintf("acromag: channel %d does not exist", channel))
+	}
+	if out < n {
+		panic(fmt.Sprintf("acromag: conversion of %d values into %d", n, out))
+	}
+}
+
+// calibrate is CalibrateFloat64 for callers holding the lock; the correction
+// record of the channel is rebuilt on a change of range
+func (dac *AP235) calibrate(channel int, volts []float64, dn []uint16) {
+	C.calibrate235(dac.cfg, C.int(channel), (*C.double)(&volts[0]), (*C.ushort)(&dn[0]), C.size_t(len(volts)))
+}
+
+// CalibrateFloat32 is CalibrateFloat64 for single precision volts
+func (dac *AP235) CalibrateFloat32(channel int, volts []float32, dn []uint16) {
+	checkCalibrate(channel, len(volts), len(dn))
+	if len(volts) == 0 {
+		return
+	}
+	dac.Lock()
+	defer dac.Unlock()
+	C.calibrate235_f32(dac.cfg, C.int(channel), (*C.float)(&volts[0]), (*C.ushort)(&dn[0]), C.size_t(len(volts)))
+}
+
+// CalibrateDN16 converts DNs spanning the channel's range ideally to
+// corrected codes, as OutputDN16 does; see SetDNTable.
+// It panics if len(codes) < len(dn) or the channel does not exist.
+func (dac *AP235) CalibrateDN16(channel int, dn []uint16, codes []uint16) {
+	checkCalibrate(channel, len(dn), len(codes))
+	if len(dn) == 0 {
+		return
+	}
+	dac.Lock()
+	defer dac.Unlock()
+	C.calibrate235_dn(dac.cfg, C.int(channel), (*C.ushort)(&dn[0]), (*C.ushort)(&codes[0]), C.size_t(len(dn)))
+}
+
+// calRecord returns the terms of the correction of a channel at its current
+// range, see APCAL
+func (dac *AP235) calRecord(channel int) (gain, offset, cliplo, cliphi float64) {
+	dac.Lock()
+	defer dac.Unlock()
+	cal := C.cal235(dac.cfg, C.int(channel))
+	return float64(cal.gain), float64(cal.offset), float64(cal.cliplo), float64(cal.cliphi)
+}
+
+// SetDNTable selects whether DNs (OutputDN16, CalibrateDN16) are corrected
+// through a 65536 entry table per channel (128 KiB each) instead of floating
+// point math.  A channel's table is built on its first DN after the table is
+// enabled or its range or calibration changes.
+// The error is always nil
+func (dac *AP235) SetDNTable(enabled bool) error {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.cfg.UseLUT = C.FALSE
+	if enabled {
+		dac.cfg.UseLUT = C.TRUE
+	}
+	return nil
+}
+
+// calibrateData converts a f64 value to uint16.  This is cd235.
 // len(buffer) shall == len(volts)
 func (dac *AP235) calibrateData(channel int, volts []float64, buffer []uint16) {
-	// see AP235 manual (PDF), page 68
-	cCh := C.int(channel)
-	rngS, _ := dac.GetRange(channel)    // err always nil
-	rng, _ := ValidateOutputRange(rngS) // err always nil
-	gainCoef := 1 + float64(dac.cfg.ogc235[cCh][rng][gain])/(65535*16)
-	slopeCoef := float64(dac.cfg.pIdealCode[rng][idealSlope])
-	off := float64(dac.cfg.pIdealCode[rng][idealZeroBTC]) + float64(dac.cfg.ogc235[channel][rng][offset])/16
-	gain := gainCoef * slopeCoef
-	min := float64(dac.cfg.pIdealCode[rng][clipLo])
-	max := float64(dac.cfg.pIdealCode[rng][clipHi])
-	for i := 0; i < len(volts); i++ {
-		in := volts[i]
-		out := gain*in + off
-		if out > max {
-			out = max
-		} else if out < min {
-			out = min
+	dac.CalibrateFloat64(channel, volts, buffer)
+}
+
+// WaveformBuffer returns a writable view of size samples (DN) for the
+// waveform of a channel.  Samples written to it are played back as-is after
+// CommitWaveformBuffer; there is no copy in between.
+//
+// waveforms of up to MAXSAMPLES samples are placed directly in the channel's
+// part of the DMA buffer, longer ones in a page locked buffer that is reused
+// until a larger one is needed.  The view is valid until the next call to
+// WaveformBuffer for the channel or Close, and should not be written after
+// CommitWaveformBuffer, which may move the waveform out of the DMA buffer.
+//
+// the error is non-nil if the DAC is playing back a waveform, the channel
+// does not exist or the allocation fails
+func (dac *AP235) WaveformBuffer(channel int, size int) ([]uint16, error) {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.playingBack {
+		return nil, errors.New("AP235 cannot change waveform table during playback")
+	}
+	if channel < 0 || channel > 15 {
+		return nil, fmt.Errorf("channel %d does not exist", channel)
+	}
+	if size < 1 {
+		return nil, fmt.Errorf("waveform size %d is not allowed", size)
+	}
+	if size <= MAXSAMPLES {
+		dac.freePinned(channel)
+		dac.buffer[channel] = cSliceU16(&dac.cfg.pcor_buf[channel][0], size)
+	} else {
+		if cap(dac.pinned[channel]) < size {
+			dac.freePinned(channel)
+			buf, err := pinned.Default.Uint16s(size)
+			if err != nil {
+				return nil, fmt.Errorf("unable to allocate a %d sample waveform buffer: %w", size, err)
+			}
+			dac.pinned[channel] = buf
 		}
-		// buffer[i] = int16(out) ^ 0x8000 // or with 0x8000 per the manual
-		buffer[i] = uint16(out + 0x8000)
+		dac.buffer[channel] = dac.pinned[channel][:size]
 	}
+	dac.committed &^= 1 << uint(channel)
+	dac.generating &^= 1 << uint(channel)
+	dac.unschedule(channel)
+	return dac.buffer[channel], nil
 }
 
-// PopulateWaveform populates the waveform table for a given channel
-// the error is only non-nil if the DAC is currently playing back a waveform
-func (dac *AP235) PopulateWaveform(channel int, data []float64) error {
-	// need to:
-	// 1) convert f64 => uint16
-	// 2) handle buffer, cursor, sample count
-	//    sampleCount in Go, not SampleCount in C (which is <= 4096)
-	// 3) free old buffers if this isn't the first time we're populating
-	// 5) put the channel in FIFO_DMA mode
-	// 4) do the first dma transfer
+// relocate moves a waveform that lives in pcor_buf to a pinned buffer
+func (dac *AP235) relocate(channel int) error {
+	l := len(dac.buffer[channel])
+	buf, err := pinned.Default.Uint16s(l)
+	if err != nil {
+		return fmt.Errorf("unable to allocate a %d sample waveform buffer: %w", l, err)
+	}
+	copy(buf, dac.buffer[channel])
+	dac.pinned[channel] = buf
+	dac.buffer[channel] = buf
+	return nil
+}
+
+// SetWaveformRepeat sets the number of times the waveform of a channel is
+// played back to back, from the next CommitWaveformBuffer or PopulateWaveform.
+// A count of zero loops the waveform until StopWaveform.  The default is one.
+// The error is only non-nil if the count is negative or the DAC is playing
+// back a waveform
+func (dac *AP235) SetWaveformRepeat(channel int, count int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if count < 0 {
+		return fmt.Errorf("waveform repeat count %d is not allowed", count)
+	}
+	if dac.playingBack {
+		return errors.New("AP235 cannot change waveform repeat during playback")
+	}
+	dac.repeat[channel] = count
+	return nil
+}
+
+// GetWaveformRepeat returns the number of times the waveform of a channel is
+// played, zero for forever.  The error is always nil
+func (dac *AP235) GetWaveformRepeat(channel int) (int, error) {
+	return dac.repeat[channel], nil
+}
+
+// StageWaveform returns a writable view of size samples for the next
+// waveform of a channel during playback, which SwapWaveform puts in place of
+// the one playing without stopping.  The view is a page locked buffer apart
+// from the one playing; the two trade places at each swap, so a sequence of
+// waveforms is played from two buffers.  The view is valid until the next
+// call to StageWaveform for the channel, and becomes the channel's waveform
+// buffer once the swap is taken.
+//
+// the error is non-nil if the DAC is not playing back, if the channel is not
+// playing a waveform buffer, if the previous swap of the channel is still
+// pending (ErrSwapPending) or if the allocation fails
+func (dac *AP235) StageWaveform(channel int, size int) ([]uint16, error) {
+	dac.Lock()
+	defer dac.Unlock()
+	if !dac.playingBack {
+		return nil, errors.New("AP235 stages waveforms only during playback, see WaveformBuffer")
+	}
+	if (dac.active&^dac.live&^dac.scheduled)&(1<<uint(channel)) == 0 {
+		return nil, fmt.Errorf("channel %d is not playing a waveform buffer", channel)
+	}
+	if size < 1 {
+		return nil, fmt.Errorf("waveform size %d is not allowed", size)
+	}
+	if dac.settle(channel) {
+		return nil, ErrSwapPending
+	}
+	if cap(dac.spare[channel]) < size {
+		dac.freeSpare(channel)
+		buf, err := pinned.Default.Uint16s(size)
+		if err != nil {
+			return nil, fmt.Errorf("unable to allocate a %d sample waveform buffer: %w", size, err)
+		}
+		dac.spare[channel] = buf
+	}
+	dac.next[channel] = dac.spare[channel][:size]
+	return dac.next[channel], nil
+}
+
+// SwapWaveform replaces the waveform of a channel during playback with the
+// one staged by StageWaveform.  The service thread takes the swap at the end
+// of the current waveform's period, or at once if it finished playing, so the
+// output goes from the last sample of one period to the first of the new
+// waveform.  The new waveform is played the number of times set by
+// SetWaveformRepeat.  The call does not wait for the swap; see SwapPending.
+//
+// the error is non-nil if the DAC is not playing back, if no waveform is
+// staged, or if the previous swap is still pending (ErrSwapPending)
+func (dac *AP235) SwapWaveform(channel int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if !dac.playingBack {
+		return errors.New("AP235 swaps waveforms only during playback, see CommitWaveformBuffer")
+	}
+	if dac.settle(channel) {
+		return ErrSwapPending
+	}
+	buf := dac.next[channel]
+	if buf == nil {
+		return errors.New("no waveform staged, see StageWaveform")
+	}
+	head := (*C.short)(unsafe.Pointer(&buf[0]))
+	if C.svc235_swap(dac.svc, C.int(channel), head, C.size_t(len(buf)), C.uint(dac.repeat[channel])) == 0 {
+		return ErrSwapPending
+	}
+	dac.swapping |= 1 << uint(channel)
+	return nil
+}
+
+// SwapPending returns true while a swap of the channel made by SwapWaveform
+// waits for the end of the current waveform's period
+func (dac *AP235) SwapPending(channel int) bool {
+	dac.Lock()
+	defer dac.Unlock()
+	return dac.settle(channel)
+}
+
+// settle makes the trade of buffers of a swap the service thread has taken:
+// the staged buffer becomes the channel's, and the old one, if page locked,
+// the spare.  It returns true if the swap is still pending
+func (dac *AP235) settle(channel int) bool {
+	bit := uint32(1) << uint(channel)
+	if dac.swapping&bit == 0 {
+		return false
+	}
+	if C.svc235_swap_pending(dac.svc, C.int(channel)) != 0 {
+		return true
+	}
+	dac.swapping &^= bit
+	dac.pinned[channel], dac.spare[channel] = dac.spare[channel], dac.pinned[channel]
+	dac.buffer[channel] = dac.next[channel]
+	dac.next[channel] = nil
+	return false
+}
+
+// freeSpare releases the staging buffer of a channel, if any
+func (dac *AP235) freeSpare(channel int) {
+	if dac.spare[channel] != nil {
+		pinned.Default.PutUint16s(dac.spare[channel])
+		dac.spare[channel] = nil
+	}
+}
+
+// freePinned releases the pinned buffer of a channel, if any
+func (dac *AP235) freePinned(channel int) {
+	if dac.pinned[channel] != nil {
+		pinned.Default.PutUint16s(dac.pinned[channel])
+		dac.pinned[channel] = nil
+	}
+}
+
+// CommitWaveformBuffer puts the channel in waveform mode and marks the view
+// returned by WaveformBuffer for playback from the next StartWaveform.
+//
+// the error is non-nil if there is no buffer to commit, the DAC is currently
+// playing back a waveform, or the trigger mode is incompatible
+func (dac *AP235) CommitWaveformBuffer(channel int) error {
 	// we do not start the background thread until waveform playback starts
 	// since we only want to start the one thread, not one per channel.
-
-	// create a buffer long enough to hold the waveform in uint16s
+	dac.Lock()
+	defer dac.Unlock()
 	if dac.playingBack {
 		return errors.New("AP235 cannot change waveform table during playback")
 	}
-
-	err := dac.SetOperatingMode(channel, "waveform")
-	if err != nil {
-		return err // err is beneign, but force users to reconfigure DAC first
+	if dac.buffer[channel] == nil {
+		return errors.New("no waveform buffer to commit, see WaveformBuffer")
 	}
-	l := len(data)
-	buf, cptr, err := cMkarrayU16(l)
+	mode, err := dac.armWaveform(channel)
 	if err != nil {
 		return err
 	}
+	l := len(dac.buffer[channel])
+	if mode == "waveform-dma" && dac.repeat[channel] != 1 && dac.pinned[channel] == nil && l%MaxXferSize != 0 {
+		// looping a waveform that does not fill pcor_buf's pages exactly
+		// would copy parts of it over itself, so move it out first
+		err = dac.relocate(channel)
+		if err != nil {
+			return err
+		}
+	}
+	dac.committed |= 1 << uint(channel)
+	dac.generating &^= 1 << uint(channel)
+	dac.unschedule(channel)
+	return nil
+}
 
-	err = dac.Clear(channel)
-	if err != nil {
-		return err // err is beneign, but dump the buffer first
+// armWaveform puts a channel in waveform mode, keeping DMA if it was set,
+// empties its FIFO and enables its interrupt.  It returns the mode.
+// The caller holds the lock and has checked the DAC is not playing back
+func (dac *AP235) armWaveform(channel int) (string, error) {
+	mode, _ := dac.GetOperatingMode(channel)
+	if mode != "waveform-dma" {
+		mode = "waveform"
 	}
-	if dac.cptr[channel] != nil {
-		// free old buffer and replace
-		C.aligned_free(unsafe.Pointer(dac.cptr[channel]))
+	err := dac.setOperatingMode(channel, mode)
+	if err != nil {
+		return mode, err // err is beneign, but force users to reconfigure DAC first
 	}
-	dac.cptr[channel] = cptr
-
+	dac.clear(channel) // dump the buffer first
 	// set the interrupt source for this channel (needed for transfer interrupt)
 	dac.cfg.opts._chan[channel].InterruptSource = 1
-	dac.sendCfgToBoard(channel) // need to make sure this value propagates to the FPGA
+	dac.writeCfg(1 << uint(channel)) // need to make sure this value propagates to the FPGA
+	return mode, nil
+}
 
-	// now convert each value to a u16 and update the buffer
-	dac.calibrateData(channel, data, buf) // "moves" data->buf
-	dac.sampleCount[channel] = l
-	dac.cursor[channel] = 0
-	dac.buffer[channel] = buf
-	dac.cfg.head_ptr[channel] = (*C.short)(unsafe.Pointer(&dac.buffer[channel][0]))
-	C.set_DAC_sample_addresses(dac.cfg, C.int(channel))
-	dac.doTransfer(channel)
-	return nil
-}
-
-// serviceInterrupts should be run as a background goroutine; it handles
-// interrupts from the DAC to keep it fed
-func (dac *AP235) serviceInterrupts() {
-	// the minimum recommended timer period is 0x136
-	// which is (310 * 32 ns) = 9.9us
-	// so this loop could happen as frequently as
-	// 9.9us * 2048 samples = 20 ms
-	// it's not all that hot after all.
-	//
-	// the above was for DMA, and is true
-	// however, now we are considering the non-DMA case
-	// where it is 1us/sample transfer time
-	// so the interrupt could come and we need
-	// 2048*16 = 32768 samples = 32768 or more us
-	// per interrupt, given a period of only about 20 ms.
-	// this is not viable.
-	// suggest to add an error to the timer period
-	// function for periods < 2x the recommended limit
-	// which is ~50kHz
-	dac.Lock()
-	C.enable_interrupts(dac.cfg)
-	dac.Unlock()
-	for {
-		// fetch_status blocks for an extended period, so we will hold the lock
-		// for an extended period.  At 5k samples per second and 2048 samples
-		// per channel, that could be 500 ms (an eternitity for real time)
-		// this is a nasty pickle.
-		//
-		// it isn't solved here.  You might be okay if you run a waveform and
-		// try to talk to the DAC on other channels at the same time.  It could
-		// deadlock.  I don't know how to solve this problem in a way that makes
-		// the waveform and any real time needs happy simultaneously.
-		// TODO
-		Cstatus := C.fetch_status(dac.cfg)
-		status := uint(Cstatus)
-
-		if status == 0 {
-			return
+// SetGenerator plays a waveform computed during playback on a channel in
+// place of its waveform buffer, from the next StartWaveform until
+// StopWaveform; the repeat count does not apply.  Each refill is synthesized
+// and calibrated as it is sent, so the memory used is one refill whatever the
+// period of the waveform.  WaveformBuffer or CommitWaveformBuffer return the
+// channel to its buffer.
+//
+// During playback, a channel already playing a generator can be switched to
+// another without stopping.  The call only hands the new generator to the
+// service thread; it is played from the channel's next refill, after the
+// samples already in the FIFO, and continues the old one's time.
+//
+// the error is non-nil if the generator is invalid, if the trigger mode is
+// incompatible, or during playback if the channel is not playing a generator
+func (dac *AP235) SetGenerator(channel int, gen Generator) error {
+	cgen, err := gen.toC()
+	if err != nil {
+		return err
+	}
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.playingBack {
+		if dac.live&(1<<uint(channel)) == 0 {
+			return errors.New("AP235 can only switch the generator of a channel playing one during playback")
+		}
+		dac.generator[channel] = cgen
+		C.svc235_switch(dac.svc, C.int(channel), &dac.generator[channel])
+		return nil
+	}
+	if _, err := dac.armWaveform(channel); err != nil {
+		return err
+	}
+	dac.generator[channel] = cgen
+	dac.committed |= 1 << uint(channel)
+	dac.generating |= 1 << uint(channel)
+	dac.unschedule(channel)
+	return nil
+}
+
+// ScheduledOutput is an update of channels at a time from the start of
+// playback, see ScheduleOutputs
+type ScheduledOutput struct {
+	// At is the time of the update from StartWaveform
+	At time.Duration `json:"at"`
+
+	// Channels and Voltages are as in OutputMulti
+	Channels []int     `json:"channels"`
+	Voltages []float64 `json:"voltages"`
+}
+
+// ScheduleOutputs plays a sequence of updates on the channels they name, in
+// place of their waveform buffers, from the next StartWaveform until
+// StopWaveform.  Each update lands on the timer tick nearest its time rather
+// than when software gets to it: the channels are played in waveform mode
+// and their samples hold each update's value until the next, expanded from
+// the updates as each refill is sent.  A channel outputs the value of its
+// first update from the start of playback and holds its last one after it.
+// Of two updates of a channel landing on the same tick, the one of the later
+// time wins, or the later in outputs if their times are equal.  No channel is
+// changed if the error is non-nil.
+//
+// The timer period and the ranges of the channels must be set before.
+// WaveformBuffer, CommitWaveformBuffer or SetGenerator return a channel to
+// its buffer or a generator, channels not named keep what they play.
+//
+// the error is non-nil if an update is invalid, the timer period is not set,
+// the trigger mode is incompatible or the DAC is playing back a waveform
+func (dac *AP235) ScheduleOutputs(outputs []ScheduledOutput) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.playingBack {
+		return errors.New("AP235 cannot change a schedule during playback")
+	}
+	period := int64(dac.cfg.TimerDivider) * 32
+	if period == 0 {
+		return errors.New("AP235 timer period must be set before scheduling outputs")
+	}
+	order := make([]int, len(outputs))
+	for i, o := range outputs {
+		if len(o.Channels) != len(o.Voltages) {
+			return fmt.Errorf("update %d has %d channels and %d voltages", i, len(o.Channels), len(o.Voltages))
+		}
+		if o.At < 0 {
+			return fmt.Errorf("update %d is scheduled before the start of playback", i)
 		}
-		// at least one channel requires updating
-		for i := 0; i < 16; i++ { // i = channel index
-			var mask uint = 1 << i
-			if (mask & status) != 0 {
-				dac.Lock()
-				dac.doTransfer(i)
-				dac.Unlock()
+		for _, ch := range o.Channels {
+			if ch < 0 || ch > 15 {
+				return fmt.Errorf("update %d: channel %d does not exist", i, ch)
+			}
+		}
+		order[i] = i
+	}
+	sort.SliceStable(order, func(i, j int) bool { return outputs[order[i]].At < outputs[order[j]].At })
+
+	var (
+		steps [16][]C.struct_svcstep
+		volt  [1]float64
+		code  [1]uint16
+	)
+	for _, i := range order {
+		o := outputs[i]
+		tick := C.ulonglong((o.At.Nanoseconds() + period/2) / period)
+		for j, ch := range o.Channels {
+			volt[0] = o.Voltages[j]
+			dac.calibrate(ch, volt[:], code[:])
+			st := steps[ch]
+			if n := len(st); n > 0 && st[n-1].tick == tick {
+				st[n-1].code = C.short(code[0])
+				continue
 			}
+			steps[ch] = append(st, C.struct_svcstep{tick: tick, code: C.short(code[0])})
 		}
-		C.refresh_interrupt(dac.cfg, Cstatus)
 	}
+	// everything that can fail is done before the first channel is armed,
+	// which then cannot fail
+	var sched [16]*C.struct_svcstep
+	for ch := range steps {
+		if len(steps[ch]) == 0 {
+			continue
+		}
+		if trigger, _ := dac.GetTriggerMode(ch); trigger != "external" && trigger != "timer" {
+			freeSteps(&sched)
+			return fmt.Errorf("channel %d: %w", ch, ErrIncompatibleOperatingTrigger)
+		}
+		n := len(steps[ch])
+		sched[ch] = (*C.struct_svcstep)(C.calloc(C.size_t(n), C.sizeof_struct_svcstep))
+		if sched[ch] == nil {
+			freeSteps(&sched)
+			return fmt.Errorf("unable to allocate a %d step schedule", n)
+		}
+		var cs []C.struct_svcstep
+		hdr := (*reflect.SliceHeader)(unsafe.Pointer(&cs))
+		hdr.Cap = n
+		hdr.Len = n
+		hdr.Data = uintptr(unsafe.Pointer(sched[ch]))
+		copy(cs, steps[ch])
+	}
+	for ch := range steps {
+		if sched[ch] == nil {
+			continue
+		}
+		dac.armWaveform(ch)
+		dac.unschedule(ch)
+		dac.schedule[ch] = sched[ch]
+		dac.scheduleLen[ch] = len(steps[ch])
+		dac.scheduled |= 1 << uint(ch)
+		dac.committed |= 1 << uint(ch)
+		dac.generating &^= 1 << uint(ch)
+	}
+	return nil
+}
+
+// freeSteps frees the schedules of ScheduleOutputs not yet handed to channels
+func freeSteps(sched *[16]*C.struct_svcstep) {
+	for ch, p := range sched {
+		if p != nil {
+			C.free(unsafe.Pointer(p))
+			sched[ch] = nil
+		}
+	}
+}
+
+// unschedule releases the schedule of a channel, if any
+func (dac *AP235) unschedule(channel int) {
+	if dac.schedule[channel] != nil {
+		C.free(unsafe.Pointer(dac.schedule[channel]))
+		dac.schedule[channel] = nil
+		dac.scheduleLen[channel] = 0
+	}
+	dac.scheduled &^= 1 << uint(channel)
+}
+
+// PopulateWaveform populates the waveform table for a given channel
+// the error is only non-nil if the DAC is currently playing back a waveform
+func (dac *AP235) PopulateWaveform(channel int, data []float64) error {
+	buf, err := dac.WaveformBuffer(channel, len(data))
+	if err != nil {
+		return err
+	}
+	dac.calibrateData(channel, data, buf) // converts in place, no copy
+	return dac.CommitWaveformBuffer(channel)
 }
 
 // Clear soft resets the DAC, clearing the output but not configuration
@@ -670,10 +1441,15 @@ func (dac *AP235) serviceInterrupts() {
 func (dac *AP235) Clear(channel int) error {
 	dac.Lock()
 	defer dac.Unlock()
+	dac.clear(channel)
+	return nil
+}
+
+// clear is Clear for callers holding the lock
+func (dac *AP235) clear(channel int) {
 	dac.cfg.opts._chan[C.int(channel)].DataReset = C.int(1)
-	dac.sendCfgToBoard(channel)
+	dac.writeCfg(1 << uint(channel))
 	dac.cfg.opts._chan[C.int(channel)].DataReset = C.int(0)
-	return nil
 }
 
 // Reset completely clears both data and configuration for a channel
@@ -682,25 +1458,99 @@ func (dac *AP235) Reset(channel int) error {
 	dac.Lock()
 	defer dac.Unlock()
 	dac.cfg.opts._chan[C.int(channel)].FullReset = C.int(1)
-	dac.sendCfgToBoard(channel)
+	dac.writeCfg(1 << uint(channel))
 	dac.cfg.opts._chan[C.int(channel)].FullReset = C.int(0)
 	return nil
 }
 
 // Close the dac, freeing hardware.
 func (dac *AP235) Close() error {
+	if dac.cfg == nil {
+		return nil // failed to open, or closed
+	}
+	dac.StopSampler()
+	C.svc235_free(dac.svc) // stops the thread if it is running
+	dac.svc = nil
+	dac.untrace()
+	for i := 0; i < 16; i++ {
+		dac.freePinned(i)
+		dac.freeSpare(i)
+		dac.unschedule(i)
+		dac.buffer[i] = nil
+		dac.next[i] = nil
+	}
 	C.Teardown_board_corrected_buffer(dac.cfg, dac.cScatterInfo)
+	C.free(unsafe.Pointer(dac.cScatterInfo))
+	dac.cScatterInfo = nil
 	errC := C.APClose(dac.cfg.nHandle)
+	C.free_cblk235(dac.cfg)
+	dac.cfg = nil
 	return enrich(errC, "APClose")
 }
 
-// Status retrieves the status of a given channel of the DAC
+// Stats returns the counters of the waveform service thread and the
+// register accesses made to the board.  The service counters are read
+// without stopping or locking the thread
+func (dac *AP235) Stats() PlaybackStats {
+	var cs C.struct_svcstats
+	C.svc235_stats(dac.svc, &cs)
+	out := PlaybackStats{
+		Interrupts:       uint64(cs.interrupts),
+		Samples:          uint64(cs.samples),
+		Underflows:       uint64(cs.underflows),
+		DMATimeouts:      uint64(cs.dma_timeouts),
+		TransferErrors:   uint64(cs.errors),
+		Swaps:            uint64(cs.swaps),
+		RegisterAccesses: uint64(C.APRegisterAccesses(dac.cfg.nHandle)),
+	}
+	for i := 0; i < len(out.LatencyNs); i++ {
+		out.LatencyNs[i] = uint64(cs.latency[i])
+		out.DurationNs[i] = uint64(cs.duration[i])
+		out.SamplesPerInterrupt[i] = uint64(cs.batch[i])
+	}
+	if t := dac.snapshot(); t != nil {
+		out.RegisterRate = t.RegisterRate
+	}
+	return out
+}
+
+// Instrumentation is Stats for generichttp/daq
+func (dac *AP235) Instrumentation() interface{} {
+	return dac.Stats()
+}
+
+// Status retrieves the status of a given channel of the DAC.  While the
+// telemetry sampler runs, the status is that of its latest sample and the
+// board is not accessed; see StartSampler
 func (dac *AP235) Status(channel int) ChannelStatus {
+	if t := dac.snapshot(); t != nil {
+		return t.Channels[channel]
+	}
+	return dac.StatusAll()[channel]
+}
+
+// StatusAll retrieves the status of every channel of the DAC, from the
+// latest sample while the telemetry sampler runs
+func (dac *AP235) StatusAll() [16]ChannelStatus {
+	if t := dac.snapshot(); t != nil {
+		return t.Channels
+	}
+	var (
+		regs [16]C.uint32_t
+		out  [16]ChannelStatus
+	)
 	dac.Lock()
-	defer dac.Unlock()
-	C.rsts235(dac.cfg)
+	C.chstatus235(dac.cfg, &regs[0])
+	dac.Unlock()
+	for i, stat := range regs {
+		out[i] = channelStatus(i, uint32(stat))
+	}
+	return out
+}
+
+// channelStatus decodes the status register of a channel
+func channelStatus(channel int, stat uint32) ChannelStatus {
 	out := ChannelStatus{Channel: channel}
-	stat := dac.cfg.ChStatus[channel]
 	out.FIFOEmpty = (stat>>0)&1 == 1
 	out.FIFOHalfFull = (stat>>1)&1 == 1
 	out.FIFOFull = (stat>>2)&1 == 1
@@ -710,40 +1560,12 @@ func (dac *AP235) Status(channel int) ChannelStatus {
 	return out
 }
 
-func (dac *AP235) doTransfer(channel int) {
-	head := dac.cursor[channel]
-	tailOffset := dac.sampleCount[channel] - dac.cursor[channel]
-	if tailOffset > MaxXferSize {
-		tailOffset = MaxXferSize
-	}
-	tailOffset-- // 2048 => 2047, etc.
-	tail := head + tailOffset
-	if tail == dac.sampleCount[channel] {
-		tail--
-	}
-	p1 := (*C.short)(unsafe.Pointer(&dac.buffer[channel][head]))
-	p2 := (*C.short)(unsafe.Pointer(&dac.buffer[channel][tail]))
-	// no need for bytes to transfer, since that only applies in simple DMA mode
-	// fifowro235 only writes half, we want it to write all since we are only
-	// sending half to begin with
-	dac.cfg.SampleCount[channel] = C.uint(tailOffset*2) + 1
-	dac.cfg.current_ptr[channel] = p1
-	dac.cfg.tail_ptr[channel] = p2
-	C.fifowro235(dac.cfg, C.int(channel))
-	dac.cursor[channel] += tailOffset + 1 // todo: wrap around
-}
-
-// CMkarrayU16 allocates a []uint16 in C and returns a Go slice without copying
-// as well as the pointer for freeing, and error if malloc failed.
-func cMkarrayU16(size int) ([]uint16, *C.short, error) {
-	cptr := C.MkDataArray(C.int(size))
-	if cptr == nil {
-		return nil, nil, fmt.Errorf("cMkarrayU16: cmalloc failed")
-	}
+// cSliceU16 returns a Go slice of size samples over memory owned by C
+func cSliceU16(cptr *C.short, size int) []uint16 {
 	var slc []uint16
 	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slc))
 	hdr.Cap = size
 	hdr.Len = size
 	hdr.Data = uintptr(unsafe.Pointer(cptr))
-	return slc, cptr, nil
+	return slc
 }
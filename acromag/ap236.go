@@ -9,55 +9,128 @@ import "C"
 import (
 	"errors"
 	"fmt"
+	"sync"
 	"unsafe"
 )
 
 // AP236 is an acromag 16-bit DAC of the same type
 type AP236 struct {
+	sync.Mutex
+
 	cfg *C.struct_cblk236
+
+	// tracer empties cfg.trace, nil when not tracing; see SetTracer
+	tracer *Tracer
 }
 
 // NewAP236 creates a new instance and opens the connection to the DAC
 func NewAP236(deviceIndex int) (*AP236, error) {
+	return NewAP236WithIO(deviceIndex, IOSyscall)
+}
+
+// NewAP236WithIO is NewAP236 with a choice of register access mode.
+// IOMapped silently falls back to IOSyscall if the board cannot be mapped;
+// check the IOMode method of the returned DAC.  If the error is non-nil,
+// what was acquired of the board is released and Close does nothing
+func NewAP236WithIO(deviceIndex int, mode IOMode) (*AP236, error) {
+	out := &AP236{}
+	err := out.open(deviceIndex, mode)
+	if err != nil {
+		out.release()
+	}
+	return out, err
+}
+
+// open opens the board, initializes it, gets its address, and populates its
+// config
+func (o *AP236) open(deviceIndex int, mode IOMode) error {
 	var (
-		o    AP236
-		out  = &o
 		addr *C.struct_map236
 		cs   = C.CString("ap236_") // copied from AP236.h
 	)
 	defer C.free(unsafe.Pointer(cs))
-	o.cfg = (*C.struct_cblk236)(C.malloc(C.sizeof_struct_cblk236))
+	o.cfg = C.new_cblk236()
+	if o.cfg == nil {
+		return errors.New("unable to allocate the AP236 control block")
+	}
 	o.cfg.pIdealCode = cMkCopyOfIdealData(idealCode)
-	errC := C.APOpen(C.int(deviceIndex), &o.cfg.nHandle, cs)
+	errC := C.APOpenEx(C.int(deviceIndex), &o.cfg.nHandle, cs, C.int(mode), C.sizeof_struct_map236)
 	err := enrich(errC, "APOpen")
 	if err != nil {
-		return out, err
+		return err
 	}
 
 	errC = C.APInitialize(o.cfg.nHandle)
 	err = enrich(errC, "APInitialize")
 	if err != nil {
-		return out, err
+		return err
 	}
 	errC = C.GetAPAddress236(o.cfg.nHandle, &addr)
 	err = enrich(errC, "GetAPAddress")
 	if err != nil {
-		return out, err
+		return err
 	}
 	o.cfg.brd_ptr = addr
 	o.cfg.bInitialized = C.TRUE
 	o.cfg.bAP = C.TRUE
-	errC = C.Setup_board_cal(o.cfg)
-	if errC != 0 {
-		return out, errors.New("error getting offset and gain coefs from AP236")
+	return o.readCalibration(deviceIndex)
+}
+
+// release frees what a failed open acquired: the board's handle and the
+// control block
+func (dac *AP236) release() {
+	if dac.cfg == nil {
+		return
+	}
+	if dac.cfg.nHandle >= 0 {
+		C.APClose(dac.cfg.nHandle)
+	}
+	C.free_luts236(dac.cfg)
+	C.free_cblk236(dac.cfg)
+	dac.cfg = nil
+}
+
+// readCalibration fills the ID string and calibration coefficients of the
+// board from the calibration cache, or from its flash on a miss.  The AP236
+// has no location register, so the device index stands in for it
+func (dac *AP236) readCalibration(deviceIndex int) error {
+	C.rsts236(dac.cfg)
+	key := calibrationKey("ap236", deviceIndex, uint32(dac.cfg.revision))
+	id := (*[32]byte)(unsafe.Pointer(&dac.cfg.IDbuf))
+	ogc := (*[8 * 8 * 2]int16)(unsafe.Pointer(&dac.cfg.ogc236))[:]
+	if loadCalibration(key, id, ogc) {
+		return nil
+	}
+	if C.Setup_board_cal(dac.cfg) != 0 {
+		return errors.New("error getting offset and gain coefs from AP236")
+	}
+	storeCalibration(key, id, ogc)
+	return nil
+}
+
+// IOMode returns the register access mode the board was opened with
+func (dac *AP236) IOMode() IOMode {
+	return IOMode(C.APGetIOMode(dac.cfg.nHandle))
+}
+
+// SetWriteDelayMode selects how the settling delay after register writes
+// is waited out.  The error is only non-nil if the mode is invalid
+func (dac *AP236) SetWriteDelayMode(mode DelayMode) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if mode < DelaySleep || mode > DelayCoalesce {
+		return fmt.Errorf("write delay mode %d is not allowed", mode)
 	}
-	return out, nil
+	errC := C.APSetWriteDelayMode(dac.cfg.nHandle, C.int(mode))
+	return enrich(errC, "APSetWriteDelayMode")
 }
 
 // SetRange configures the output range of the DAC
 // this function only returns an error if the range is not allowed
 // rngS is specified as in ValidateOutputRange
 func (dac *AP236) SetRange(channel int, rngS string) error {
+	dac.Lock()
+	defer dac.Unlock()
 	rng, err := ValidateOutputRange(rngS)
 	if err != nil {
 		return err
@@ -79,6 +152,8 @@ func (dac *AP236) GetRange(channel int) (string, error) {
 // SetPowerUpVoltage configures the voltage set on the DAC at power up
 // The error is only non-nil if the scale is invalid
 func (dac *AP236) SetPowerUpVoltage(channel int, scale OutputScale) error {
+	dac.Lock()
+	defer dac.Unlock()
 	if scale < ZeroScale || scale > FullScale {
 		return fmt.Errorf("output scale %d is not allowed", scale)
 	}
@@ -97,6 +172,8 @@ func (dac *AP236) GetPowerUpVoltage(channel int) (OutputScale, error) {
 // SetClearVoltage sets the voltage applied at the output when the device is cleared
 // the error is only non-nil if the voltage is invalid
 func (dac *AP236) SetClearVoltage(channel int, scale OutputScale) error {
+	dac.Lock()
+	defer dac.Unlock()
 	if scale < ZeroScale || scale > FullScale {
 		return fmt.Errorf("output scale %d is not allowed", scale)
 	}
@@ -116,6 +193,8 @@ func (dac *AP236) GetClearVoltage(channel int) (OutputScale, error) {
 // is detected.  Shutdown == true -> shut down the board on overtemp
 // the error is always nil
 func (dac *AP236) SetOverTempBehavior(channel int, shutdown bool) error {
+	dac.Lock()
+	defer dac.Unlock()
 	i := 0
 	if shutdown {
 		i = 1
@@ -136,6 +215,8 @@ func (dac *AP236) GetOverTempBehavior(channel int) (bool, error) {
 // allowed == true allows the DAC to operate slightly beyond limits
 // the error is always nil
 func (dac *AP236) SetOverRange(channel int, allowed bool) error {
+	dac.Lock()
+	defer dac.Unlock()
 	i := 0
 	if allowed {
 		i = 1
@@ -155,6 +236,8 @@ func (dac *AP236) GetOverRange(channel int) (bool, error) {
 // SetOutputSimultaneous configures the DAC to simultaneous mode or async mode
 // this function will always return nil.
 func (dac *AP236) SetOutputSimultaneous(channel int, simultaneous bool) error {
+	dac.Lock()
+	defer dac.Unlock()
 	sim := 0
 	if simultaneous {
 		sim = 1
@@ -175,15 +258,19 @@ func (dac *AP236) GetOutputSimultaneous(channel int) (bool, error) {
 // sendCfgToBoard updates the configuration on the board
 func (dac *AP236) sendCfgToBoard(channel int) {
 	C.cnfg236(dac.cfg, C.int(channel))
+	traceConfig(dac.cfg.trace, 1<<uint(channel))
 	return
 }
 
 // Output writes a voltage to a channel.
 // the error is only non-nil if the value is out of range
 func (dac *AP236) Output(channel int, voltage float64) error {
-	// TODO: look into cd236 C function
-	C.cd236(dac.cfg, C.int(channel), C.double(voltage))
-	C.wro236(dac.cfg, C.int(channel), (C.word)(dac.cfg.cor_buf[channel]))
+	dac.Lock()
+	defer dac.Unlock()
+	// cd236 + wro236, as one batch
+	ch := C.int(channel)
+	v := C.double(voltage)
+	C.wromulti236(dac.cfg, 1, &ch, &v)
 	return nil
 	// return dac.OutputDN16(channel, dac.calibrateData(channel, voltage))
 }
@@ -191,12 +278,26 @@ func (dac *AP236) Output(channel int, voltage float64) error {
 // OutputDN16 writes a value to the board in DN.
 // the error is always nil
 func (dac *AP236) OutputDN16(channel int, value uint16) error {
-	rng, _ := dac.GetRange(channel)
-	min, max := RangeToMinMax(rng)
-	step := (max - min) / 65535
-	fV := min + step*float64(value)
-	C.cd236(dac.cfg, C.int(channel), C.double(fV))
-	C.wro236(dac.cfg, C.int(channel), (C.word)(dac.cfg.cor_buf[channel]))
+	dac.Lock()
+	defer dac.Unlock()
+	ch := C.int(channel)
+	dn := C.word(value)
+	C.wromultidn236(dac.cfg, 1, &ch, &dn)
+	return nil
+}
+
+// SetDNTable selects whether DNs (OutputDN16, OutputMultiDN16) are corrected
+// through a 65536 entry table per channel (128 KiB each) instead of floating
+// point math.  A channel's table is built on its first DN after the table is
+// enabled or its range or calibration changes.
+// The error is always nil
+func (dac *AP236) SetDNTable(enabled bool) error {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.cfg.UseLUT = C.FALSE
+	if enabled {
+		dac.cfg.UseLUT = C.TRUE
+	}
 	return nil
 }
 
@@ -213,23 +314,15 @@ func (dac *AP236) OutputDN16(channel int, value uint16) error {
 //
 // passing zero length slices will cause a panic.  Slices must be of equal length.
 func (dac *AP236) OutputMulti(channels []int, voltages []float64) error {
-	// ensure channels are homogeneous
-	sim, _ := dac.GetOutputSimultaneous(channels[0])
-	for i := 0; i < len(channels); i++ { // old for is faster than range, this code may be hot
-		sim2, _ := dac.GetOutputSimultaneous(channels[i])
-		if sim2 != sim {
-			return fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
-				channels[i], channels[0])
-		}
-	}
-	for i := 0; i < len(channels); i++ {
-		err := dac.Output(channels[i], voltages[i])
-		if err != nil {
-			return fmt.Errorf("channel %d voltage %f: %w", channels[i], voltages[i], err)
-		}
+	dac.Lock()
+	defer dac.Unlock()
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
 	}
+	dac.writeMulti(channels, voltages)
 	if sim {
-		dac.Flush()
+		dac.flush()
 	}
 	return nil
 }
@@ -237,35 +330,123 @@ func (dac *AP236) OutputMulti(channels []int, voltages []float64) error {
 // OutputMultiDN16 is equivalent to OutputMulti, but with DNs instead of volts.
 // see the docstring of OutputMulti for more information.
 func (dac *AP236) OutputMultiDN16(channels []int, uint16s []uint16) error {
-	// ensure channels are homogeneous
+	dac.Lock()
+	defer dac.Unlock()
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
+	}
+	dac.writeMultiDN16(channels, uint16s)
+	if sim {
+		dac.flush()
+	}
+	return nil
+}
+
+// checkMulti returns whether channels are in simultaneous output mode,
+// and an error if they are not all in the same mode
+func (dac *AP236) checkMulti(channels []int) (bool, error) {
 	sim, _ := dac.GetOutputSimultaneous(channels[0])
 	for i := 0; i < len(channels); i++ { // old for is faster than range, this code may be hot
 		sim2, _ := dac.GetOutputSimultaneous(channels[i])
 		if sim2 != sim {
-			return fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
+			return sim, fmt.Errorf("mixture of output modes used, must be homogeneous.  Channel %d != channel %d",
 				channels[i], channels[0])
 		}
 	}
-	for i := 0; i < len(channels); i++ {
-		err := dac.OutputDN16(channels[i], uint16s[i])
-		if err != nil {
-			return fmt.Errorf("channel %d DN %d: %w", channels[i], uint16s[i], err)
+	return sim, nil
+}
+
+// writeMulti writes voltages to channels, one batch of register writes per
+// (up to) 8 channels, with the lock held
+func (dac *AP236) writeMulti(channels []int, voltages []float64) {
+	var (
+		cch [8]C.int
+		cv  [8]C.double
+	)
+	for start := 0; start < len(channels); start += len(cch) {
+		n := len(channels) - start
+		if n > len(cch) {
+			n = len(cch)
+		}
+		for i := 0; i < n; i++ {
+			cch[i] = C.int(channels[start+i])
+			cv[i] = C.double(voltages[start+i])
 		}
+		C.wromulti236(dac.cfg, C.int(n), &cch[0], &cv[0])
 	}
-	if sim {
-		dac.Flush()
+}
+
+// writeMultiDN16 is writeMulti for DNs
+func (dac *AP236) writeMultiDN16(channels []int, uint16s []uint16) {
+	var (
+		cch [8]C.int
+		cdn [8]C.word
+	)
+	for start := 0; start < len(channels); start += len(cch) {
+		n := len(channels) - start
+		if n > len(cch) {
+			n = len(cch)
+		}
+		for i := 0; i < n; i++ {
+			cch[i] = C.int(channels[start+i])
+			cdn[i] = C.word(uint16s[start+i])
+		}
+		C.wromultidn236(dac.cfg, C.int(n), &cch[0], &cdn[0])
 	}
+}
+
+// groupChannels, stage, stageDN16 and trigger make the AP236 a GroupMember;
+// the group calls the last three with the lock held
+func (dac *AP236) groupChannels() int {
+	return 8
+}
+
+func (dac *AP236) stage(channels []int, voltages []float64) error {
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
+	}
+	if !sim {
+		return ErrNotSimultaneous
+	}
+	dac.writeMulti(channels, voltages)
+	return nil
+}
+
+func (dac *AP236) stageDN16(channels []int, uint16s []uint16) error {
+	sim, err := dac.checkMulti(channels)
+	if err != nil {
+		return err
+	}
+	if !sim {
+		return ErrNotSimultaneous
+	}
+	dac.writeMultiDN16(channels, uint16s)
 	return nil
 }
 
+func (dac *AP236) trigger() (C.int, C.APWRITE_OP) {
+	return dac.cfg.nHandle, C.trigger_op236(dac.cfg)
+}
+
 // Flush writes any pending output values to the device
 func (dac *AP236) Flush() {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.flush()
+}
+
+// flush is Flush for callers holding the lock
+func (dac *AP236) flush() {
 	C.simtrig236(dac.cfg)
 }
 
 // Clear soft resets the DAC, clearing the output but not configuration
 // the error is always nil
 func (dac *AP236) Clear(channel int) error {
+	dac.Lock()
+	defer dac.Unlock()
 	dac.cfg.opts._chan[C.int(channel)].DataReset = C.int(1)
 	dac.sendCfgToBoard(channel)
 	dac.cfg.opts._chan[C.int(channel)].DataReset = C.int(0)
@@ -275,6 +456,8 @@ func (dac *AP236) Clear(channel int) error {
 // Reset completely clears both data and configuration for a channel
 // the error is always nil
 func (dac *AP236) Reset(channel int) error {
+	dac.Lock()
+	defer dac.Unlock()
 	dac.cfg.opts._chan[C.int(channel)].FullReset = C.int(1)
 	dac.sendCfgToBoard(channel)
 	dac.cfg.opts._chan[C.int(channel)].FullReset = C.int(0)
@@ -283,6 +466,15 @@ func (dac *AP236) Reset(channel int) error {
 
 // Close the dac, freeing hardware.
 func (dac *AP236) Close() error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.cfg == nil {
+		return nil // failed to open, or closed
+	}
+	dac.untrace()
+	C.free_luts236(dac.cfg)
 	errC := C.APClose(dac.cfg.nHandle)
+	C.free_cblk236(dac.cfg)
+	dac.cfg = nil
 	return enrich(errC, "APClose")
 }
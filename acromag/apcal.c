@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include "apcal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define APCAL_X86
+#endif
+
+// indices into the ideal code table and correction pairs, as in AP235.h/AP236.h
+#define CAL_IDEALZEROBTC 1
+#define CAL_IDEALSLOPE 2
+#define CAL_CLIPLO 5
+#define CAL_CLIPHI 6
+#define CAL_OFFSET 0
+#define CAL_GAIN 1
+
+void apcal_make(APCAL *cal, double (*pIdealCode)[8][7], const short ogc[2], int range)
+{
+	range &= 0x7;
+	cal->gain = (1.0 + (double)ogc[CAL_GAIN] / 1048576.0) * (*pIdealCode)[range][CAL_IDEALSLOPE];
+	cal->offset = (*pIdealCode)[range][CAL_IDEALZEROBTC] + (double)ogc[CAL_OFFSET] / 16.0;
+	cal->cliplo = (*pIdealCode)[range][CAL_CLIPLO];
+	cal->cliphi = (*pIdealCode)[range][CAL_CLIPHI];
+	cal->range = range;
+	cal->valid = 1;
+}
+
+// code is the scalar kernel, cd235 less the per-sample setup
+static inline unsigned short code(const APCAL *cal, double v)
+{
+	double f = cal->gain * v + cal->offset;
+	f += (f < 0.0) ? -0.5 : 0.5; // round
+	if (!(f <= cal->cliphi)) { // NaN clips high, as fmin does in cd235
+		f = cal->cliphi;
+	}
+	if (f < cal->cliplo) {
+		f = cal->cliplo;
+	}
+	return (unsigned short)((short)f ^ 0x8000); // BTC to straight binary
+}
+
+#ifdef APCAL_X86
+// the SIMD kernels compute 8 samples per iteration as two blocks of four,
+// the tail is left for the scalar kernel.  Adding 32768 to the truncated
+// BTC code and packing with unsigned saturation is the XOR with 0x8000.
+
+__attribute__((target("avx2"))) static inline __m128i block_avx2(const APCAL *cal, __m256d v)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	__m256d f = _mm256_add_pd(_mm256_mul_pd(v, _mm256_set1_pd(cal->gain)), _mm256_set1_pd(cal->offset));
+	f = _mm256_add_pd(f, _mm256_or_pd(_mm256_and_pd(f, sign), _mm256_set1_pd(0.5)));
+	f = _mm256_min_pd(f, _mm256_set1_pd(cal->cliphi)); // second operand on NaN
+	f = _mm256_max_pd(f, _mm256_set1_pd(cal->cliplo));
+	return _mm_add_epi32(_mm256_cvttpd_epi32(f), _mm_set1_epi32(32768));
+}
+
+__attribute__((target("avx2"))) static size_t f64_avx2(const APCAL *cal, const double *in, unsigned short *out, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i lo = block_avx2(cal, _mm256_loadu_pd(in + i));
+		__m128i hi = block_avx2(cal, _mm256_loadu_pd(in + i + 4));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi32(lo, hi));
+	}
+	return i;
+}
+
+__attribute__((target("avx2"))) static size_t f32_avx2(const APCAL *cal, const float *in, unsigned short *out, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i lo = block_avx2(cal, _mm256_cvtps_pd(_mm_loadu_ps(in + i)));
+		__m128i hi = block_avx2(cal, _mm256_cvtps_pd(_mm_loadu_ps(in + i + 4)));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi32(lo, hi));
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i pair_sse41(const APCAL *cal, __m128d v)
+{
+	const __m128d sign = _mm_set1_pd(-0.0);
+	__m128d f = _mm_add_pd(_mm_mul_pd(v, _mm_set1_pd(cal->gain)), _mm_set1_pd(cal->offset));
+	f = _mm_add_pd(f, _mm_or_pd(_mm_and_pd(f, sign), _mm_set1_pd(0.5)));
+	f = _mm_min_pd(f, _mm_set1_pd(cal->cliphi));
+	f = _mm_max_pd(f, _mm_set1_pd(cal->cliplo));
+	return _mm_cvttpd_epi32(f); // two codes in the low half
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i block_sse41(const APCAL *cal, __m128d a, __m128d b)
+{
+	__m128i q = _mm_unpacklo_epi64(pair_sse41(cal, a), pair_sse41(cal, b));
+	return _mm_add_epi32(q, _mm_set1_epi32(32768));
+}
+
+__attribute__((target("sse4.1"))) static size_t f64_sse41(const APCAL *cal, const double *in, unsigned short *out, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i lo = block_sse41(cal, _mm_loadu_pd(in + i), _mm_loadu_pd(in + i + 2));
+		__m128i hi = block_sse41(cal, _mm_loadu_pd(in + i + 4), _mm_loadu_pd(in + i + 6));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi32(lo, hi));
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1"))) static size_t f32_sse41(const APCAL *cal, const float *in, unsigned short *out, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128 a = _mm_loadu_ps(in + i);
+		__m128 b = _mm_loadu_ps(in + i + 4);
+		__m128i lo = block_sse41(cal, _mm_cvtps_pd(a), _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+		__m128i hi = block_sse41(cal, _mm_cvtps_pd(b), _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi32(lo, hi));
+	}
+	return i;
+}
+
+// gather_avx2 looks up 16 DNs per iteration.  The gather reads 32 bits at each
+// 16 bit entry, which is why tables have an entry of padding at the end
+__attribute__((target("avx2"))) static size_t gather_avx2(const unsigned short *table, const unsigned short *in, unsigned short *out, size_t n)
+{
+	const __m256i mask = _mm256_set1_epi32(0xFFFF);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+		lo = _mm256_and_si256(_mm256_i32gather_epi32((const int *)table, lo, 2), mask);
+		hi = _mm256_and_si256(_mm256_i32gather_epi32((const int *)table, hi, 2), mask);
+		// packus interleaves the 128 bit lanes of lo and hi, permute restores the order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256((__m256i *)(out + i), packed);
+	}
+	return i;
+}
+
+// 0 = scalar, 1 = SSE4.1, 2 = AVX2; -1 until the CPU has been checked.
+// Boards opened at once may race to check, which finds the same level
+static int simd_level = -1;
+
+static int simd(void)
+{
+	int level = __atomic_load_n(&simd_level, __ATOMIC_RELAXED);
+
+	if (level < 0) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			level = 2;
+		} else if (__builtin_cpu_supports("sse4.1")) {
+			level = 1;
+		} else {
+			level = 0;
+		}
+		__atomic_store_n(&simd_level, level, __ATOMIC_RELAXED);
+	}
+	return level;
+}
+#endif
+
+int apcal_simd(int level)
+{
+#ifdef APCAL_X86
+	int best;
+
+	__atomic_store_n(&simd_level, -1, __ATOMIC_RELAXED);
+	best = simd();
+	if (level >= 0 && level < best) {
+		__atomic_store_n(&simd_level, level, __ATOMIC_RELAXED);
+		return level;
+	}
+	return best;
+#else
+	(void)level;
+	return 0;
+#endif
+}
+
+void apcal_f64(const APCAL *cal, const double *in, unsigned short *out, size_t n)
+{
+	size_t i = 0;
+#ifdef APCAL_X86
+	switch (simd()) {
+	case 2:
+		i = f64_avx2(cal, in, out, n);
+		break;
+	case 1:
+		i = f64_sse41(cal, in, out, n);
+		break;
+	}
+#endif
+	for (; i < n; i++) {
+		out[i] = code(cal, in[i]);
+	}
+}
+
+void apcal_f32(const APCAL *cal, const float *in, unsigned short *out, size_t n)
+{
+	size_t i = 0;
+#ifdef APCAL_X86
+	switch (simd()) {
+	case 2:
+		i = f32_avx2(cal, in, out, n);
+		break;
+	case 1:
+		i = f32_sse41(cal, in, out, n);
+		break;
+	}
+#endif
+	for (; i < n; i++) {
+		out[i] = code(cal, (double)in[i]);
+	}
+}
+
+// same record, as far as the codes are concerned
+static int same(const APCAL *a, const APCAL *b)
+{
+	return a->valid && b->valid && a->range == b->range && a->gain == b->gain &&
+		   a->offset == b->offset && a->cliplo == b->cliplo && a->cliphi == b->cliphi;
+}
+
+void apcal_dn(const APCAL *cal, double lo, double hi, const unsigned short *in, unsigned short *out, size_t n)
+{
+	double volts[512];
+	size_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i;
+		if (m > sizeof(volts) / sizeof(volts[0])) {
+			m = sizeof(volts) / sizeof(volts[0]);
+		}
+		for (j = 0; j < m; j++) {
+			volts[j] = lo + (hi - lo) / 65535 * (double)in[i + j];
+		}
+		apcal_f64(cal, volts, out + i, m);
+	}
+}
+
+const unsigned short *apcal_lut(APLUT *lut, const APCAL *cal, double lo, double hi)
+{
+	unsigned short dn[1024];
+	size_t i, j;
+
+	if (lut->code != NULL && same(&lut->cal, cal)) {
+		return lut->code;
+	}
+	if (lut->code == NULL) {
+		lut->code = calloc(APCAL_LUT + 1, sizeof(unsigned short)); // + padding for gather_avx2
+		if (lut->code == NULL) {
+			return NULL;
+		}
+	}
+	for (i = 0; i < APCAL_LUT; i += 1024) {
+		for (j = 0; j < 1024; j++) {
+			dn[j] = (unsigned short)(i + j);
+		}
+		apcal_dn(cal, lo, hi, dn, lut->code + i, 1024);
+	}
+	lut->cal = *cal;
+	return lut->code;
+}
+
+void apcal_lut_free(APLUT *lut)
+{
+	free(lut->code);
+	memset(lut, 0, sizeof(*lut));
+}
+
+void apcal_gather(const unsigned short *table, const unsigned short *in, unsigned short *out, size_t n)
+{
+	size_t i = 0;
+#ifdef APCAL_X86
+	if (simd() == 2) {
+		i = gather_avx2(table, in, out, n);
+	}
+#endif
+	for (; i < n; i++) {
+		out[i] = table[in[i]];
+	}
+}
@@ -0,0 +1,62 @@
+// apcal contains the bulk volts -> DAC code conversion shared by the AP235
+// and AP236.  The math is that of cd235/cd236 from the Acromag example
+// software, with the per-channel terms computed once instead of per sample.
+#ifndef APCAL_H
+#define APCAL_H
+
+#include <stddef.h>
+
+// APCAL is the correction for one channel at one output range
+typedef struct
+{
+	double gain;   // DN/V, ideal slope times the gain correction
+	double offset; // DN, ideal two's complement zero plus the offset correction
+	double cliplo; // lowest two's complement code
+	double cliphi; // highest two's complement code
+	int range;     // range the record was computed for
+	int valid;     // zero when the record must be (re)computed
+} APCAL;
+
+// apcal_make fills cal for the given range from the ideal code table and the
+// offset & gain correction pair of the channel at that range
+void apcal_make(APCAL *cal, double (*pIdealCode)[8][7], const short ogc[2], int range);
+
+// apcal_f64 and apcal_f32 convert n voltages to offset binary (straight
+// binary) codes, rounding half away from zero and clipping to the code range
+// exactly as cd235 does.  AVX2 or SSE4.1 is used when the CPU has it.
+void apcal_f64(const APCAL *cal, const double *in, unsigned short *out, size_t n);
+void apcal_f32(const APCAL *cal, const float *in, unsigned short *out, size_t n);
+
+// apcal_simd forces the kernels of apcal_f64, apcal_f32 and apcal_gather to
+// level, 0 for scalar, 1 for SSE4.1 or 2 for AVX2, at most what the CPU has;
+// a negative level returns to the best the CPU has.  It returns the level in
+// use, and is meant for tests comparing the kernels
+int apcal_simd(int level);
+
+// APCAL_LUT is the number of entries of a DN -> code table
+#define APCAL_LUT 65536
+
+// APLUT is the DN -> code table of one channel, see apcal_lut
+typedef struct
+{
+	APCAL cal;            // record the table was built from
+	unsigned short *code; // APCAL_LUT entries, NULL until first built
+} APLUT;
+
+// apcal_lut returns the table of lut for cal, (re)building it first if it was
+// built from a different record.  DN d of the table is the code of the voltage
+// lo + (hi - lo) / 65535 * d.  NULL is returned if the table cannot be allocated
+const unsigned short *apcal_lut(APLUT *lut, const APCAL *cal, double lo, double hi);
+
+// apcal_lut_free frees the table of lut
+void apcal_lut_free(APLUT *lut);
+
+// apcal_dn converts n DNs spanning lo to hi to codes, as apcal_lut's table
+// would map them, without a table
+void apcal_dn(const APCAL *cal, double lo, double hi, const unsigned short *in, unsigned short *out, size_t n);
+
+// apcal_gather looks up n DNs in a table from apcal_lut.  AVX2 is used when the
+// CPU has it
+void apcal_gather(const unsigned short *table, const unsigned short *in, unsigned short *out, size_t n);
+
+#endif
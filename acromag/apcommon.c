@@ -35,6 +35,15 @@
   DATE	   BY	    PURPOSE
 --------  ----	------------------------------------------------
 02/01/17   FJM  Added function APTerminateBlockedStart() and modified APblocking_start_convert
+           JPL  Added APOpenEx() and direct register access through a mapping of the board
+           JPL  Added output_long_batch()
+           JPL  Handles index gpAP[] directly, added the _ap I/O functions
+           JPL  Added write delay modes
+           JPL  Count register accesses, added APRegisterAccesses()
+           JPL  Added the AP_IO_SIM access mode and APDeviceIoctl()
+           JPL  Added output_long_group()
+           JPL  Guarded the board table with gAPLock, AddAP() returns a status
+           JPL  The service thread counts its register accesses apart, added APServiceThread()
 
 {-D}
 */
@@ -43,14 +52,26 @@
 	This file contains the implementation of the functions for Acromag modules.
 */
 
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
 #include "apcommon.h"
+#include "apsim.h"
 
 /*	Global variables */
 int	gNumberAPs = -1;		/* Number of boards that have been opened and/or flag = -1...
 	                               if library is uninitialized see function InitAPLib() */
 
 
-APDATA_STRUCT *gpAP[MAX_APS];	/* pointer to the boards */
+APDATA_STRUCT *gpAP[MAX_APS];	/* pointer to the boards, indexed by handle */
+
+/*
+	gAPLock serializes the changes to gpAP[] and gNumberAPs, so boards may be
+	opened and closed from several threads at once.  GetAP() does not take it:
+	a slot is published with a release store once its board is complete, and
+	is only cleared by APClose() of its own handle.
+*/
+static pthread_mutex_t gAPLock = PTHREAD_MUTEX_INITIALIZER;
 
 
 
@@ -111,10 +132,72 @@ long SwapLong( long v )
 }
 
 
+/*
+	The driver calls.  Register reads and writes pass the board address in data[0]
+	and the value in data[1]; in AP_IO_SIM mode they go to the simulated board.
+*/
+
+static void DeviceRead(APDATA_STRUCT* pAP, unsigned long *data, int width)
+{
+	if( pAP->pSim )
+	   data[1] = apsim_read( (struct apsim *)pAP->pSim, data[0], width );
+	else
+	   read( pAP->nAPDeviceHandle, data, width );
+}
+
+
+static void DeviceWrite(APDATA_STRUCT* pAP, unsigned long *data, int width)
+{
+	if( pAP->pSim )
+	   apsim_write( (struct apsim *)pAP->pSim, data[0], data[1], width );
+	else
+	   write( pAP->nAPDeviceHandle, data, width );
+}
+
+
+/*
+	The board the calling thread is the service thread of, see APServiceThread().
+*/
+
+static __thread APDATA_STRUCT* tServiceAP;
+
+
+/*
+	Translate a board address (as found in the brd_ptr of a configuration block)
+	into its location in the user space mapping of the board.  NULL is returned
+	when the board is not mapped or the access falls outside of the mapping, in
+	which case the caller uses the read()/write() path.
+*/
+
+static volatile void *MappedAddress(APDATA_STRUCT* pAP, void *p, unsigned long width)
+{
+	unsigned long offset;
+
+	/* every register access comes through here, mapped or not.  The service
+	   thread is the only writer of its counter, which it adds to without a
+	   locked instruction */
+	if( pAP == tServiceAP )
+	   __atomic_store_n(&pAP->ullServiceAccesses,
+			    __atomic_load_n(&pAP->ullServiceAccesses, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	else
+	   __atomic_fetch_add(&pAP->ullAccesses, 1, __ATOMIC_RELAXED);
+
+	if( pAP->pMapped == NULL )
+		return(NULL);
+
+	offset = (unsigned long)p - (unsigned long)pAP->lBaseAddress;
+	if( offset > pAP->lMapSize || pAP->lMapSize - offset < width )
+		return(NULL);	/* also catches p below the base address */
+
+	return((volatile void *)(pAP->pMapped + offset));
+}
+
+
 byte input_byte(int nHandle, byte *p)
 {
 	APDATA_STRUCT* pAP;	/*  local */
 	unsigned long data[2];
+	volatile void *m;	/* mapped register */
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
@@ -122,11 +205,14 @@ byte input_byte(int nHandle, byte *p)
 
 	if( p )
 	{
+           if( (m = MappedAddress(pAP, p, sizeof(byte))) )
+              return( *(volatile byte *)m );
+
            /* place address to read byte from in data [0]; */
            data[0] = (unsigned long) p;
            data[1] = (unsigned long) 0;
            /* pram3 = function: 1=read8bits,2=read16bits,4=read32bits */
-           read( pAP->nAPDeviceHandle, &data[0], 1 );
+           DeviceRead( pAP, &data[0], 1 );
            return( (byte)data[1] );
 	}
 	return((byte)0);
@@ -136,6 +222,7 @@ word input_word(int nHandle, word *p)
 {
 	APDATA_STRUCT* pAP;	/*  local */
 	unsigned long data[2];
+	volatile void *m;	/* mapped register */
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
@@ -143,10 +230,13 @@ word input_word(int nHandle, word *p)
 
 	if( p )
 	{
+           if( (m = MappedAddress(pAP, p, sizeof(word))) )
+              return( SwapBytes( *(volatile word *)m ) );
+
            /* place address to read word from in data [0]; */
            data[0] = (unsigned long) p;
            /* pram3 = function: 1=read8bits,2=read16bits,4=read32bits */
-           read( pAP->nAPDeviceHandle, &data[0], 2 );
+           DeviceRead( pAP, &data[0], 2 );
            return(  SwapBytes( (word)data[1] ) );
 	}
 	return((word)0);
@@ -156,18 +246,30 @@ word input_word(int nHandle, word *p)
 long input_long(int nHandle, long *p)
 {
 	APDATA_STRUCT* pAP;	/*  local */
-	unsigned long data[2];
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
 		return((long)0);
 
+	return( input_long_ap(pAP, p) );
+}
+
+
+long input_long_ap(APDATA_STRUCT* pAP, long *p)
+{
+	unsigned long data[2];
+	volatile void *m;	/* mapped register */
+
 	if( p )
 	{
+           /* registers are 32 bits wide on the board regardless of sizeof(long) */
+           if( (m = MappedAddress(pAP, p, sizeof(uint32_t))) )
+              return( SwapLong( (long)*(volatile uint32_t *)m ) );
+
            /* place address to read word from in data [0]; */
            data[0] = (unsigned long) p;
            /* pram3 = function: 1=read8bits,2=read16bits,4=read32bits */
-           read( pAP->nAPDeviceHandle, &data[0], 4 );
+           DeviceRead( pAP, &data[0], 4 );
            return(  SwapLong( (long)data[1] ) );
 	}
 	return((long)0);
@@ -178,6 +280,7 @@ void output_byte(int nHandle, byte *p, byte v)
 {
 	APDATA_STRUCT* pAP;	/*  local */
 	unsigned long data[2];
+	volatile void *m;	/* mapped register */
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
@@ -185,12 +288,18 @@ void output_byte(int nHandle, byte *p, byte v)
 
 	if( p )
 	{
+		if( (m = MappedAddress(pAP, p, sizeof(byte))) )
+		{
+			*(volatile byte *)m = v;
+			return;
+		}
+
 		/* place address to write byte in data [0]; */
 		data[0] = (unsigned long) p;
 		/* place value to write @ address data [1]; */
 		data[1] = (unsigned long) v;
 	        /* pram3 = function: 1=write8bits,2=write16bits,4=write32bits */
-		write( pAP->nAPDeviceHandle, &data[0], 1 );
+		DeviceWrite( pAP, &data[0], 1 );
 	}
 }
 
@@ -198,6 +307,7 @@ void output_word(int nHandle, word *p, word v)
 {
 	APDATA_STRUCT* pAP;	/*  local */
 	unsigned long data[2];
+	volatile void *m;	/* mapped register */
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
@@ -205,12 +315,18 @@ void output_word(int nHandle, word *p, word v)
 
 	if( p )
 	{
+           if( (m = MappedAddress(pAP, p, sizeof(word))) )
+           {
+              *(volatile word *)m = SwapBytes( v );
+              return;
+           }
+
            /* place address to write word in data [0]; */
            data[0] = (unsigned long) p;
            /* place value to write @ address data [1]; */
            data[1] = (unsigned long) SwapBytes( v );
            /* pram3 = function: 1=write8bits,2=write16bits,4=write32bits */
-           write( pAP->nAPDeviceHandle, &data[0], 2 );
+           DeviceWrite( pAP, &data[0], 2 );
 	}
 }
 
@@ -218,24 +334,175 @@ void output_word(int nHandle, word *p, word v)
 void output_long(int nHandle, long *p, long v)
 {
 	APDATA_STRUCT* pAP;	/*  local */
-	unsigned long data[2];
 
 	pAP = GetAP(nHandle);
 	if(pAP == NULL)
 		return;
 
+	output_long_ap(pAP, p, v);
+}
+
+
+void output_long_ap(APDATA_STRUCT* pAP, long *p, long v)
+{
+	unsigned long data[2];
+	volatile void *m;	/* mapped register */
+
 	if( p )
 	{
+           if( (m = MappedAddress(pAP, p, sizeof(uint32_t))) )
+           {
+              *(volatile uint32_t *)m = (uint32_t)SwapLong( v );
+              return;
+           }
+
            /* place address to write word in data [0]; */
            data[0] = (unsigned long) p;
            /* place value to write @ address data [1]; */
            data[1] = (unsigned long) SwapLong( v );
            /* pram3 = function: 1=write8bits,2=write16bits,4=write32bits */
-           write( pAP->nAPDeviceHandle, &data[0], 4 );
+           DeviceWrite( pAP, &data[0], 4 );
 	}
 }
 
 
+/*
+	Write a list of longs in order.  The handle is resolved once for the
+	whole list; on a mapped board the list is a tight loop of stores, otherwise
+	there is one write() per element as the driver has no vectored write.
+	Each element may request a write delay applied after it is written.
+*/
+
+void output_long_batch(int nHandle, const APWRITE_OP *ops, size_t n)
+{
+	APDATA_STRUCT* pAP;	/*  local */
+
+	pAP = GetAP(nHandle);
+	if(pAP == NULL)
+		return;
+
+	output_long_batch_ap(pAP, ops, n);
+}
+
+
+void output_long_batch_ap(APDATA_STRUCT* pAP, const APWRITE_OP *ops, size_t n)
+{
+	unsigned long data[2];
+	volatile void *m;	/* mapped register */
+	unsigned int uTrailing = 0;	/* coalesced delay */
+	size_t i;
+
+	for( i = 0; i < n; i++ )
+	{
+	   if( ops[i].p == NULL )
+	      continue;
+
+	   if( (m = MappedAddress(pAP, ops[i].p, sizeof(uint32_t))) )
+	      *(volatile uint32_t *)m = (uint32_t)SwapLong( ops[i].v );
+	   else
+	   {
+	      data[0] = (unsigned long) ops[i].p;
+	      data[1] = (unsigned long) SwapLong( ops[i].v );
+	      DeviceWrite( pAP, &data[0], 4 );
+	   }
+
+	   if( pAP->nDelayMode == AP_DELAY_COALESCE )
+	   {
+	      if( ops[i].uDelay > uTrailing )
+	         uTrailing = ops[i].uDelay;
+	   }
+	   else if( ops[i].uDelay )
+	      write_delay_ap(pAP, ops[i].uDelay);	/* write delay */
+	}
+
+	if( uTrailing )
+	   write_delay_ap(pAP, uTrailing);	/* one write delay for the batch */
+}
+
+
+/*
+	Write one long to each of a list of boards, back to back, to fire the
+	simultaneous triggers of a group of boards.  The handles are all resolved
+	before the first write and nothing but a clock read is done between the
+	writes; the driver has no call that writes to several boards, so on a board
+	that is not mapped each write is still one write().  The write delays of
+	ops are not applied.  If pNs is not NULL, pNs[i] is the time in nanoseconds
+	from just before the first write to just after write i.
+*/
+
+void output_long_group(const int *nHandles, const APWRITE_OP *ops, size_t n, long long *pNs)
+{
+	APDATA_STRUCT* pAP[MAX_APS];	/* boards of the writes */
+	struct timespec start, now;
+	size_t i;
+
+	if( n > MAX_APS )
+	   n = MAX_APS;
+
+	for( i = 0; i < n; i++ )
+	   pAP[i] = GetAP(nHandles[i]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for( i = 0; i < n; i++ )
+	{
+	   if( pAP[i] )
+	      output_long_ap(pAP[i], ops[i].p, ops[i].v);
+
+	   if( pNs )
+	   {
+	      clock_gettime(CLOCK_MONOTONIC, &now);
+	      pNs[i] = (now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec);
+	   }
+	}
+}
+
+
+/*
+	Wait after a register write for the board to accept the next one.
+
+	usleep() of a couple of microseconds is a minimum of one scheduler wakeup, which
+	is commonly 50-100 us.  The spin modes poll CLOCK_MONOTONIC, which is read
+	without a syscall, and return as soon as the delay has elapsed.
+*/
+
+void write_delay(int nHandle, unsigned int uDelay)
+{
+	APDATA_STRUCT* pAP;	/*  local */
+
+	pAP = GetAP(nHandle);
+	if(pAP == NULL)
+		return;
+
+	write_delay_ap(pAP, uDelay);
+}
+
+
+void write_delay_ap(APDATA_STRUCT* pAP, unsigned int uDelay)
+{
+	struct timespec start, now;
+	long elapsed;
+
+	if( uDelay == 0 )
+	   return;
+
+	if( pAP->nDelayMode == AP_DELAY_SLEEP )
+	{
+	   usleep((useconds_t) uDelay);
+	   return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do
+	{
+#if defined(__x86_64__) || defined(__i386__)
+	   __builtin_ia32_pause();
+#endif
+	   clock_gettime(CLOCK_MONOTONIC, &now);
+	   elapsed = (now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec);
+	} while( elapsed < (long)uDelay * 1000L );
+}
+
+
 long get_param()
 {
 
@@ -271,6 +538,7 @@ uint32_t APBlockingStartConvert(int nHandle, long *p, long v, long parameter)
 	   return(0);
 
 	data[0] = (unsigned long) p;		/* place address of write in data[0] */
+	data[1] = 0;
 
 	switch(parameter)
 	{
@@ -290,7 +558,10 @@ uint32_t APBlockingStartConvert(int nHandle, long *p, long v, long parameter)
  	/* place board instance index in data[3] */
  	data[3] = (unsigned long) pAP->nDevInstance;	/* Device Instance */
 
- 	write( pAP->nAPDeviceHandle, &data[0], 8 );		/* function: 8=blocking_start_convert */
+ 	if( pAP->pSim )
+ 	   data[1] = (unsigned long)apsim_block( (struct apsim *)pAP->pSim, data[0], data[1] );
+ 	else
+ 	   write( pAP->nAPDeviceHandle, &data[0], 8 );		/* function: 8=blocking_start_convert */
 
 	return( (uint32_t)SwapLong( (long)data[1] ) );	/* return Interrupt Pending value */
 }
@@ -307,7 +578,31 @@ void APTerminateBlockedStart(int nHandle)
 		return;
 
 	data = (unsigned long) pAP->nDevInstance;	/* Device Instance */
-	ioctl( pAP->nAPDeviceHandle, 21, &data );	/* get wake up/terminate cmd */
+	if( pAP->pSim )
+	   apsim_terminate( (struct apsim *)pAP->pSim );
+	else
+	   ioctl( pAP->nAPDeviceHandle, 21, &data );	/* get wake up/terminate cmd */
+}
+
+
+/*
+	Issue a driver command other than a register access, such as building the
+	scatter-gather list of a DMA buffer.  A simulated board needs none of them
+	and returns 0.
+*/
+
+int APDeviceIoctl(int nHandle, unsigned long nCmd, unsigned long *pData)
+{
+	APDATA_STRUCT* pAP;	/*  local */
+
+	pAP = GetAP(nHandle);
+	if(pAP == NULL)
+		return -1;
+
+	if( pAP->pSim )
+		return 0;
+
+	return ioctl( pAP->nAPDeviceHandle, nCmd, pData );
 }
 
 
@@ -373,6 +668,7 @@ APSTATUS InitAPLib(void)
 {
 	int i;				/* General purpose index */
 
+	pthread_mutex_lock(&gAPLock);
         if( gNumberAPs == -1)		/* first time used - initialize pointers to 0 */
         {
 	  gNumberAPs = 0;		/* Initialize number of APs to 0 */
@@ -381,20 +677,41 @@ APSTATUS InitAPLib(void)
 	  for(i = 0; i < MAX_APS; i++)
 		gpAP[i] = 0;		/* set to a NULL pointer */
         }
+	pthread_mutex_unlock(&gAPLock);
 	return (APSTATUS)S_OK;
 }
 
 
 APSTATUS APOpen(int nDevInstance, int* pHandle, char* devname)
+{
+	return APOpenEx(nDevInstance, pHandle, devname, AP_IO_SYSCALL, 0);
+}
+
+
+/*
+	APOpenEx is APOpen with a choice of register access mode.
+
+	nIOMode = AP_IO_SYSCALL every access is one read()/write() on the device node.
+	nIOMode = AP_IO_MMAP    lMapSize bytes of the board are mapped from the device
+	                        node and accessed with volatile 32 bit loads/stores.
+	                        If the driver refuses the mapping the board is opened
+	                        in AP_IO_SYSCALL mode instead; see APGetIOMode().
+	nIOMode = AP_IO_SIM     no device node is opened, a simulated board of the type
+	                        devname names with lMapSize bytes of registers is used
+	                        instead; see apsim.h.
+*/
+
+APSTATUS APOpenEx(int nDevInstance, int* pHandle, char* devname, int nIOMode, unsigned long lMapSize)
 {
 	APDATA_STRUCT* pAP;		/* local pointer */
+	void *pMap;			/* user space mapping of the board */
 	unsigned long data[MAX_APS];
 	char devnamebuf[64];
 	char devnumbuf[8];
 
 	*pHandle = -1;		/* set callers handle to an invalid value */
 
-	if(gNumberAPs == MAX_APS)
+	if(__atomic_load_n(&gNumberAPs, __ATOMIC_RELAXED) == MAX_APS)	/* early out, AddAP() decides */
 		return E_OUT_OF_APS;
 
 	/* Allocate memory for a new AP structure */
@@ -411,6 +728,13 @@ APSTATUS APOpen(int nDevInstance, int* pHandle, char* devname)
 	pAP->nInteruptID = 0;
 	pAP->nIntLevel = 0;
 	pAP->nDevInstance = -1;	/* Device Instance */
+	pAP->nIOMode = AP_IO_SYSCALL;
+	pAP->pMapped = NULL;
+	pAP->lMapSize = 0;
+	pAP->nDelayMode = AP_DELAY_SLEEP;
+	pAP->ullAccesses = 0;
+	pAP->ullServiceAccesses = 0;
+	pAP->pSim = NULL;
 
 	memset( &pAP->devname[0], 0, sizeof(pAP->devname));
 	memset( &devnamebuf[0], 0, sizeof(devnamebuf));
@@ -421,6 +745,29 @@ APSTATUS APOpen(int nDevInstance, int* pHandle, char* devname)
 	sprintf(&devnumbuf[0],"%d",nDevInstance);
 	strcat(devnamebuf, devnumbuf);
 
+	if( nIOMode == AP_IO_SIM )
+	{
+		pAP->pSim = apsim_new( devname, nDevInstance, lMapSize );
+		if( pAP->pSim == NULL )
+		{
+			free((void*)pAP);
+			return (APSTATUS)E_OUT_OF_MEMORY;
+		}
+		strcpy(&pAP->devname[0], &devnamebuf[0]);	/* the device simulated */
+		pAP->nAPDeviceHandle = -1;
+		pAP->nDevInstance = nDevInstance;
+		pAP->lBaseAddress = apsim_base( (struct apsim *)pAP->pSim );
+		pAP->nIOMode = AP_IO_SIM;
+		if( AddAP(pAP) != S_OK )
+		{
+			apsim_free( (struct apsim *)pAP->pSim );
+			free((void*)pAP);
+			return E_OUT_OF_APS;
+		}
+		*pHandle = pAP->nHandle;
+		return (APSTATUS)S_OK;
+	}
+
 	pAP->nAPDeviceHandle = open( devnamebuf, O_RDWR );
 
 	if( pAP->nAPDeviceHandle < 0 )
@@ -440,7 +787,26 @@ APSTATUS APOpen(int nDevInstance, int* pHandle, char* devname)
 	ioctl( pAP->nAPDeviceHandle, 6, &data[0] );		/* get IRQ cmd */
 	pAP->nIntLevel = ( int )( data[nDevInstance] & 0xFF );
 
-	AddAP(pAP);                  /* call function to add AP to array and set handle */
+	/* Map the board registers, keep the syscall path if the driver does not support it */
+	if( nIOMode == AP_IO_MMAP && lMapSize && pAP->lBaseAddress )
+	{
+		pMap = mmap( NULL, lMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, pAP->nAPDeviceHandle, 0 );
+		if( pMap != MAP_FAILED )
+		{
+			pAP->pMapped = (volatile byte *)pMap;
+			pAP->lMapSize = lMapSize;
+			pAP->nIOMode = AP_IO_MMAP;
+		}
+	}
+
+	if( AddAP(pAP) != S_OK )     /* call function to add AP to array and set handle */
+	{
+		if( pAP->pMapped )
+			munmap( (void *)pAP->pMapped, pAP->lMapSize );
+		close( pAP->nAPDeviceHandle );
+		free((void*)pAP);
+		return E_OUT_OF_APS;
+	}
 	*pHandle = pAP->nHandle;      /* return our handle */
 
 	return (APSTATUS)S_OK;
@@ -460,7 +826,19 @@ APSTATUS APClose(int nHandle)
 	if(pAP->bInitialized == FALSE)
 		return E_NOT_INITIALIZED;
 
-  	close( pAP->nAPDeviceHandle );
+	if( pAP->pMapped )
+	{
+		munmap( (void *)pAP->pMapped, pAP->lMapSize );
+		pAP->pMapped = NULL;
+	}
+
+	if( pAP->pSim )
+	{
+		apsim_free( (struct apsim *)pAP->pSim );
+		pAP->pSim = NULL;
+	}
+	else
+		close( pAP->nAPDeviceHandle );
 
   	pAP->nAPDeviceHandle = -1;
 	DeleteAP(nHandle);		/*  Delete the AP with the provided handle */
@@ -469,6 +847,64 @@ APSTATUS APClose(int nHandle)
 }
 
 
+int APGetIOMode(int nHandle)
+{
+	APDATA_STRUCT* pAP;
+
+	pAP = GetAP(nHandle);
+	if(pAP == 0)
+		return AP_IO_SYSCALL;
+
+	return pAP->nIOMode;
+}
+
+
+/*
+	Number of register accesses made to the board since it was opened.
+*/
+
+unsigned long long APRegisterAccesses(int nHandle)
+{
+	APDATA_STRUCT* pAP;
+
+	pAP = GetAP(nHandle);
+	if(pAP == 0)
+		return 0;
+
+	return __atomic_load_n(&pAP->ullAccesses, __ATOMIC_RELAXED) +
+	       __atomic_load_n(&pAP->ullServiceAccesses, __ATOMIC_RELAXED);
+}
+
+
+/*
+	Make the calling thread the service thread of the board: the one thread,
+	such as the waveform service thread of the AP235, that does most of the
+	register accesses while others access it too.  Its accesses are counted
+	apart from the others', without locked instructions.
+*/
+
+void APServiceThread(int nHandle)
+{
+	tServiceAP = GetAP(nHandle);
+}
+
+
+APSTATUS APSetWriteDelayMode(int nHandle, int nMode)
+{
+	APDATA_STRUCT* pAP;
+
+	pAP = GetAP(nHandle);
+	if(pAP == 0)
+		return E_INVALID_HANDLE;
+
+	if(nMode < AP_DELAY_SLEEP || nMode > AP_DELAY_COALESCE)
+		return E_NOT_IMPLEMENTED;
+
+	pAP->nDelayMode = nMode;
+	return (APSTATUS)S_OK;
+}
+
+
 APSTATUS APInitialize(int nHandle)
 {
 	APDATA_STRUCT* pAP;
@@ -483,74 +919,57 @@ APSTATUS APInitialize(int nHandle)
 }
 
 
-void AddAP(APDATA_STRUCT* pAP)
+/*
+	The handle of a board is its index in gpAP[], so finding a board from its
+	handle is a bounds check and a load.
+*/
+
+APSTATUS AddAP(APDATA_STRUCT* pAP)
 {
-	int i, j;			/* general purpose index */
-	BOOL bFound;			/* general purpose BOOL */
+	int i;				/* general purpose index */
 
-	for(i = 0; i < MAX_APS; i++)	/* Determine a handle for this AP */
+	pthread_mutex_lock(&gAPLock);
+	for(i = 0; i < MAX_APS; i++)	/* Determine a handle for this AP, the first free slot */
 	{
-		bFound = TRUE;
-		for(j = 0; j < gNumberAPs; j++)
-		{
-			if(i == gpAP[j]->nHandle)
-			{
-				bFound = FALSE;
-				break;
-			}
-		}
-
-		if(bFound)
+		if(gpAP[i] == 0)
 			break;
 	}
 
+	if(i == MAX_APS)		/* the table filled since APOpenEx() checked gNumberAPs */
+	{
+		pthread_mutex_unlock(&gAPLock);
+		return E_OUT_OF_APS;
+	}
+
 	pAP->nHandle = i;          	/* set new handle */
-	gpAP[gNumberAPs] = pAP;		/* add AP to array */
-	gNumberAPs++;			/* increment number of APs */
+	__atomic_store_n(&gpAP[i], pAP, __ATOMIC_RELEASE);	/* add AP to array */
+	__atomic_store_n(&gNumberAPs, gNumberAPs + 1, __ATOMIC_RELAXED);	/* increment number of APs */
+	pthread_mutex_unlock(&gAPLock);
+	return (APSTATUS)S_OK;
 }
 
 
 void DeleteAP(int nHandle)
 {
 	APDATA_STRUCT* pAP;
-	int i;
 
-	if(gNumberAPs == 0)
-		return;
-
-	pAP = 0;			/* initialize pointer to null */
-	for(i = 0; i < gNumberAPs; i++)/* Find AP that has this handle */
-	{
-		if(nHandle == gpAP[i]->nHandle)
-		{
-			pAP = gpAP[i];
-			break;
-		}
-	}
+	pAP = GetAP(nHandle);
 	if(pAP == 0)			/* return if no AP has been found */
 		return;
 
-	free((void*)pAP);		/* delete the memory for this AP */
+	pthread_mutex_lock(&gAPLock);
+	__atomic_store_n(&gpAP[nHandle], 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&gNumberAPs, gNumberAPs - 1, __ATOMIC_RELAXED);	/* decrement AP count */
+	pthread_mutex_unlock(&gAPLock);
 
-	/* Rearrange AP array */
-	gpAP[i] = gpAP[gNumberAPs - 1];
-	gpAP[gNumberAPs - 1] = 0;
-	gNumberAPs--;			/* decrement AP count */
+	free((void*)pAP);		/* delete the memory for this AP */
 }
 
 
 APDATA_STRUCT* GetAP(int nHandle)
 {
-	APDATA_STRUCT* pAP;
-	int i;				/* General purpose index */
+	if(nHandle < 0 || nHandle >= MAX_APS)
+		return (APDATA_STRUCT*)0;	/* return null */
 
-	for(i = 0; i < gNumberAPs; i++)/* Find AP that has this handle */
-	{
-		if(nHandle == gpAP[i]->nHandle)
-		{
-			pAP = gpAP[i];
-			return pAP;
-		}
-	}
-	return (APDATA_STRUCT*)0;	/* return null */
+	return __atomic_load_n(&gpAP[nHandle], __ATOMIC_ACQUIRE);
 }
@@ -35,6 +35,17 @@
   DATE	   BY	    PURPOSE
 --------  ----	------------------------------------------------
 02/01/17  FJM   Added APTerminateBlockedStart() and modified APblocking_start_convert()
+          JPL   Added APOpenEx() and the memory mapped register access mode
+          JPL   Added output_long_batch()
+          JPL   MAX_APS may be set at build time, added the _ap I/O functions
+          JPL   Added write delay modes
+          JPL   Added register access counts
+          JPL   Added the simulated board access mode and APDeviceIoctl()
+          JPL   Added output_long_group()
+          JPL   Added AP_CACHE_ALIGNED
+          JPL   AddAP() returns a status, boards may be opened and closed from several threads
+          JPL   Declared struct aptrace
+          JPL   The service thread counts its register accesses apart, added APServiceThread()
 
 {-D}
 */
@@ -49,7 +60,9 @@
 #define APCOMMON_H
 
 #define VENDOR_ID (word)0x16D5		/* Acromag's vendor ID for all PCI bus products */
-#define MAX_APS 4			/* maximum number of boards */
+#ifndef MAX_APS
+#define MAX_APS 8			/* maximum number of boards, also the size of the handle table */
+#endif
 
 
 #ifndef BUILDING_FOR_KERNEL
@@ -88,6 +101,33 @@ typedef int APSTATUS;			/* custom made APSTATUS data type, used as a
 
 
 
+/*
+	Register access modes, see APOpenEx()
+*/
+
+#define AP_IO_SYSCALL	0	/* one read()/write() on the device node per register access */
+#define AP_IO_MMAP	1	/* registers mapped into the process, accessed with loads/stores */
+#define AP_IO_SIM	2	/* no board, the accesses go to a simulated board, see apsim.h */
+
+/* start a member of a control block on its own cache line */
+#define AP_CACHE_LINE	64
+#define AP_CACHE_ALIGNED __attribute__((aligned(AP_CACHE_LINE)))
+
+/* output trace ring of a board, see aptrace.h */
+struct aptrace;
+
+
+
+/*
+	Write delay modes, see APSetWriteDelayMode()
+*/
+
+#define AP_DELAY_SLEEP		0	/* usleep() after each write that needs a delay */
+#define AP_DELAY_SPIN		1	/* busy-wait on CLOCK_MONOTONIC after each write that needs a delay */
+#define AP_DELAY_COALESCE	2	/* one busy-wait at the end of a batch, for its longest delay */
+
+
+
 /*
 	APSTATUS return values
 	Errors will have most significant bit set and are preceded with an E_.
@@ -119,6 +159,18 @@ typedef struct
 	char devname[64];		/* device name */
 	BOOL bInitialized;		/* intialized flag */
 	BOOL bIntEnabled;		/* interrupts enabled flag */
+	int nIOMode;			/* register access mode, AP_IO_xxx */
+	volatile byte *pMapped;		/* user space mapping of the board, NULL if not mapped */
+	unsigned long lMapSize;		/* size of the mapping in bytes */
+	int nDelayMode;			/* write delay mode, AP_DELAY_xxx */
+	void *pSim;			/* simulated board in AP_IO_SIM mode, NULL otherwise */
+
+	/* the access counters, see APRegisterAccesses(), are kept off the cache
+	   lines of the fields above and of each other */
+	char cPad0[AP_CACHE_LINE];
+	unsigned long long ullAccesses;	/* register accesses of threads other than the service thread */
+	char cPad1[AP_CACHE_LINE];
+	unsigned long long ullServiceAccesses;	/* register accesses of the service thread, its only writer */
 }APDATA_STRUCT;
 
 typedef struct
@@ -126,6 +178,17 @@ typedef struct
 	uint32_t InterruptRegister;	/* Interrupt Pending/control Register */
 }AP_BOARD_MEMORY_MAP;
 
+/*
+	One register write of a batch, see output_long_batch()
+*/
+
+typedef struct
+{
+	long *p;			/* board address to write */
+	long v;				/* value to write */
+	unsigned int uDelay;		/* write delay after this write in microseconds, 0 = none */
+}APWRITE_OP;
+
 /*
 	Function Prototypes
 */
@@ -136,6 +199,12 @@ APSTATUS EnableAPInterrupts(int nHandle);
 APSTATUS DisableAPInterrupts(int nHandle);
 APSTATUS InitAPLib(void);
 APSTATUS APOpen(int nDevInstance, int* pHandle, char* devname);
+APSTATUS APOpenEx(int nDevInstance, int* pHandle, char* devname, int nIOMode, unsigned long lMapSize);
+int APGetIOMode(int nHandle);
+APSTATUS APSetWriteDelayMode(int nHandle, int nMode);
+unsigned long long APRegisterAccesses(int nHandle);
+void APServiceThread(int nHandle);
+int APDeviceIoctl(int nHandle, unsigned long nCmd, unsigned long *pData);
 APSTATUS APClose(int nHandle);
 APSTATUS APInitialize(int nHandle);
 
@@ -145,7 +214,7 @@ long SwapLong( long v );
 
 
 /*  Functions used by above functions */
-void AddAP(APDATA_STRUCT* pAP);
+APSTATUS AddAP(APDATA_STRUCT* pAP);
 void DeleteAP(int nHandle);
 APDATA_STRUCT* GetAP(int nHandle);
 byte input_byte(int nHandle, byte*);		/* function to read an input byte */
@@ -154,6 +223,15 @@ void output_byte(int nHandle, byte*, byte);	/* function to output a byte */
 void output_word(int nHandle, word*, word);	/* function to output a word */
 long input_long(int nHandle, long*);		/* function to read an input long */
 void output_long(int nHandle, long*, long);	/* function to output a long */
+void output_long_batch(int nHandle, const APWRITE_OP *ops, size_t n); /* function to output a list of longs */
+void output_long_group(const int *nHandles, const APWRITE_OP *ops, size_t n, long long *pNs); /* one long to each of a list of boards */
+
+/*  Same as above for a board already looked up with GetAP(), for use in loops */
+long input_long_ap(APDATA_STRUCT* pAP, long*);
+void output_long_ap(APDATA_STRUCT* pAP, long*, long);
+void output_long_batch_ap(APDATA_STRUCT* pAP, const APWRITE_OP *ops, size_t n);
+void write_delay(int nHandle, unsigned int uDelay);	/* delay after a write, per the delay mode */
+void write_delay_ap(APDATA_STRUCT* pAP, unsigned int uDelay);
 uint32_t APBlockingStartConvert(int nHandle, long *p, long v, long parameter);
 void APTerminateBlockedStart(int nHandle);
 long get_param(void);		/* input a parameter */
@@ -0,0 +1,128 @@
+#include <math.h>
+#include "apgen.h"
+
+#define TWO_PI 6.283185307179586
+
+void apgen_init(APGENSTATE *s, const APGEN *gen, const APCAL *cal, double dt)
+{
+	s->gen = *gen;
+	s->cal = *cal;
+	s->dt = dt;
+	s->k = 0;
+}
+
+void apgen_set(APGENSTATE *s, const APGEN *gen)
+{
+	s->gen = *gen;
+}
+
+// cycle is the position in [0, 1) of sample k in the period of a waveform of
+// frequency f and phase phi
+static double cycle(double f, double dt, unsigned long long k, double phi)
+{
+	double x = f * dt * (double)k + phi / TWO_PI;
+	return x - floor(x);
+}
+
+// sine adds a sin(theta + j delta) to v[j] for j < m.  The angles are stepped
+// by rotation rather than calls to sin; four rotations of 4 delta each run
+// side by side so the steps are independent.  Every chunk starts from exact
+// values, so the error of the steps does not build up
+static void sine(double *v, size_t m, double a, double theta, double delta)
+{
+	double s[4], c[4], rs = sin(4 * delta), rc = cos(4 * delta), t;
+	size_t j, l;
+
+	for (l = 0; l < 4; l++) {
+		s[l] = a * sin(theta + l * delta);
+		c[l] = a * cos(theta + l * delta);
+	}
+	for (j = 0; j + 4 <= m; j += 4) {
+		for (l = 0; l < 4; l++) {
+			v[j + l] += s[l];
+			t = s[l] * rc + c[l] * rs;
+			c[l] = c[l] * rc - s[l] * rs;
+			s[l] = t;
+		}
+	}
+	for (l = 0; j < m; j++, l++) {
+		v[j] += s[l];
+	}
+}
+
+// chirp computes up to m samples of a chirp, stopping at the end of a sweep,
+// and returns how many it computed
+static size_t chirp(const APGENSTATE *s, double *v, size_t m)
+{
+	const APGEN *g = &s->gen;
+	unsigned long long ns = (unsigned long long)llround(g->sweep / s->dt), i;
+	double beta, t;
+	size_t j;
+
+	if (ns == 0) {
+		ns = 1;
+	}
+	i = s->k % ns;
+	if (m > ns - i) {
+		m = (size_t)(ns - i);
+	}
+	beta = (g->stop - g->frequency) / (ns * s->dt); // Hz/s
+	for (j = 0; j < m; j++) {
+		t = (double)(i + j) * s->dt;
+		v[j] += g->amplitude * sin(TWO_PI * (g->frequency * t + 0.5 * beta * t * t) + g->phase);
+	}
+	return m;
+}
+
+// volts computes up to m voltages into v and returns how many it computed
+static size_t volts(const APGENSTATE *s, double *v, size_t m)
+{
+	const APGEN *g = &s->gen;
+	double x0, inc, x, a = g->amplitude;
+	size_t j;
+	int i;
+
+	for (j = 0; j < m; j++) {
+		v[j] = g->offset;
+	}
+	switch (g->shape) {
+	case APGEN_SINE:
+		sine(v, m, a, TWO_PI * cycle(g->frequency, s->dt, s->k, g->phase), TWO_PI * g->frequency * s->dt);
+		break;
+	case APGEN_MULTITONE:
+		for (i = 0; i < g->ntones && i < APGEN_TONES; i++) {
+			const APTONE *t = &g->tone[i];
+			sine(v, m, t->amplitude, TWO_PI * cycle(t->frequency, s->dt, s->k, t->phase),
+				TWO_PI * t->frequency * s->dt);
+		}
+		break;
+	case APGEN_RAMP:
+	case APGEN_TRIANGLE:
+		x0 = cycle(g->frequency, s->dt, s->k, g->phase);
+		inc = g->frequency * s->dt;
+		for (j = 0; j < m; j++) {
+			x = x0 + (double)j * inc;
+			x -= floor(x);
+			v[j] += g->shape == APGEN_RAMP ? a * (2 * x - 1) : a * (1 - 4 * fabs(x - 0.5));
+		}
+		break;
+	case APGEN_CHIRP:
+		m = chirp(s, v, m);
+		break;
+	}
+	return m;
+}
+
+void apgen_run(APGENSTATE *s, unsigned short *out, size_t n)
+{
+	double v[APGEN_CHUNK];
+	size_t m;
+
+	while (n > 0) {
+		m = volts(s, v, n < APGEN_CHUNK ? n : APGEN_CHUNK);
+		apcal_f64(&s->cal, v, out, m);
+		s->k += m;
+		out += m;
+		n -= m;
+	}
+}
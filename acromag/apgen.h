@@ -0,0 +1,67 @@
+// apgen synthesizes parametric waveforms as DAC codes a chunk at a time, so
+// a waveform of any period is played from a buffer of one refill.  The
+// voltages of a chunk are computed then converted with apcal
+#ifndef APGEN_H
+#define APGEN_H
+
+#include <stddef.h>
+#include "apcal.h"
+
+// APGEN_CHUNK is the number of samples computed and calibrated at a time, one
+// AP235 DMA page
+#define APGEN_CHUNK 2048
+
+// APGEN_TONES is the most tones an APGEN_MULTITONE generator sums
+#define APGEN_TONES 8
+
+// shapes of APGEN
+#define APGEN_SINE 0      // offset + amplitude sin(2 pi frequency t + phase)
+#define APGEN_RAMP 1      // rises from offset - amplitude to offset + amplitude each period
+#define APGEN_TRIANGLE 2  // from offset - amplitude up to offset + amplitude and back each period
+#define APGEN_CHIRP 3     // sine swept linearly from frequency to stop over sweep s, repeated
+#define APGEN_MULTITONE 4 // offset plus the sum of the sines of tone
+
+// APTONE is one sine of an APGEN_MULTITONE generator
+typedef struct
+{
+	double amplitude; // V, peak
+	double frequency; // Hz
+	double phase;     // rad
+} APTONE;
+
+// APGEN describes a waveform.  Phases of the periodic shapes are in radians
+// of their period, so a phase of pi starts a ramp at offset
+typedef struct
+{
+	int shape;
+	double offset;    // V
+	double amplitude; // V, peak, all but APGEN_MULTITONE
+	double frequency; // Hz, all but APGEN_MULTITONE; the start frequency of APGEN_CHIRP
+	double phase;     // rad, all but APGEN_MULTITONE
+	double stop;      // Hz, APGEN_CHIRP
+	double sweep;     // s, APGEN_CHIRP
+	int ntones;       // APGEN_MULTITONE
+	APTONE tone[APGEN_TONES];
+} APGEN;
+
+// APGENSTATE is a generator being played
+typedef struct
+{
+	APGEN gen;
+	APCAL cal;             // correction of the channel played on
+	double dt;             // s between samples
+	unsigned long long k;  // index of the next sample from the start of playback
+} APGENSTATE;
+
+// apgen_init starts playing gen at sample period dt on a channel with the
+// correction cal
+void apgen_init(APGENSTATE *s, const APGEN *gen, const APCAL *cal, double dt);
+
+// apgen_set switches s to gen.  The new waveform continues from the time of
+// the old, so a change of amplitude or offset alone keeps the phase
+void apgen_set(APGENSTATE *s, const APGEN *gen);
+
+// apgen_run writes the codes of the next n samples to out
+void apgen_run(APGENSTATE *s, unsigned short *out, size_t n);
+
+#endif
@@ -0,0 +1,196 @@
+// apsim.c is the part of the simulated board common to the board models:
+// register memory, the flash and the blocking wait for interrupts.  See
+// apsim.h
+#include <time.h>
+#include "apsim.h"
+
+#define SPI_READ 0x03 // M25P10 read, 3 address bytes then data
+
+static const struct apsimboard *boards[] = {&apsim235, &apsim236};
+
+uint64_t apsim_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+struct apsim *apsim_new(const char *devname, int instance, unsigned long size)
+{
+	const struct apsimboard *board = NULL;
+	pthread_condattr_t attr;
+	struct apsim *sim;
+	size_t i;
+
+	for (i = 0; i < sizeof(boards) / sizeof(boards[0]); i++) {
+		if (strcmp(devname, boards[i]->devname) == 0) {
+			board = boards[i];
+		}
+	}
+	if (board == NULL) {
+		return NULL;
+	}
+	sim = calloc(1, sizeof(*sim));
+	if (sim == NULL) {
+		return NULL;
+	}
+	sim->board = board;
+	sim->size = (size + 3) & ~3UL;
+	sim->regs = calloc(1, sim->size);
+	if (sim->regs == NULL) {
+		free(sim);
+		return NULL;
+	}
+	strncpy((char *)sim->flash.id, board->id, sizeof(sim->flash.id) - 1);
+	if (board->init(sim, instance) != 0) {
+		free(sim->regs);
+		free(sim);
+		return NULL;
+	}
+	pthread_mutex_init(&sim->lock, NULL);
+	// the waits have deadlines in the board's time, which is monotonic
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sim->irq, &attr);
+	pthread_condattr_destroy(&attr);
+	return sim;
+}
+
+void apsim_free(struct apsim *sim)
+{
+	if (sim == NULL) {
+		return;
+	}
+	if (sim->board->free != NULL) {
+		sim->board->free(sim);
+	}
+	pthread_cond_destroy(&sim->irq);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim->regs);
+	free(sim);
+}
+
+long apsim_base(struct apsim *sim)
+{
+	return (long)sim->regs;
+}
+
+uint32_t apsim_reg(struct apsim *sim, unsigned long off)
+{
+	uint32_t v;
+	memcpy(&v, &sim->regs[off], sizeof(v));
+	return v;
+}
+
+void apsim_setreg(struct apsim *sim, unsigned long off, uint32_t v)
+{
+	memcpy(&sim->regs[off], &v, sizeof(v));
+}
+
+unsigned long apsim_read(struct apsim *sim, unsigned long addr, int width)
+{
+	unsigned long off = addr - (unsigned long)sim->regs, v = 0;
+
+	if (off >= sim->size || sim->size - off < (unsigned long)width) {
+		return 0; // nothing decodes there
+	}
+	pthread_mutex_lock(&sim->lock);
+	if (!sim->board->read(sim, off, width, &v)) {
+		memcpy(&v, &sim->regs[off], width); // little endian, as the bus
+	}
+	pthread_mutex_unlock(&sim->lock);
+	return v;
+}
+
+// store is apsim_write with the lock held
+static void store(struct apsim *sim, unsigned long off, unsigned long v, int width)
+{
+	if (off >= sim->size || sim->size - off < (unsigned long)width) {
+		return;
+	}
+	if (!sim->board->write(sim, off, width, v)) {
+		memcpy(&sim->regs[off], &v, width);
+	}
+}
+
+void apsim_write(struct apsim *sim, unsigned long addr, unsigned long v, int width)
+{
+	pthread_mutex_lock(&sim->lock);
+	store(sim, addr - (unsigned long)sim->regs, v, width);
+	// any write may enable or raise an interrupt
+	pthread_cond_broadcast(&sim->irq);
+	pthread_mutex_unlock(&sim->lock);
+}
+
+uint32_t apsim_block(struct apsim *sim, unsigned long addr, unsigned long v)
+{
+	uint64_t deadline;
+	struct timespec ts;
+	unsigned terminations;
+	uint32_t raised = 0;
+
+	pthread_mutex_lock(&sim->lock);
+	store(sim, addr - (unsigned long)sim->regs, v, 4);
+	terminations = sim->terminations;
+	while (sim->terminations == terminations) {
+		deadline = 0;
+		if (sim->board->interrupt != NULL) {
+			raised = sim->board->interrupt(sim, apsim_now(), &deadline);
+			if (raised) {
+				break;
+			}
+		}
+		if (deadline == 0) {
+			pthread_cond_wait(&sim->irq, &sim->lock);
+		} else {
+			ts.tv_sec = deadline / 1000000000ULL;
+			ts.tv_nsec = deadline % 1000000000ULL;
+			pthread_cond_timedwait(&sim->irq, &sim->lock, &ts);
+		}
+	}
+	pthread_mutex_unlock(&sim->lock);
+	return raised;
+}
+
+void apsim_terminate(struct apsim *sim)
+{
+	pthread_mutex_lock(&sim->lock);
+	sim->terminations++;
+	pthread_cond_broadcast(&sim->irq);
+	pthread_mutex_unlock(&sim->lock);
+}
+
+// apsim_select drives the chip select of the flash, selecting it starts a
+// transaction
+void apsim_select(struct apsim *sim, int selected)
+{
+	if (selected) {
+		sim->flash.n = 0;
+		sim->flash.cmd = 0;
+		sim->flash.addr = 0;
+	}
+}
+
+// apsim_spi clocks one byte out to the flash and returns the byte clocked in
+unsigned char apsim_spi(struct apsim *sim, unsigned char tx)
+{
+	struct apsimflash *f = &sim->flash;
+	unsigned char rx = 0;
+	uint32_t a;
+
+	if (f->n == 0) {
+		f->cmd = tx;
+	} else if (f->cmd == SPI_READ && f->n <= 3) {
+		f->addr = (f->addr << 8) | tx;
+	} else if (f->cmd == SPI_READ) {
+		a = f->addr + (f->n - 4);
+		if (a >= APSIM_ID_ADDR && a < APSIM_ID_ADDR + sizeof(f->id)) {
+			rx = f->id[a - APSIM_ID_ADDR];
+		}
+	}
+	// everything else, read status included, reads zero: an idle part
+	// with writes disabled
+	f->n++;
+	f->rx = rx;
+	return rx;
+}
@@ -0,0 +1,98 @@
+// apsim is a simulated board behind the register access functions of
+// apcommon, selected with AP_IO_SIM.  It lets the library, its service thread
+// and its benchmarks run without a board or the kernel driver.
+//
+// The registers are plain memory with a board model on top that gives the
+// registers with side effects their behaviour: the calibration flash, the
+// channel FIFOs draining at the timer rate, the DMA engine and the interrupts
+// the blocking start convert waits for.
+#ifndef APSIM_H
+#define APSIM_H
+
+#include <pthread.h>
+#include "apcommon.h"
+
+struct apsim;
+
+// apsimflash is an M25P10 on the SPI port of a board.  Only the read and
+// read status commands are modelled; the part never reports busy and program
+// and erase commands are ignored
+struct apsimflash
+{
+	unsigned n;            // bytes sent since chip select
+	unsigned char cmd;     // first byte of the transaction
+	uint32_t addr;         // address of a read command
+	unsigned char rx;      // byte received while the last one was sent
+	unsigned char id[16];  // ID string at APSIM_ID_ADDR, the rest reads as zero
+};
+
+// APSIM_ID_ADDR is FlashCoefficientIDString of both boards
+#define APSIM_ID_ADDR 0x3FEFF0
+
+// apsimboard is the model of one type of board
+struct apsimboard
+{
+	const char *devname; // device name prefix, DEVICE_NAME
+	const char *id;      // ID string in the flash
+
+	// init sets up the registers and allocates state after the registers
+	// are cleared, returning nonzero on failure
+	int (*init)(struct apsim *sim, int instance);
+	void (*free)(struct apsim *sim);
+
+	// read and write handle the registers with side effects at offset off,
+	// returning zero to leave the access to plain memory.  Called locked
+	int (*read)(struct apsim *sim, unsigned long off, int width, unsigned long *v);
+	int (*write)(struct apsim *sim, unsigned long off, int width, unsigned long v);
+
+	// interrupt returns the enabled interrupts raised at now and masks them,
+	// as the driver's interrupt handler does.  If none is raised it sets
+	// *deadline to when the next one will be, or zero if none is due.  NULL
+	// for a board without interrupts.  Called locked
+	uint32_t (*interrupt)(struct apsim *sim, uint64_t now, uint64_t *deadline);
+};
+
+struct apsim
+{
+	pthread_mutex_t lock;
+	pthread_cond_t irq;         // broadcast when an interrupt may have been raised
+	unsigned terminations;      // apsim_terminate calls, wakes the blocked waits
+	const struct apsimboard *board;
+	unsigned char *regs;        // register memory, at the board's base address
+	unsigned long size;         // size of regs in bytes
+	struct apsimflash flash;
+	void *state;                // owned by the board model
+};
+
+extern const struct apsimboard apsim235;
+extern const struct apsimboard apsim236;
+
+// apsim_new simulates the board of devname (ap235_, ap236_) with size bytes
+// of registers, NULL if the board is not known or out of memory
+struct apsim *apsim_new(const char *devname, int instance, unsigned long size);
+
+void apsim_free(struct apsim *sim);
+
+// apsim_base is the board address the registers appear at, for brd_ptr
+long apsim_base(struct apsim *sim);
+
+// apsim_read and apsim_write access width (1, 2 or 4) bytes at board
+// address addr, as the read() and write() of the driver
+unsigned long apsim_read(struct apsim *sim, unsigned long addr, int width);
+void apsim_write(struct apsim *sim, unsigned long addr, unsigned long v, int width);
+
+// apsim_block writes v to addr and waits for an interrupt, returning the
+// interrupts raised or zero if terminated, as blocking_start_convert
+uint32_t apsim_block(struct apsim *sim, unsigned long addr, unsigned long v);
+
+// apsim_terminate ends the waits in apsim_block
+void apsim_terminate(struct apsim *sim);
+
+// helpers for the board models, called locked
+uint32_t apsim_reg(struct apsim *sim, unsigned long off);
+void apsim_setreg(struct apsim *sim, unsigned long off, uint32_t v);
+void apsim_select(struct apsim *sim, int selected);
+unsigned char apsim_spi(struct apsim *sim, unsigned char tx);
+uint64_t apsim_now(void);
+
+#endif
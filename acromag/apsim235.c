@@ -0,0 +1,298 @@
+// apsim235.c is the model of the AP235 for apsim.  The channels in FIFO mode
+// drain one sample per timer period (TimerDivider * 32 ns) from the start of
+// playback, and raise their interrupt at or below half of their sample memory
+// window.  DMA transfers complete as soon as they are started.  The samples
+// are only counted, not kept
+#include <stddef.h>
+#include "apsim.h"
+#include "AP235.h"
+
+#define REG(r) offsetof(struct mapap235, r)
+#define DACREG(r) (REG(DAC[0].r) - REG(DAC[0]))
+#define DACSTRIDE (REG(DAC[1]) - REG(DAC[0]))
+
+#define CC_START 0x01 // CommonControl, start all waveforms
+#define CC_STOP 0x10  // CommonControl, stop all waveforms
+
+struct sim235
+{
+	int playing;           // between a start and a stop of all waveforms
+	uint64_t last;         // board time the levels were last brought up to
+	uint32_t level[16];    // samples in each FIFO
+	uint32_t underflowed;  // FIFOs that ran dry while playing, until written
+	uint32_t dma;          // DMAInterruptPending, until acknowledged
+};
+
+static struct sim235 *state(struct apsim *sim)
+{
+	return sim->state;
+}
+
+static int init(struct apsim *sim, int instance)
+{
+	sim->state = calloc(1, sizeof(struct sim235));
+	if (sim->state == NULL) {
+		return -1;
+	}
+	apsim_setreg(sim, REG(LocationRegister), (uint32_t)instance);
+	apsim_setreg(sim, REG(CDMAStatusRegister), DMATransferComplete);
+	return 0;
+}
+
+static void release(struct apsim *sim)
+{
+	free(sim->state);
+}
+
+static uint64_t period(struct apsim *sim)
+{
+	return (uint64_t)apsim_reg(sim, REG(TimerDivider)) * 32;
+}
+
+static int fifo_mode(struct apsim *sim, int ch)
+{
+	return (apsim_reg(sim, REG(DAC[0].Control) + ch * DACSTRIDE) & 3) == DAC_FIFO;
+}
+
+// window is the size of a channel's sample memory window
+static uint32_t window(struct apsim *sim, int ch)
+{
+	uint32_t start = apsim_reg(sim, REG(DAC[0].StartAddr) + ch * DACSTRIDE);
+	uint32_t end = apsim_reg(sim, REG(DAC[0].EndAddr) + ch * DACSTRIDE);
+	return end > start ? end - start + 1 : MAXSAMPLES;
+}
+
+// drain brings the FIFO levels up to now
+static void drain(struct apsim *sim, uint64_t now)
+{
+	struct sim235 *s = state(sim);
+	uint64_t p = period(sim), n;
+	int i;
+
+	if (!s->playing || p == 0) {
+		s->last = now;
+		return;
+	}
+	n = (now - s->last) / p;
+	if (n == 0) {
+		return;
+	}
+	s->last += n * p;
+	for (i = 0; i < 16; i++) {
+		if (!fifo_mode(sim, i)) {
+			continue;
+		}
+		if (s->level[i] > n) {
+			s->level[i] -= (uint32_t)n;
+		} else {
+			s->level[i] = 0;
+			s->underflowed |= 1U << i;
+		}
+	}
+}
+
+static void fill(struct apsim *sim, int ch, uint32_t samples)
+{
+	struct sim235 *s = state(sim);
+	uint32_t size = window(sim, ch);
+
+	drain(sim, apsim_now());
+	s->level[ch] = s->level[ch] + samples < size ? s->level[ch] + samples : size;
+	s->underflowed &= ~(1U << ch);
+}
+
+// raised is the interrupt status: the channels at or below half their window
+// and the DMA completion
+static uint32_t raised(struct apsim *sim)
+{
+	struct sim235 *s = state(sim);
+	uint32_t status = s->dma;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		if (fifo_mode(sim, i) && s->level[i] <= window(sim, i) / 2) {
+			status |= 1U << i;
+		}
+	}
+	return status;
+}
+
+static uint32_t channel_status(struct apsim *sim, int ch)
+{
+	struct sim235 *s = state(sim);
+	uint32_t size = window(sim, ch), status = 0;
+
+	if (s->level[ch] == 0) {
+		status |= FIFO_empty;
+	}
+	if (s->level[ch] >= size / 2) {
+		status |= FIFO_half_full;
+	}
+	if (s->level[ch] >= size) {
+		status |= FIFO_full;
+	}
+	if (s->underflowed & (1U << ch)) {
+		status |= FIFO_underflow;
+	}
+	return status;
+}
+
+// dma performs the transfer of the descriptor list the CDMA was started on
+static void dma(struct apsim *sim)
+{
+	struct sim235 *s = state(sim);
+	uint32_t desc = apsim_reg(sim, REG(CDMADescriptorPointerRegister)) - REG(CHAN[0]);
+	uint32_t stride = REG(CHAN[1]) - REG(CHAN[0]), ch = desc / stride;
+	unsigned long data;
+
+	if (ch >= 16) {
+		return;
+	}
+	data = REG(CHAN[0].fpdata.Control) + ch * stride;
+	if (desc % stride >= REG(CHAN[0].sptrlo) - REG(CHAN[0])) {
+		data = REG(CHAN[0].spdata.Control) + ch * stride;
+	}
+	fill(sim, ch, apsim_reg(sim, data) / sizeof(short));
+	if (apsim_reg(sim, REG(CDMAControlRegister)) & DMAInterruptOnCompleteEnabled) {
+		apsim_setreg(sim, REG(CDMAStatusRegister), DMATransferComplete | DMAInterruptOnCompleteEnabled);
+		s->dma = DMAInterruptPending;
+	}
+}
+
+static int read_reg(struct apsim *sim, unsigned long off, int width, unsigned long *v)
+{
+	struct sim235 *s = state(sim);
+	unsigned long d = off - REG(DAC[0]);
+
+	(void)width;
+	drain(sim, apsim_now());
+	if (off >= REG(DAC[0]) && off < REG(DAC[0]) + 16 * DACSTRIDE && d % DACSTRIDE == DACREG(Status)) {
+		*v = channel_status(sim, d / DACSTRIDE);
+		return 1;
+	}
+	switch (off) {
+	case REG(QSPI_SPISR):
+		*v = 0x2; // transfer complete
+		return 1;
+	case REG(QSPI_SPIDRR):
+		*v = sim->flash.rx;
+		return 1;
+	case REG(AXI_InterruptStatusRegister):
+		*v = raised(sim);
+		return 1;
+	case REG(AXI_InterruptPendingRegister):
+		*v = raised(sim) & apsim_reg(sim, REG(AXI_InterruptEnableRegister));
+		return 1;
+	case REG(CommonControl):
+		*v = (apsim_reg(sim, off) & ~(uint32_t)(CC_START | CC_STOP)) | (s->playing ? CC_START : 0);
+		return 1;
+	}
+	return 0;
+}
+
+static int write_reg(struct apsim *sim, unsigned long off, int width, unsigned long v)
+{
+	struct sim235 *s = state(sim);
+	unsigned long d = off - REG(DAC[0]);
+	uint32_t r;
+	int ch;
+
+	(void)width;
+	if (off >= REG(DAC[0]) && off < REG(DAC[0]) + 16 * DACSTRIDE) {
+		ch = d / DACSTRIDE;
+		if (d % DACSTRIDE == DACREG(Fifo)) {
+			fill(sim, ch, 2); // a pair of samples per write
+			return 1;
+		}
+		if (d % DACSTRIDE == DACREG(DirectAccess) &&
+		    ((v >> 16) == DataResetWrite || (v >> 16) == FullResetWrite)) {
+			s->level[ch] = 0;
+			s->underflowed &= ~(1U << ch);
+		}
+		return 0;
+	}
+	switch (off) {
+	case REG(QSPI_SPIDTR):
+		apsim_spi(sim, (unsigned char)v);
+		return 1;
+	case REG(QSPI_SPISSR):
+		apsim_select(sim, v == 0);
+		return 1;
+	case REG(AXI_SetInterruptEnableRegister):
+		r = apsim_reg(sim, REG(AXI_InterruptEnableRegister)) | (uint32_t)v;
+		apsim_setreg(sim, REG(AXI_InterruptEnableRegister), r);
+		return 1;
+	case REG(AXI_ClearInterruptEnableRegister):
+		r = apsim_reg(sim, REG(AXI_InterruptEnableRegister)) & ~(uint32_t)v;
+		apsim_setreg(sim, REG(AXI_InterruptEnableRegister), r);
+		return 1;
+	case REG(AXI_InterruptAcknowledgeRegister):
+		s->dma &= ~(uint32_t)v; // the channels are level triggered
+		return 1;
+	case REG(CDMAStatusRegister):
+		r = apsim_reg(sim, off) & ~((uint32_t)v & DMAInterruptOnCompleteEnabled);
+		apsim_setreg(sim, off, r | DMATransferComplete);
+		return 1;
+	case REG(CDMATailDescriptorPointerRegister):
+		apsim_setreg(sim, off, (uint32_t)v);
+		dma(sim);
+		return 1;
+	case REG(TimerDivider):
+		drain(sim, apsim_now()); // the old rate up to now
+		return 0;
+	case REG(CommonControl):
+		if (v & CC_STOP) {
+			s->playing = 0;
+			memset(s->level, 0, sizeof(s->level));
+			s->underflowed = 0;
+		} else if ((v & CC_START) && !s->playing) {
+			s->playing = 1;
+			s->last = apsim_now();
+		}
+		apsim_setreg(sim, off, (uint32_t)v & ~(uint32_t)(CC_START | CC_STOP));
+		return 1;
+	}
+	return 0;
+}
+
+static uint32_t interrupt(struct apsim *sim, uint64_t now, uint64_t *deadline)
+{
+	struct sim235 *s = state(sim);
+	uint32_t ier = apsim_reg(sim, REG(AXI_InterruptEnableRegister)), r, half;
+	uint64_t p = period(sim), t;
+	int i;
+
+	drain(sim, now);
+	if (apsim_reg(sim, REG(AXI_MasterEnableRegister)) == MasterInterruptDisable) {
+		return 0; // woken by the write that enables them
+	}
+	r = raised(sim) & ier;
+	if (r) {
+		apsim_setreg(sim, REG(AXI_InterruptEnableRegister), ier & ~r);
+		return r;
+	}
+	if (!s->playing || p == 0) {
+		return 0;
+	}
+	for (i = 0; i < 16; i++) {
+		if (!(ier & (1U << i)) || !fifo_mode(sim, i)) {
+			continue;
+		}
+		half = window(sim, i) / 2;
+		t = s->last + (uint64_t)(s->level[i] - half) * p;
+		if (*deadline == 0 || t < *deadline) {
+			*deadline = t;
+		}
+	}
+	return 0;
+}
+
+const struct apsimboard apsim235 = {
+	.devname = DEVICE_NAME,
+	.id = FlashIDString,
+	.init = init,
+	.free = release,
+	.read = read_reg,
+	.write = write_reg,
+	.interrupt = interrupt,
+};
@@ -0,0 +1,47 @@
+// apsim236.c is the model of the AP236 for apsim.  Only the flash port has
+// side effects; the DAC registers are plain memory and the board raises no
+// interrupts
+#include <stddef.h>
+#include "apsim.h"
+#include "AP236.h"
+
+#define REG(r) offsetof(struct map236, r)
+
+static int init(struct apsim *sim, int instance)
+{
+	(void)sim;
+	(void)instance;
+	return 0;
+}
+
+static int read_reg(struct apsim *sim, unsigned long off, int width, unsigned long *v)
+{
+	(void)width;
+	if (off == REG(FLASHData)) {
+		*v = sim->flash.rx;
+		return 1;
+	}
+	return 0;
+}
+
+static int write_reg(struct apsim *sim, unsigned long off, int width, unsigned long v)
+{
+	(void)width;
+	switch (off) {
+	case REG(FLASHData):
+		apsim_spi(sim, (unsigned char)v);
+		return 1;
+	case REG(FlashChipSelect):
+		apsim_select(sim, (v & 1) == 0);
+		return 1;
+	}
+	return 0;
+}
+
+const struct apsimboard apsim236 = {
+	.devname = DEVICE_NAME,
+	.id = FlashIDString,
+	.init = init,
+	.read = read_reg,
+	.write = write_reg,
+};
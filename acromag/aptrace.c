@@ -0,0 +1,145 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "apcommon.h"
+#include "aptrace.h"
+
+_Static_assert(sizeof(struct aptrace_rec) == 64, "trace records are 64 bytes");
+
+struct aptrace
+{
+	struct aptrace_rec *rec;
+	size_t mask; // records - 1
+	unsigned short board;
+	// head is the producer's and tail the consumer's, on lines of their own
+	atomic_ullong head AP_CACHE_ALIGNED;
+	atomic_ullong tail AP_CACHE_ALIGNED;
+	atomic_ullong dropped;
+};
+
+struct aptrace *aptrace_new(unsigned board, size_t records)
+{
+	struct aptrace *t;
+	size_t n = 1;
+	void *p;
+
+	while (n < records) {
+		n <<= 1;
+	}
+	if (posix_memalign(&p, AP_CACHE_LINE, sizeof(struct aptrace)) != 0) {
+		return NULL;
+	}
+	t = memset(p, 0, sizeof(struct aptrace));
+	if (posix_memalign(&p, AP_CACHE_LINE, n * sizeof(struct aptrace_rec)) != 0) {
+		free(t);
+		return NULL;
+	}
+	t->rec = memset(p, 0, n * sizeof(struct aptrace_rec));
+	t->mask = n - 1;
+	t->board = (unsigned short)board;
+	return t;
+}
+
+void aptrace_free(struct aptrace *t)
+{
+	if (t == NULL) {
+		return;
+	}
+	free(t->rec);
+	free(t);
+}
+
+// slot returns the next record to fill, NULL if the ring is full
+static struct aptrace_rec *slot(struct aptrace *t, unsigned long long *head)
+{
+	*head = atomic_load_explicit(&t->head, memory_order_relaxed);
+	if (*head - atomic_load_explicit(&t->tail, memory_order_acquire) > t->mask) {
+		atomic_store_explicit(&t->dropped, atomic_load_explicit(&t->dropped, memory_order_relaxed) + 1,
+			memory_order_relaxed);
+		return NULL;
+	}
+	return memset(&t->rec[*head & t->mask], 0, sizeof(struct aptrace_rec));
+}
+
+// publish stamps r and hands it to the consumer
+static void publish(struct aptrace *t, struct aptrace_rec *r, unsigned long long head)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	r->ns = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+	// the drops are counted into seq so they show as a gap; dropped is the
+	// producer's alone, like head
+	r->seq = head + atomic_load_explicit(&t->dropped, memory_order_relaxed);
+	r->board = t->board;
+	atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+void aptrace_codes(struct aptrace *t, int n, const int *channels, const unsigned short *codes)
+{
+	unsigned long long head;
+	struct aptrace_rec *r = slot(t, &head);
+	int i;
+
+	if (r == NULL) {
+		return;
+	}
+	if (n > 16) {
+		n = 16;
+	}
+	r->kind = APTRACE_OUTPUT;
+	r->n = (unsigned char)n;
+	r->mask = 0;
+	r->status = 0;
+	r->count = (unsigned)n;
+	for (i = 0; i < n; i++) {
+		r->mask |= 1U << channels[i];
+		r->code[i] = codes[i];
+	}
+	publish(t, r, head);
+}
+
+void aptrace_event(struct aptrace *t, int kind, unsigned mask, unsigned status, unsigned count, unsigned short code)
+{
+	unsigned long long head;
+	struct aptrace_rec *r = slot(t, &head);
+
+	if (r == NULL) {
+		return;
+	}
+	r->kind = (unsigned char)kind;
+	r->n = kind == APTRACE_REFILL;
+	r->mask = mask;
+	r->status = status;
+	r->count = count;
+	r->code[0] = code;
+	publish(t, r, head);
+}
+
+size_t aptrace_drain(struct aptrace *t, struct aptrace_rec *out, size_t max)
+{
+	unsigned long long tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+	unsigned long long head = atomic_load_explicit(&t->head, memory_order_acquire);
+	size_t n = (size_t)(head - tail), i, k;
+
+	if (n > max) {
+		n = max;
+	}
+	// in at most two runs, around the end of the ring
+	for (i = 0; i < n; i += k) {
+		size_t at = (size_t)((tail + i) & t->mask);
+		k = t->mask + 1 - at;
+		if (k > n - i) {
+			k = n - i;
+		}
+		memcpy(out + i, &t->rec[at], k * sizeof(struct aptrace_rec));
+	}
+	atomic_store_explicit(&t->tail, tail + n, memory_order_release);
+	return n;
+}
+
+unsigned long long aptrace_dropped(struct aptrace *t)
+{
+	return atomic_load_explicit(&t->dropped, memory_order_relaxed);
+}
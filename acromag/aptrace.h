@@ -0,0 +1,56 @@
+// aptrace records what is written to a board into single producer, single
+// consumer rings of fixed records, for a writer to move to a trace file.
+// The callers keep to one producer per ring, the DAC's lock serializing the
+// control API and the service thread having a ring of its own.
+// The producers check the board's ring pointer before recording, so a board
+// that is not traced pays one branch per write.
+#ifndef APTRACE_H
+#define APTRACE_H
+
+#include <stddef.h>
+
+// kinds of record
+#define APTRACE_OUTPUT 1 // codes written to the outputs of mask's channels, in order
+#define APTRACE_CONFIG 2 // the registers of mask's channels configured
+#define APTRACE_REFILL 3 // count samples sent to a channel's FIFO, code[0] the first
+#define APTRACE_IRQ 4    // an interrupt of mask's channels serviced, count samples sent
+
+// aptrace_rec is one record, 64 bytes with no padding so a trace file is an
+// array of them
+struct aptrace_rec
+{
+	unsigned long long ns;  // CLOCK_MONOTONIC
+	unsigned long long seq; // index of the record among those made for its ring, dropped or not
+	unsigned short board;
+	unsigned char kind;
+	unsigned char n; // codes used
+	unsigned int mask;
+	unsigned int status; // channels that underflowed, APTRACE_IRQ
+	unsigned int count;
+	unsigned short code[16];
+};
+
+// aptrace is opaque to Go; cgo does not translate the atomics inside
+struct aptrace;
+
+// aptrace_new allocates a ring of records records, rounded up to a power of
+// two, for the given board number; NULL is returned if the allocation fails
+struct aptrace *aptrace_new(unsigned board, size_t records);
+
+void aptrace_free(struct aptrace *t);
+
+// aptrace_codes records an APTRACE_OUTPUT of codes[i] to channels[i] for
+// i < n, up to 16.  aptrace_event records any other kind.  Records that do
+// not fit in the ring are dropped and counted
+void aptrace_codes(struct aptrace *t, int n, const int *channels, const unsigned short *codes);
+
+void aptrace_event(struct aptrace *t, int kind, unsigned mask, unsigned status, unsigned count, unsigned short code);
+
+// aptrace_drain moves up to max records from the ring to out and returns how
+// many it moved.  Only one thread may drain a ring
+size_t aptrace_drain(struct aptrace *t, struct aptrace_rec *out, size_t max);
+
+// aptrace_dropped is the number of records dropped because the ring was full
+unsigned long long aptrace_dropped(struct aptrace *t);
+
+#endif
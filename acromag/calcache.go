@@ -0,0 +1,74 @@
+package acromag
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+)
+
+// CalibrationCacheDir is the directory the flash ID and calibration
+// coefficients of each board are cached in, so that opening a board a second
+// time does not have to read its flash.  Empty disables the cache.
+// Changes only take effect for boards opened afterwards
+var CalibrationCacheDir string
+
+// calMagic starts every calibration cache file
+var calMagic = [8]byte{'A', 'P', 'C', 'A', 'L', '0', '0', '1'}
+
+// calibrationKey identifies a board in the cache.  location is the slot of
+// the board, revision its firmware revision
+func calibrationKey(model string, location int, revision uint32) string {
+	return fmt.Sprintf("%s-%d-%08x.cal", model, location, revision)
+}
+
+// loadCalibration fills id and ogc from the cache, returning false if the
+// cache is disabled or has no entry of the right size for key
+func loadCalibration(key string, id *[32]byte, ogc []int16) bool {
+	if CalibrationCacheDir == "" {
+		return false
+	}
+	b, err := ioutil.ReadFile(filepath.Join(CalibrationCacheDir, key))
+	if err != nil || len(b) != len(calMagic)+len(id)+2*len(ogc) {
+		return false
+	}
+	r := bytes.NewReader(b)
+	var magic [8]byte
+	binary.Read(r, binary.LittleEndian, &magic)
+	if magic != calMagic {
+		return false
+	}
+	binary.Read(r, binary.LittleEndian, id)
+	binary.Read(r, binary.LittleEndian, ogc)
+	return true
+}
+
+// storeCalibration writes id and ogc to the cache.  The cache is only an
+// optimization, so failures are ignored; the file is renamed into place so
+// a concurrent or interrupted store never leaves a partial entry
+func storeCalibration(key string, id *[32]byte, ogc []int16) {
+	if CalibrationCacheDir == "" {
+		return
+	}
+	var buf bytes.Buffer
+	buf.Write(calMagic[:])
+	buf.Write(id[:])
+	binary.Write(&buf, binary.LittleEndian, ogc)
+
+	f, err := ioutil.TempFile(CalibrationCacheDir, key+".tmp")
+	if err != nil {
+		return
+	}
+	_, err = f.Write(buf.Bytes())
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), filepath.Join(CalibrationCacheDir, key))
+	}
+	if err != nil {
+		os.Remove(f.Name())
+	}
+}
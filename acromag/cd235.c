@@ -43,6 +43,9 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+10/14/26  JPL	use the cached per channel correction record and the
+		bulk apcal kernel, added cal235
+	  JPL	added the DN lookup table, lut235
 
 {-D}
 */
@@ -58,38 +61,51 @@
 */
 
 
-void cd235(struct cblk235 *c_blk, int channel, double *fb)
-{
-
 /*
-    declare local storage
+    cal235 returns the correction record for the channel at its current range,
+    computing it first if it was invalidated (rcc235) or the range changed.
 */
 
-    double f_cor;
-    int range, i;
+APCAL *cal235(struct cblk235 *c_blk, int channel)
+{
+    APCAL *cal;
+    int range;
+
+    cal = &c_blk->cal235[channel];
+    range = (int)(c_blk->opts.chan[channel].Range & 0x7);	/* get channels range setting */
+    if( !cal->valid || cal->range != range )
+	apcal_make(cal, c_blk->pIdealCode, c_blk->ogc235[channel][range], range);
+    return cal;
+}
+
+
 
 /*
-        Entry point of routine
-	Storage configuration for offset & gain correction pairs[2] for each range[8] for each channel[16]
+    lut235 returns the DN -> code table of the channel at its current range, building
+    it first if it is out of date with the correction record.  NULL is returned if the
+    tables are not in use or the table cannot be allocated.
 */
 
-    range = (int)(c_blk->opts.chan[channel].Range & 0x7);	/* get channels range setting */
+const unsigned short *lut235(struct cblk235 *c_blk, int channel)
+{
+    APCAL *cal;
 
-    for( i = 0; i < c_blk->SampleCount[channel]; i++)
-    {
-      f_cor = ((1.0 + (double)c_blk->ogc235[channel][range][GAIN] / 1048576.0) * (*c_blk->pIdealCode)[range][IDEALSLOPE]) *
-		fb[i] + (*c_blk->pIdealCode)[range][IDEALZEROBTC] + ((double)c_blk->ogc235[channel][range][OFFSET] / 16.0);
+    if( !c_blk->UseLUT )
+	return NULL;
+    cal = cal235(c_blk, channel);
+    return apcal_lut(&c_blk->lut235[channel], cal,
+		     (*c_blk->pIdealCode)[cal->range][ENDPOINTLO], (*c_blk->pIdealCode)[cal->range][ENDPOINTHI]);
+}
 
-      f_cor += (f_cor < 0.0) ? -0.5 : 0.5; /* round */
 
-      f_cor = fmin(f_cor, (*c_blk->pIdealCode)[range][CLIPHI]);
-      f_cor = fmax(f_cor, (*c_blk->pIdealCode)[range][CLIPLO]);
+void cd235(struct cblk235 *c_blk, int channel, double *fb)
+{
+
 /*
-printf("Ch %X R = %X IZ %lf IS %lf Oc = %lf Gc = %lf fc = %lf\n", channel, range, (*c_blk->pIdealCode)[range][IDEALZEROBTC],
-(*c_blk->pIdealCode)[range][IDEALSLOPE], (double)c_blk->ogc235[channel][range][OFFSET], (double)c_blk->ogc235[channel][range][GAIN], f_cor);
+        Entry point of routine
+	Storage configuration for offset & gain correction pairs[2] for each range[8] for each channel[16]
 */
-      (*c_blk->pcor_buf)[channel][i] = (short)f_cor;
-      (*c_blk->pcor_buf)[channel][i] ^= 0x8000; /* Convert BTC data to straight binary data */
-    }
-}
 
+    apcal_f64(cal235(c_blk, channel), fb,
+	      (unsigned short *)&(*c_blk->pcor_buf)[channel][0], c_blk->SampleCount[channel]);
+}
@@ -42,6 +42,8 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+10/14/26  JPL	use the cached per channel correction record, added cal236
+	  JPL	added the DN lookup table, lut236
 
 {-D}
 */
@@ -57,33 +59,56 @@
 */
 
 
-void cd236(struct cblk236 *c_blk, int channel, double Volts)
-{
-
 /*
-    declare local storage
+    cal236 returns the correction record for the channel at its current range,
+    computing it first if it was invalidated (rcc236) or the range changed.
 */
 
-    double f_cor;
+APCAL *cal236(struct cblk236 *c_blk, int channel)
+{
+    APCAL *cal;
     int range;
 
+    cal = &c_blk->cal236[channel];
+    range = (int)(c_blk->opts.chan[channel].Range & 0x7);	/* get channels range setting */
+    if( !cal->valid || cal->range != range )
+	apcal_make(cal, c_blk->pIdealCode, c_blk->ogc236[channel][range], range);
+    return cal;
+}
+
+
+
 /*
-        Entry point of routine
-	Storage configuration for offset & gain correction pairs[2] for each range[8] for each channel[16]
+    lut236 returns the DN -> code table of the channel at its current range, building
+    it first if it is out of date with the correction record.  NULL is returned if the
+    tables are not in use or the table cannot be allocated.
 */
 
-    range = (int)(c_blk->opts.chan[channel].Range & 0x7);	/* get channels range setting */
+const unsigned short *lut236(struct cblk236 *c_blk, int channel)
+{
+    APCAL *cal;
+
+    if( !c_blk->UseLUT )
+	return NULL;
+    cal = cal236(c_blk, channel);
+    return apcal_lut(&c_blk->lut236[channel], cal,
+		     (*c_blk->pIdealCode)[cal->range][ENDPOINTLO], (*c_blk->pIdealCode)[cal->range][ENDPOINTHI]);
+}
+
+
+void cd236(struct cblk236 *c_blk, int channel, double Volts)
+{
 
-    f_cor = ((1.0 + (double)c_blk->ogc236[channel][range][GAIN] / 1048576.0) * (*c_blk->pIdealCode)[range][IDEALSLOPE]) *
-		Volts + (*c_blk->pIdealCode)[range][IDEALZEROBTC] + ((double)c_blk->ogc236[channel][range][OFFSET] / 16.0);
+/*
+    declare local storage
+*/
 
-    f_cor += (f_cor < 0.0) ? -0.5 : 0.5; /* round */
+    unsigned short code;
 
-    f_cor = fmin(f_cor, (*c_blk->pIdealCode)[range][CLIPHI]);
-    f_cor = fmax(f_cor, (*c_blk->pIdealCode)[range][CLIPLO]);
 /*
-printf("Ch %X R = %X IZ %lf IS %lf Oc = %lf Gc = %lf fc = %lf\n", channel, range, (*c_blk->pIdealCode)[range][IDEALZEROBTC],
-(*c_blk->pIdealCode)[range][IDEALSLOPE], (double)c_blk->ogc236[channel][range][OFFSET], (double)c_blk->ogc236[channel][range][GAIN], f_cor);
+        Entry point of routine
 */
-    c_blk->cor_buf[channel] = (short)f_cor;
+
+    apcal_f64(cal236(c_blk, channel), &Volts, &code, 1);
+    c_blk->cor_buf[channel] = (short)(code ^ 0x8000);	/* cor_buf holds BTC data */
 }
@@ -1,4 +1,5 @@
 
+#include <string.h>
 #include <unistd.h>
 #include "apcommon.h"
 #include "AP235.h"
@@ -21,10 +22,19 @@
 			for the AP235 board.
 
     CALLING
-	SEQUENCE:	cnfg235(ptr);
+	SEQUENCE:	cnfg235(ptr, channel);
 				where:
 				ptr (pointer to structure)
 				Pointer to the configuration block structure.
+				channel (int)
+				Channel to configure.
+
+			cnfgdiff235(ptr, mask);
+				where:
+				ptr (pointer to structure)
+				Pointer to the configuration block structure.
+				mask (uint32_t)
+				Bit n set configures channel n.
 
     MODULE TYPE:    void
 
@@ -40,6 +50,8 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+	  JPL	    write delay follows the board's write delay mode
+	  JPL	    record the shadow registers, added cnfgdiff235
 
 {-D}
 */
@@ -60,6 +72,51 @@
 */
 
 
+/* DirectAccess WriteControl word for the channel's options */
+static uint32_t direct_word(struct cblk235 *c_blk, int channel)
+{
+    uint32_t control;
+
+    control = WriteControl << 16;	/* initialize channel control register write value */
+    control |= (c_blk->opts.chan[channel].ClearVoltage << 9); /* Clear Voltage */
+    control |= (c_blk->opts.chan[channel].OverRange << 8); /* 5% Overrange */
+    control |= (c_blk->opts.chan[channel].ThermalShutdown << 6); /* Thermal Shutdown */
+    control |= (c_blk->opts.chan[channel].PowerUpVoltage << 3); /* Power-up Voltage */
+    control |= c_blk->opts.chan[channel].Range; /* Output Range */
+    return control;
+}
+
+/* channel Control register value for the channel's options */
+static uint32_t control_word(struct cblk235 *c_blk, int channel)
+{
+    uint32_t control;
+
+    control = c_blk->opts.chan[channel].OpMode;	/* get Operating Mode */
+
+    /* DAC_FIFO_DMA is an abstraction that differentiates DMA transfers from CPU transfers */
+    /* only the DAC_FIFO mode exists, the DAC FIFO can be written by CPU or DMA */
+    if(control == DAC_FIFO_DMA)
+       control = DAC_FIFO;
+
+    control |= (c_blk->opts.chan[channel].TriggerSource << 2); /* Trigger Source */
+    return control;
+}
+
+/* TRUE if the channel's options call for its interrupt to be enabled */
+static BOOL wants_irq(struct cblk235 *c_blk, int channel)
+{
+    switch(c_blk->opts.chan[channel].OpMode)
+    {
+       case DAC_SB:	    /* these modes can be interrupt driven */
+       case DAC_FIFO:
+       case DAC_FIFO_DMA:
+            /* Interrupt Source enable/disable DAC_FIFO, DAC_FIFO_DMA, or Single Burst interrupt */
+            return c_blk->opts.chan[channel].InterruptSource == FIFO_SBURST;
+    }
+    return FALSE;
+}
+
+
 
 void cnfg235(struct cblk235 *c_blk, int channel)
 {
@@ -81,24 +138,13 @@ void cnfg235(struct cblk235 *c_blk, int channel)
 
     control = FullResetWrite << 16;	/* initialize control register write value */
     output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, control );
-    usleep((useconds_t) 2);	/* write delay */
+    write_delay( c_blk->nHandle, 2 );	/* write delay */
 
     control = DataResetWrite << 16;	/* initialize control register write value */
     output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, control );
-    usleep((useconds_t) 2);	/* write delay */
-
-    control = WriteControl << 16;	/* initialize channel control register write value */
-
-    control |= (c_blk->opts.chan[channel].ClearVoltage << 9); /* Clear Voltage */
-
-    control |= (c_blk->opts.chan[channel].OverRange << 8); /* 5% Overrange */
-
-    control |= (c_blk->opts.chan[channel].ThermalShutdown << 6); /* Thermal Shutdown */
-
-    control |= (c_blk->opts.chan[channel].PowerUpVoltage << 3); /* Power-up Voltage */
-
-    control |= c_blk->opts.chan[channel].Range; /* Output Range */
+    write_delay( c_blk->nHandle, 2 );	/* write delay */
 
+    control = direct_word(c_blk, channel);
     output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, control );
 
     /* Underflow Clear in DAC channel status */
@@ -114,25 +160,128 @@ void cnfg235(struct cblk235 *c_blk, int channel)
     output_long( c_blk->nHandle, (long *)&c_blk->brd_ptr->CommonControl, (long)temp );
 
     /* configure channel X control register */
-    control = c_blk->opts.chan[channel].OpMode;	/* get Operating Mode */
+    output_long( c_blk->nHandle, (long *)&c_blk->brd_ptr->DAC[channel].Control, control_word(c_blk, channel) );
+
+    if( wants_irq(c_blk, channel) )
+        output_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->AXI_SetInterruptEnableRegister, (long)( 1 << channel));
+
+    /* remember what was written for cnfgdiff235 */
+    c_blk->shadow[channel].Valid = TRUE;
+    c_blk->shadow[channel].Irq = wants_irq(c_blk, channel);
+    c_blk->shadow[channel].Direct = control;
+    c_blk->shadow[channel].Status = c_blk->opts.chan[channel].UnderflowClear << 3;
+    c_blk->shadow[channel].Control = control_word(c_blk, channel);
+    c_blk->ShadowCommon = TRUE;
+    c_blk->ShadowTimer = c_blk->TimerDivider;
+    c_blk->ShadowTrigger = c_blk->TriggerDirection;
+}
 
-    /* DAC_FIFO_DMA is an abstraction that differentiates DMA transfers from CPU transfers */
-    /* only the DAC_FIFO mode exists, the DAC FIFO can be written by CPU or DMA */
-    if(control == DAC_FIFO_DMA)
-       control = DAC_FIFO;
 
-    control |= (c_blk->opts.chan[channel].TriggerSource << 2); /* Trigger Source */
-    output_long( c_blk->nHandle, (long *)&c_blk->brd_ptr->DAC[channel].Control, control );
 
-    switch(c_blk->opts.chan[channel].OpMode)
+/*
+    cnfgdiff235 brings the channels in mask and the board wide timer and trigger
+    direction up to date with the options, writing only the registers whose value
+    differs from the shadow.  A channel is reset as cnfg235 does only if it has not
+    been configured yet or its FullReset option is set; DataReset resets only its data.
+    The writes, apart from the resets, are made as one batch.
+*/
+
+void cnfgdiff235(struct cblk235 *c_blk, uint32_t mask)
+{
+    APWRITE_OP ops[2 + 16 * 4];
+    struct shadow235 *sh;
+    uint32_t v, temp;
+    size_t n = 0;
+    int channel;
+    BOOL irq;
+
+    /* resets need their delays before the next write, so are made first, one by one */
+    for( channel = 0; channel < 16; channel++ )
     {
-       case DAC_SB:	    /* these modes can be interrupt driven */
-       case DAC_FIFO:
-       case DAC_FIFO_DMA:
-            /* Interrupt Source enable/disable DAC_FIFO, DAC_FIFO_DMA, or Single Burst interrupt */
-            if( c_blk->opts.chan[channel].InterruptSource == FIFO_SBURST )
-                output_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->AXI_SetInterruptEnableRegister, (long)( 1 << channel));
-       break;
+       if( !(mask & (1 << channel)) )
+          continue;
+
+       sh = &c_blk->shadow[channel];
+       if( !sh->Valid || c_blk->opts.chan[channel].FullReset )
+       {
+          /* make sure interrupts for this channel are disabled */
+          output_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->AXI_ClearInterruptEnableRegister, (long)( 1 << channel));
+          output_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, FullResetWrite << 16);
+          write_delay_ap(c_blk->pAP, 2);	/* write delay */
+          output_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, DataResetWrite << 16);
+          write_delay_ap(c_blk->pAP, 2);	/* write delay */
+          memset(sh, 0, sizeof(*sh));	/* nothing on the channel is known now */
+       }
+       else if( c_blk->opts.chan[channel].DataReset )
+       {
+          output_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, DataResetWrite << 16);
+          write_delay_ap(c_blk->pAP, 2);	/* write delay */
+       }
     }
+
+    if( !c_blk->ShadowCommon || c_blk->ShadowTimer != c_blk->TimerDivider )
+    {
+       ops[n].p = (long*)&c_blk->brd_ptr->TimerDivider;
+       ops[n].v = c_blk->TimerDivider;
+       ops[n++].uDelay = 0;
+    }
+    if( !c_blk->ShadowCommon || c_blk->ShadowTrigger != c_blk->TriggerDirection )
+    {
+       temp = input_long_ap(c_blk->pAP, (long *)&c_blk->brd_ptr->CommonControl);
+       temp &= 0xFFFFFFF7;		/* clear trigger direction */
+       temp |= c_blk->TriggerDirection << 3;
+       ops[n].p = (long*)&c_blk->brd_ptr->CommonControl;
+       ops[n].v = (long)temp;
+       ops[n++].uDelay = 0;
+    }
+    c_blk->ShadowCommon = TRUE;
+    c_blk->ShadowTimer = c_blk->TimerDivider;
+    c_blk->ShadowTrigger = c_blk->TriggerDirection;
+
+    for( channel = 0; channel < 16; channel++ )
+    {
+       if( !(mask & (1 << channel)) )
+          continue;
+
+       sh = &c_blk->shadow[channel];
+       v = direct_word(c_blk, channel);
+       if( !sh->Valid || sh->Direct != v )
+       {
+          ops[n].p = (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess;
+          ops[n].v = (long)v;
+          ops[n++].uDelay = 0;
+          sh->Direct = v;
+       }
+       v = c_blk->opts.chan[channel].UnderflowClear << 3;
+       if( !sh->Valid || sh->Status != v )
+       {
+          ops[n].p = (long*)&c_blk->brd_ptr->DAC[channel].Status;
+          ops[n].v = (long)v;
+          ops[n++].uDelay = 0;
+          sh->Status = v;
+       }
+       v = control_word(c_blk, channel);
+       if( !sh->Valid || sh->Control != v )
+       {
+          ops[n].p = (long*)&c_blk->brd_ptr->DAC[channel].Control;
+          ops[n].v = (long)v;
+          ops[n++].uDelay = 0;
+          sh->Control = v;
+       }
+       irq = wants_irq(c_blk, channel);
+       if( irq != sh->Irq )
+       {
+          if( irq )
+             ops[n].p = (long*)&c_blk->brd_ptr->AXI_SetInterruptEnableRegister;
+          else
+             ops[n].p = (long*)&c_blk->brd_ptr->AXI_ClearInterruptEnableRegister;
+          ops[n].v = (long)( 1 << channel);
+          ops[n++].uDelay = 0;
+          sh->Irq = irq;
+       }
+       sh->Valid = TRUE;
+    }
+
+    output_long_batch_ap(c_blk->pAP, ops, n);
 }
 
@@ -40,6 +40,7 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+	  JPL	    register writes are submitted as one batch, delays follow the write delay mode
 
 {-D}
 */
@@ -69,6 +70,8 @@ void cnfg236(struct cblk236 *c_blk, int channel)
 */
 
     uint32_t control;		/* control register */
+    APWRITE_OP ops[3];		/* resets and control word, written as one batch */
+    size_t nops = 0;
 
 /*
     ENTRY POINT OF ROUTINE:
@@ -77,16 +80,16 @@ void cnfg236(struct cblk236 *c_blk, int channel)
 
     if(c_blk->opts.chan[channel].ParameterMask & 0x80) /* Full Device Reset */
     {
-	control = FullResetWrite << 16;	/* initialize control register write value */
-	output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->dac_reg[channel], control );
-	usleep((useconds_t) 2);	/* write delay */
+	ops[nops].p = (long*)&c_blk->brd_ptr->dac_reg[channel];
+	ops[nops].v = FullResetWrite << 16;	/* initialize control register write value */
+	ops[nops++].uDelay = 2;			/* write delay */
     }
 
     if(c_blk->opts.chan[channel].ParameterMask & 0x40) /* Data Reset */
     {
-	control = DataResetWrite << 16;	/* initialize control register write value */
-	output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->dac_reg[channel], control );
-	usleep((useconds_t) 2);	/* write delay */
+	ops[nops].p = (long*)&c_blk->brd_ptr->dac_reg[channel];
+	ops[nops].v = DataResetWrite << 16;	/* initialize control register write value */
+	ops[nops++].uDelay = 2;			/* write delay */
     }
 
 
@@ -111,7 +114,9 @@ void cnfg236(struct cblk236 *c_blk, int channel)
     if(c_blk->opts.chan[channel].ParameterMask & 0x01) /* Output Range */
        control |= c_blk->opts.chan[channel].Range;
 
-    output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->dac_reg[channel], control );
-    usleep((useconds_t) 2);	/* write delay */
-}
+    ops[nops].p = (long*)&c_blk->brd_ptr->dac_reg[channel];
+    ops[nops].v = control;
+    ops[nops++].uDelay = 2;	/* write delay */
 
+    output_long_batch( c_blk->nHandle, ops, nops );
+}
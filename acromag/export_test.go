@@ -0,0 +1,20 @@
+package acromag
+
+// CalibrationKernel forces the SIMD level of the calibration kernels, for the
+// tests of package acromag_test
+var CalibrationKernel = calibrationKernel
+
+// TraceRing is the capacity in records of the rings of a board
+const TraceRing = traceRing
+
+// Flush drains the rings of a tracer into its file now
+func (t *Tracer) Flush() {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	t.flush()
+}
+
+// CalibrationRecord returns the correction terms of a channel of an AP235
+func CalibrationRecord(dac *AP235, channel int) (gain, offset, cliplo, cliphi float64) {
+	return dac.calRecord(channel)
+}
@@ -0,0 +1,116 @@
+package acromag
+
+/*
+#include "apgen.h"
+*/
+import "C"
+import (
+	"fmt"
+	"math"
+)
+
+// Tone is one sine of a "tones" Generator
+type Tone struct {
+	// Amplitude is the peak deviation in volts
+	Amplitude float64 `json:"amplitude"`
+
+	// Frequency is in Hz
+	Frequency float64 `json:"frequency"`
+
+	// Phase is in radians
+	Phase float64 `json:"phase"`
+}
+
+// Generator describes a waveform computed during playback rather than played
+// from a buffer, see AP235.SetGenerator
+type Generator struct {
+	// Shape is one of:
+	//  sine:     Offset + Amplitude sin(2 pi Frequency t + Phase)
+	//  ramp:     rising from Offset - Amplitude to Offset + Amplitude each period
+	//  triangle: from Offset - Amplitude up to Offset + Amplitude and back each period
+	//  chirp:    a sine swept linearly from Frequency to StopFrequency over
+	//            SweepTime, then again from Frequency
+	//  tones:    Offset plus the sum of the sines of Tones
+	Shape string `json:"shape"`
+
+	// Offset is the voltage the waveform is centered on
+	Offset float64 `json:"offset"`
+
+	// Amplitude is the peak deviation from Offset in volts, unused by tones
+	Amplitude float64 `json:"amplitude"`
+
+	// Frequency is in Hz, unused by tones
+	Frequency float64 `json:"frequency"`
+
+	// Phase is in radians of the period, unused by tones.  A ramp or
+	// triangle of phase 0 starts at Offset - Amplitude
+	Phase float64 `json:"phase"`
+
+	// StopFrequency (Hz) and SweepTime (s) are the end of a chirp's sweep
+	StopFrequency float64 `json:"stop_frequency"`
+	SweepTime     float64 `json:"sweep_time"`
+
+	// Tones are the sines of tones, up to MaxTones
+	Tones []Tone `json:"tones"`
+}
+
+// MaxTones is the most Tones a Generator may have
+const MaxTones = C.APGEN_TONES
+
+var generatorShapes = map[string]C.int{
+	"sine":     C.APGEN_SINE,
+	"ramp":     C.APGEN_RAMP,
+	"triangle": C.APGEN_TRIANGLE,
+	"chirp":    C.APGEN_CHIRP,
+	"tones":    C.APGEN_MULTITONE,
+}
+
+// finite is true if none of v is NaN or infinite
+func finite(v ...float64) bool {
+	for _, x := range v {
+		if math.IsNaN(x) || math.IsInf(x, 0) {
+			return false
+		}
+	}
+	return true
+}
+
+// toC validates g and converts it to the form apgen plays
+func (g Generator) toC() (C.APGEN, error) {
+	var out C.APGEN
+	shape, ok := generatorShapes[g.Shape]
+	if !ok {
+		return out, fmt.Errorf("generator shape %q is not one of sine, ramp, triangle, chirp, tones", g.Shape)
+	}
+	if !finite(g.Offset, g.Amplitude, g.Frequency, g.Phase, g.StopFrequency, g.SweepTime) {
+		return out, fmt.Errorf("generator parameters must be finite, got %+v", g)
+	}
+	if g.Frequency < 0 || g.StopFrequency < 0 {
+		return out, fmt.Errorf("generator frequencies must not be negative, got %g and %g Hz", g.Frequency, g.StopFrequency)
+	}
+	if g.Shape == "chirp" && !(g.SweepTime > 0) {
+		return out, fmt.Errorf("chirp sweep time %g s is not allowed", g.SweepTime)
+	}
+	if g.Shape == "tones" && (len(g.Tones) == 0 || len(g.Tones) > MaxTones) {
+		return out, fmt.Errorf("a tones generator needs 1 to %d tones, got %d", MaxTones, len(g.Tones))
+	}
+	out.shape = shape
+	out.offset = C.double(g.Offset)
+	out.amplitude = C.double(g.Amplitude)
+	out.frequency = C.double(g.Frequency)
+	out.phase = C.double(g.Phase)
+	out.stop = C.double(g.StopFrequency)
+	out.sweep = C.double(g.SweepTime)
+	if g.Shape == "tones" {
+		for i, t := range g.Tones {
+			if !finite(t.Amplitude, t.Frequency, t.Phase) || t.Frequency < 0 {
+				return out, fmt.Errorf("tone %d is not allowed: %+v", i, t)
+			}
+			out.tone[i].amplitude = C.double(t.Amplitude)
+			out.tone[i].frequency = C.double(t.Frequency)
+			out.tone[i].phase = C.double(t.Phase)
+		}
+		out.ntones = C.int(len(g.Tones))
+	}
+	return out, nil
+}
@@ -0,0 +1,265 @@
+package acromag
+
+/*
+#include "apcommon.h"
+*/
+import "C"
+import (
+	"errors"
+	"fmt"
+	"sync"
+)
+
+// GroupMember is a board that can be part of a BoardGroup, an *AP235 or an
+// *AP236
+type GroupMember interface {
+	// Lock and Unlock are the board's lock, held by the group from the
+	// first write of an update to the trigger
+	sync.Locker
+
+	// groupChannels is the number of channels of the board
+	groupChannels() int
+
+	// stage and stageDN16 write to channels in simultaneous output mode,
+	// leaving the outputs to be updated by the trigger
+	stage([]int, []float64) error
+	stageDN16([]int, []uint16) error
+
+	// trigger is the handle of the board and the register write that
+	// updates its simultaneous outputs
+	trigger() (C.int, C.APWRITE_OP)
+}
+
+// GroupStats is the trigger timing of a BoardGroup
+type GroupStats struct {
+	// Updates is the number of group updates made
+	Updates uint64 `json:"updates"`
+
+	// SkewNs is the time between the first and last board's triggers of the
+	// last update, as measured around the trigger writes
+	SkewNs int64 `json:"skew_ns"`
+
+	// MaxSkewNs is the largest SkewNs seen
+	MaxSkewNs int64 `json:"max_skew_ns"`
+
+	// TriggerOffsetsNs is the time of each board's trigger of the last
+	// update from the first's, in the order of the group; boards that were
+	// not written to in the last update are not triggered and left out
+	TriggerOffsetsNs []int64 `json:"trigger_offsets_ns"`
+}
+
+// BoardGroup drives several boards as one wide DAC.  The channels of the
+// group are numbered through the boards in order, so a group of three AP236s
+// has channels 0-23, with channel 8 the first of the second board.
+//
+// An update writes to every board concerned in simultaneous output mode, in
+// batches, then fires the boards' triggers back to back so their outputs
+// change together.  The trigger writes of boards opened with IOMapped are
+// stores a few nanoseconds apart; with IOSyscall each is a syscall.  See
+// Stats for the skew measured.
+//
+// The channels written must be in simultaneous output mode and, on an AP235,
+// software triggered
+type BoardGroup struct {
+	mu sync.Mutex
+
+	members []GroupMember
+
+	// first is the group channel of each member's channel 0, plus the total
+	first []int
+
+	// chans, volts and dns are the channels and values of each member of
+	// the update in progress
+	chans [][]int
+	volts [][]float64
+	dns   [][]uint16
+
+	// handles and ops are the trigger writes of an update, ns their timing
+	handles []C.int
+	ops     []C.APWRITE_OP
+	ns      []C.longlong
+
+	stats GroupStats
+}
+
+// NewBoardGroup creates a group of boards.  The boards must be open and stay
+// open for the life of the group.  They may still be used on their own: an
+// update holds the lock of each board it writes to, in the order of the
+// group, until the boards are triggered, so a board in several groups must
+// come in the same order in each
+func NewBoardGroup(boards ...GroupMember) (*BoardGroup, error) {
+	if len(boards) == 0 {
+		return nil, errors.New("a board group needs at least one board")
+	}
+	if len(boards) > C.MAX_APS {
+		return nil, fmt.Errorf("a board group can have at most %d boards", C.MAX_APS)
+	}
+	g := &BoardGroup{
+		members: boards,
+		first:   make([]int, len(boards)+1),
+		chans:   make([][]int, len(boards)),
+		volts:   make([][]float64, len(boards)),
+		dns:     make([][]uint16, len(boards)),
+		handles: make([]C.int, len(boards)),
+		ops:     make([]C.APWRITE_OP, len(boards)),
+		ns:      make([]C.longlong, len(boards)),
+	}
+	for i, b := range boards {
+		g.first[i+1] = g.first[i] + b.groupChannels()
+	}
+	return g, nil
+}
+
+// Channels is the number of channels of the group
+func (g *BoardGroup) Channels() int {
+	return g.first[len(g.members)]
+}
+
+// member returns the index of the member a group channel is on
+func (g *BoardGroup) member(channel int) (int, error) {
+	if channel < 0 || channel >= g.Channels() {
+		return 0, fmt.Errorf("channel %d outside of the group's %d channels", channel, g.Channels())
+	}
+	i := 0
+	for channel >= g.first[i+1] {
+		i++
+	}
+	return i, nil
+}
+
+// Output writes a voltage to a channel of the group.
+// the error is non-nil if the channel does not exist or cannot be written
+// by the group, see OutputMulti
+func (g *BoardGroup) Output(channel int, voltage float64) error {
+	return g.OutputMulti([]int{channel}, []float64{voltage})
+}
+
+// OutputDN16 is Output with a DN instead of a voltage
+func (g *BoardGroup) OutputDN16(channel int, value uint16) error {
+	return g.OutputMultiDN16([]int{channel}, []uint16{value})
+}
+
+// OutputMulti writes voltages to channels of the group and updates them all
+// at once.  the error is non-nil if a channel does not exist or is not in
+// simultaneous output mode, or if a board refuses the write; no board is
+// triggered then, but boards written before the error hold the new values
+// until their next trigger.  Slices must be of equal length
+func (g *BoardGroup) OutputMulti(channels []int, voltages []float64) error {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	g.reset()
+	for i, ch := range channels {
+		m, err := g.member(ch)
+		if err != nil {
+			return err
+		}
+		g.chans[m] = append(g.chans[m], ch-g.first[m])
+		g.volts[m] = append(g.volts[m], voltages[i])
+	}
+	g.lock()
+	defer g.unlock()
+	for m, b := range g.members {
+		if len(g.chans[m]) == 0 {
+			continue
+		}
+		if err := b.stage(g.chans[m], g.volts[m]); err != nil {
+			return fmt.Errorf("board %d of the group: %w", m, err)
+		}
+	}
+	g.fire()
+	return nil
+}
+
+// OutputMultiDN16 is OutputMulti with DNs instead of voltages
+func (g *BoardGroup) OutputMultiDN16(channels []int, uint16s []uint16) error {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	g.reset()
+	for i, ch := range channels {
+		m, err := g.member(ch)
+		if err != nil {
+			return err
+		}
+		g.chans[m] = append(g.chans[m], ch-g.first[m])
+		g.dns[m] = append(g.dns[m], uint16s[i])
+	}
+	g.lock()
+	defer g.unlock()
+	for m, b := range g.members {
+		if len(g.chans[m]) == 0 {
+			continue
+		}
+		if err := b.stageDN16(g.chans[m], g.dns[m]); err != nil {
+			return fmt.Errorf("board %d of the group: %w", m, err)
+		}
+	}
+	g.fire()
+	return nil
+}
+
+// reset empties the per member slices, keeping their storage
+func (g *BoardGroup) reset() {
+	for m := range g.members {
+		g.chans[m] = g.chans[m][:0]
+		g.volts[m] = g.volts[m][:0]
+		g.dns[m] = g.dns[m][:0]
+	}
+}
+
+// lock takes the locks of the members written to by the update, in order;
+// unlock releases them
+func (g *BoardGroup) lock() {
+	for m, b := range g.members {
+		if len(g.chans[m]) != 0 {
+			b.Lock()
+		}
+	}
+}
+
+func (g *BoardGroup) unlock() {
+	for m, b := range g.members {
+		if len(g.chans[m]) != 0 {
+			b.Unlock()
+		}
+	}
+}
+
+// fire triggers the members written to by the update and records the timing
+func (g *BoardGroup) fire() {
+	n := 0
+	for m, b := range g.members {
+		if len(g.chans[m]) == 0 {
+			continue
+		}
+		g.handles[n], g.ops[n] = b.trigger()
+		n++
+	}
+	if n == 0 {
+		return
+	}
+	C.output_long_group(&g.handles[0], &g.ops[0], C.size_t(n), &g.ns[0])
+
+	g.stats.Updates++
+	g.stats.SkewNs = int64(g.ns[n-1] - g.ns[0])
+	if g.stats.SkewNs > g.stats.MaxSkewNs {
+		g.stats.MaxSkewNs = g.stats.SkewNs
+	}
+	g.stats.TriggerOffsetsNs = g.stats.TriggerOffsetsNs[:0]
+	for i := 0; i < n; i++ {
+		g.stats.TriggerOffsetsNs = append(g.stats.TriggerOffsetsNs, int64(g.ns[i]-g.ns[0]))
+	}
+}
+
+// Stats returns the trigger timing of the group
+func (g *BoardGroup) Stats() GroupStats {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	out := g.stats
+	out.TriggerOffsetsNs = append([]int64(nil), g.stats.TriggerOffsetsNs...)
+	return out
+}
+
+// Instrumentation is Stats for generichttp/daq
+func (g *BoardGroup) Instrumentation() interface{} {
+	return g.Stats()
+}
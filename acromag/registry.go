@@ -0,0 +1,145 @@
+package acromag
+
+import (
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+)
+
+// Boards are boards opened together by OpenBoards or OpenAll, each model in
+// the order of its device indices
+type Boards struct {
+	AP235 []*AP235
+	AP236 []*AP236
+}
+
+// Close closes every board, returning the first error
+func (b *Boards) Close() error {
+	var first error
+	for _, dac := range b.AP235 {
+		if err := dac.Close(); err != nil && first == nil {
+			first = err
+		}
+	}
+	for _, dac := range b.AP236 {
+		if err := dac.Close(); err != nil && first == nil {
+			first = err
+		}
+	}
+	return first
+}
+
+// BoardError is the failure to open one board
+type BoardError struct {
+	// Model is "ap235" or "ap236"
+	Model string
+
+	// Index is the device index of the board
+	Index int
+
+	Err error
+}
+
+func (e BoardError) Error() string {
+	return e.Model + "_" + strconv.Itoa(e.Index) + ": " + e.Err.Error()
+}
+
+// OpenError lists the boards OpenBoards failed to open
+type OpenError []BoardError
+
+func (e OpenError) Error() string {
+	s := make([]string, len(e))
+	for i, b := range e {
+		s[i] = b.Error()
+	}
+	return "opening boards failed: " + strings.Join(s, "; ")
+}
+
+// Discover returns the device indices of the AP235s and AP236s the driver
+// made nodes for, /dev/ap235_N and /dev/ap236_N, in increasing order
+func Discover() (ap235, ap236 []int, err error) {
+	ap235, err = deviceIndices("/dev/ap235_")
+	if err != nil {
+		return nil, nil, err
+	}
+	ap236, err = deviceIndices("/dev/ap236_")
+	return ap235, ap236, err
+}
+
+// deviceIndices returns the N of the nodes prefix+N
+func deviceIndices(prefix string) ([]int, error) {
+	names, err := filepath.Glob(prefix + "*")
+	if err != nil {
+		return nil, err
+	}
+	var out []int
+	for _, name := range names {
+		i, err := strconv.Atoi(strings.TrimPrefix(name, prefix))
+		if err == nil && i >= 0 {
+			out = append(out, i)
+		}
+	}
+	sort.Ints(out)
+	return out, nil
+}
+
+// OpenBoards opens the AP235s and AP236s of the given device indices at once,
+// one goroutine per board, so the flash reads and resets of each run side by
+// side and the time taken is that of the slowest board rather than the sum.
+// The boards that open are returned even if some fail; the error is then an
+// OpenError listing the others, which are left out and hold nothing of
+// their boards, so a failed board can be opened again later
+func OpenBoards(ap235, ap236 []int, mode IOMode) (*Boards, error) {
+	var (
+		wg     sync.WaitGroup
+		d235   = make([]*AP235, len(ap235))
+		d236   = make([]*AP236, len(ap236))
+		errs   = make([]error, len(ap235)+len(ap236))
+		boards = &Boards{}
+		failed OpenError
+	)
+	for i, index := range ap235 {
+		wg.Add(1)
+		go func(i, index int) {
+			defer wg.Done()
+			d235[i], errs[i] = NewAP235WithIO(index, mode)
+		}(i, index)
+	}
+	for i, index := range ap236 {
+		wg.Add(1)
+		go func(i, index int) {
+			defer wg.Done()
+			d236[i], errs[len(ap235)+i] = NewAP236WithIO(index, mode)
+		}(i, index)
+	}
+	wg.Wait()
+	for i, dac := range d235 {
+		if errs[i] != nil {
+			failed = append(failed, BoardError{Model: "ap235", Index: ap235[i], Err: errs[i]})
+			continue
+		}
+		boards.AP235 = append(boards.AP235, dac)
+	}
+	for i, dac := range d236 {
+		if err := errs[len(ap235)+i]; err != nil {
+			failed = append(failed, BoardError{Model: "ap236", Index: ap236[i], Err: err})
+			continue
+		}
+		boards.AP236 = append(boards.AP236, dac)
+	}
+	if len(failed) > 0 {
+		return boards, failed
+	}
+	return boards, nil
+}
+
+// OpenAll opens every board Discover finds, see OpenBoards
+func OpenAll(mode IOMode) (*Boards, error) {
+	ap235, ap236, err := Discover()
+	if err != nil {
+		return &Boards{}, err
+	}
+	return OpenBoards(ap235, ap236, mode)
+}
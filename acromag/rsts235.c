@@ -38,6 +38,7 @@
 
   DATE    BY        PURPOSE
 -------  ----   ------------------------------------------------
+          JPL       register accesses go through c_blk->pAP, no handle lookups
 
 {-D}
 */
@@ -67,40 +68,40 @@ int i;
     read board information
 */
 
-   c_blk->location = (word)input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->LocationRegister);/* AP location */
+   c_blk->location = (word)input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->LocationRegister);/* AP location */
 
-   c_blk->revision = input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->FirmwareRevision);	/* AP Revision */
+   c_blk->revision = input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->FirmwareRevision);	/* AP Revision */
 
    for(i = 0; i < 16; i++)
-     c_blk->ChStatus[i] = input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[i].Status);	/* DAC channel status */
+     c_blk->ChStatus[i] = input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->DAC[i].Status);	/* DAC channel status */
 
    /* read temp & VCC info from FPGA into status structure */
    /* temperature Data Register | (MS 16 bits addr 200) */
 
-   c_blk->FPGAAdrData[0] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_Temperature) | 0x2000000);
+   c_blk->FPGAAdrData[0] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_Temperature) | 0x2000000);
 
    /* supply monitor Data Register | (MS 16 bits addr 204) */
-   c_blk->FPGAAdrData[1] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_VCCInt) | 0x2040000);
+   c_blk->FPGAAdrData[1] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_VCCInt) | 0x2040000);
 
    /* supply monitor Data Register | (MS 16 bits addr 208) */
-   c_blk->FPGAAdrData[2] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_VCCAux) | 0x2080000);
+   c_blk->FPGAAdrData[2] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_VCCAux) | 0x2080000);
 
    /* MAXtemperature Data Register | (MS 16 bits addr 280) */
-   c_blk->FPGAAdrData[3] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MAXTemperature) | 0x2800000);
+   c_blk->FPGAAdrData[3] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MAXTemperature) | 0x2800000);
 
    /* MAXsupply monitor Data Register | (MS 16 bits addr 284) */
-   c_blk->FPGAAdrData[4] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MAXVCCInt) | 0x2840000);
+   c_blk->FPGAAdrData[4] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MAXVCCInt) | 0x2840000);
 
    /* MAXsupply monitor Data Register | (MS 16 bits addr 288) */
-   c_blk->FPGAAdrData[5] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MAXVCCAux) | 0x2880000);
+   c_blk->FPGAAdrData[5] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MAXVCCAux) | 0x2880000);
 
    /* MINtemperature Data Register | (MS 16 bits addr 290) */
-   c_blk->FPGAAdrData[6] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MINTemperature) | 0x2900000);
+   c_blk->FPGAAdrData[6] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MINTemperature) | 0x2900000);
 
    /* MINsupply monitor Data Register (MS 16 bits addr 294) */
-   c_blk->FPGAAdrData[7] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MINVCCInt) | 0x2940000);
+   c_blk->FPGAAdrData[7] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MINVCCInt) | 0x2940000);
 
    /* MINsupply monitor Data Register (MS 16 bits addr 298) */
-   c_blk->FPGAAdrData[8] = (input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->XW_MINVCCAux) | 0x2980000);
+   c_blk->FPGAAdrData[8] = (input_long_ap(c_blk->pAP, (long*)&c_blk->brd_ptr->XW_MINVCCAux) | 0x2980000);
 }
 
@@ -12,6 +12,7 @@
 
 #define WIP                   0x01	/* Write in progress status */
 #define FMAX_TRIES            250	/* FLASH write status reads tries */
+#define FBLOCK_SIZE           256	/* largest ReadBlock_M25P10() length */
 /*#define DBG_SPI		0	/ * define to output SPI data */
 /*///////////////////////////////////////////////////////////////////////////////////////////*/
 
@@ -22,6 +23,7 @@ static int ReadStatus_M25P10(struct cblk236 *c_blk );
 static int SectorErase_M25P10(struct cblk236 *c_blk );
 static int WriteFlashBlock(struct cblk236 *c_blk, uint32_t address, void *pdata, uint32_t length );
 static int ReadByte_M25P10(struct cblk236 *c_blk, unsigned long address, unsigned char *p );
+static int ReadBlock_M25P10(struct cblk236 *c_blk, unsigned long address, unsigned char *p, unsigned int length );
 static int BlankCheckFlash( struct cblk236 *c_blk );
 
 
@@ -458,6 +460,69 @@ static int ReadByte_M25P10(struct cblk236 *c_blk, unsigned long address, unsigne
 }
 
 
+
+/*
+{+D}
+    SYSTEM:	    Library Software - AP236 Board
+
+    MODULE NAME:    ReadBlock_M25P10() - routine to read a block of data from the M25P10 device.
+
+    VERSION:	    A
+
+    CREATION DATE:  10/14/26
+
+    CODED BY:       JPL
+
+    ABSTRACT:       This module will issue one read command for a block of the M25P10 device.
+
+    CALLING
+	SEQUENCE:   static int ReadBlock_M25P10(struct cblk236 *c_blk, unsigned long address, unsigned char *p, unsigned int length)
+
+    MODULE TYPE:    int
+
+    REVISIONS:
+
+  DATE    BY        PURPOSE
+-------  ----   ------------------------------------------------
+
+
+{-D}
+*/
+
+/*
+    MODULES FUNCTIONAL DETAILS:
+
+    The M25P10 continues a read at the next address for as long as it is
+    clocked, so a block is read with one command under one chip select
+    instead of a command, address, and chip select cycle per byte
+    (ReadByte_M25P10).
+*/
+
+
+
+static int ReadBlock_M25P10(struct cblk236 *c_blk, unsigned long address, unsigned char *p, unsigned int length )
+{
+    unsigned char cmd_buf[FBLOCK_SIZE + 4];
+    unsigned char rsp_buf[FBLOCK_SIZE + 4];
+    int status;
+
+    if( p == NULL || length > FBLOCK_SIZE )
+	return((int) -1);			/* error */
+
+    memset(&cmd_buf[0],0,length + 4);		/* empty the command buffer, the data bytes clock out zeros */
+
+    cmd_buf[0] = ReadM25P10;				/* read command */
+    cmd_buf[1] = (unsigned char)(address >> 16);	/* form A23-A16 address byte */
+    cmd_buf[2] = (unsigned char)(address >> 8);		/* form A15-A8 address byte */
+    cmd_buf[3] = (unsigned char)(address);		/* form lower address byte */
+
+    status = I0_M25P10(c_blk, &cmd_buf[0], &rsp_buf[0], length + 4);/* Issue command */
+
+    memcpy(p, &rsp_buf[4], length);			/* recover the response */
+    return(status);
+}
+
+
 /*
 {+D}
     SYSTEM:	    Library Software - AP236 Board
@@ -652,6 +717,8 @@ int ReadFlashID236(struct cblk236 *c_blk, unsigned char *p )
 
   DATE    BY        PURPOSE
 -------  ----   ------------------------------------------------
+10/14/26  JPL	invalidate the cached correction records
+          JPL	one ReadBlock_M25P10() per channel instead of a read per byte
 
 {-D}
 */
@@ -677,7 +744,7 @@ int rcc236( struct cblk236 *c_blk )
          Declare local data areas
 */
 
-unsigned char read_data;
+unsigned char coefs[8 * 4];	/* offset & gain pairs of one channel, LSB first */
 uint32_t channel, range, j;
 int status;
 
@@ -686,41 +753,21 @@ int status;
 	Storage configuration for offset & gain correction pairs[2] for each range[8] for each channel[8]
 */
 
+ for( channel = 0; channel < 8; channel++ )
+    c_blk->cal236[channel].valid = 0;	/* corrections are recomputed on next use */
+
  for( channel = 0; channel < 8; channel++ )
  {
     j = (FlashCoefficientMemoryAddress + (channel * 256));		/* Flash memory addressing */
-    for( range = 0; range < 8; range++, j+= 2 )
-    {
-	/* read MSB offset... pair[0] */
-	status = ReadByte_M25P10(c_blk, (j + 1), &read_data );
-	if( status )
-	   return(status);
-
-        c_blk->ogc236[channel][range][OFFSET] = (word)read_data << 8;	/* position offset MSB */
-
-	/* read LSB offset... pair[0] */
-	status = ReadByte_M25P10(c_blk, j, &read_data );
-	if( status )
-	   return(status);
+    status = ReadBlock_M25P10(c_blk, j, &coefs[0], sizeof(coefs) );	/* all ranges of the channel */
+    if( status )
+       return(status);
 
-        c_blk->ogc236[channel][range][OFFSET] |= (word)read_data;	/* position offset LSB */
-
-	j+= 2;	/* advance address/index to gain data */
-
-	/* read MSB gain... pair[1] */
-	status = ReadByte_M25P10(c_blk, (j + 1), &read_data );
-	if( status )
-	   return(status);
-
-        c_blk->ogc236[channel][range][GAIN] = (word)read_data << 8;	/* position gain MSB */
-
-	/* read LSB gain... pair[1] */
-	status = ReadByte_M25P10(c_blk, j, &read_data );
-
-	if( status )
-	   return(status);
-
-        c_blk->ogc236[channel][range][GAIN] |= (word)read_data;		/* position gain LSB */
+    for( range = 0; range < 8; range++ )
+    {
+        j = range * 4;
+        c_blk->ogc236[channel][range][OFFSET] = (word)coefs[j + 1] << 8 | (word)coefs[j];	/* offset MSB, LSB... pair[0] */
+        c_blk->ogc236[channel][range][GAIN] = (word)coefs[j + 3] << 8 | (word)coefs[j + 2];	/* gain MSB, LSB... pair[1] */
 /*
 printf("Ch %X Rng %X Offset %04X Gain %04X\n",channel,range,(word)c_blk->ogc236[channel][range][OFFSET],(word)c_blk->ogc236[channel][range][GAIN]);
 */
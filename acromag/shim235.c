@@ -2,6 +2,9 @@
 // within C to avoid making the Go type system angry
 #include "apcommon.h"
 #include "AP235.h"
+#include "aptrace.h"
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
 APSTATUS GetAPAddress235(int nHandle, struct mapap235** pAddress)
@@ -16,6 +19,9 @@ APSTATUS GetAPAddress235(int nHandle, struct mapap235** pAddress)
 void *aligned_malloc(int size, int align)
 {
 	void *mem = malloc(size + align + sizeof(void *));
+	if (mem == NULL) {
+		return NULL;
+	}
 	void **ptr = (void **)((long)(mem + align + sizeof(void *)) & ~(align - 1));
 	ptr[-1] = mem;
 	return ptr;
@@ -26,6 +32,48 @@ void aligned_free(void *ptr)
 	free(((void **)ptr)[-1]);
 }
 
+// new_cblk235 allocates a zeroed cblk235 starting on a cache line, so its
+// hot members share as few lines as the layout allows
+struct cblk235 *new_cblk235(void)
+{
+	void *p;
+
+	if (posix_memalign(&p, AP_CACHE_LINE, sizeof(struct cblk235)) != 0) {
+		return NULL;
+	}
+	return memset(p, 0, sizeof(struct cblk235));
+}
+
+// free_cblk235 frees a cblk235 of new_cblk235 and its ideal code table
+void free_cblk235(struct cblk235 *cfg)
+{
+	if (cfg == NULL) {
+		return;
+	}
+	free(cfg->pIdealCode);
+	free(cfg);
+}
+
+// the refill buffers of synthesized waveforms are page locked so the refill
+// path never takes a page fault; the waveforms of Go come from its pinned pool
+#define PINNED_ALIGNMENT 4096
+
+short *alloc_pinned235(size_t samples)
+{
+	short *p = aligned_malloc(samples * sizeof(short), PINNED_ALIGNMENT);
+	if (p == NULL) {
+		return NULL;
+	}
+	mlock(p, samples * sizeof(short));
+	return p;
+}
+
+void free_pinned235(short *p, size_t samples)
+{
+	munlock(p, samples * sizeof(short));
+	aligned_free(p);
+}
+
 // refactored/taken from acromag drvr235.c, L251-262
 unsigned long *Setup_board_corrected_buffer(struct cblk235 *cfg)
 {
@@ -43,31 +91,37 @@ unsigned long *Setup_board_corrected_buffer(struct cblk235 *cfg)
 	scatter_info[2] = (unsigned long)&cfg->brd_ptr->CHAN[0].fptrlo.NxtDescPtrLo;
 	scatter_info[3] = (unsigned long)cfg->pAP->nDevInstance; /* get board instance index */
 	/* Map user pages and build scatter/gather list for DMA xfers */
-	ioctl(cfg->pAP->nAPDeviceHandle, 8, &scatter_info[0]); /* function 8 builds scatter/gather list */
+	APDeviceIoctl(cfg->nHandle, 8, &scatter_info[0]); /* function 8 builds scatter/gather list */
 	cfg->bInitialized = TRUE;
 	cfg->bAP = TRUE;
+	return scatter_info;
+}
 
+// read_calibration235 reads the ID string and the calibration coefficients
+// from the board's flash.  -1 is returned if the board is not an AP235,
+// otherwise the status of rcc235
+int read_calibration235(struct cblk235 *cfg)
+{
 	memset(&cfg->IDbuf[0],0,sizeof(cfg->IDbuf));	/* empty the buffer */
     ReadFlashID235(cfg, &cfg->IDbuf[0]);
 
     if( (strstr( (const char *)&cfg->IDbuf[0], (const char *)"AP235" ) == NULL) )	{/* AP2X5 ID */
-		  return NULL;
-	}
-    else
-    {
-		rcc235(cfg); /* read the calibration coef. into an array */
+		  return -1;
 	}
-	return scatter_info;
+	return rcc235(cfg); /* read the calibration coef. into an array */
 }
 
 void Teardown_board_corrected_buffer(struct cblk235 *cfg)
 {
 	unsigned long scatter_info[4];
 	scatter_info[0] = (unsigned long)cfg->pAP->nDevInstance; /* get board instance */
-	ioctl(cfg->pAP->nAPDeviceHandle, 9, &scatter_info[0]);   /* unmap user pages and scatter-gather list */
+	APDeviceIoctl(cfg->nHandle, 9, &scatter_info[0]);   /* unmap user pages and scatter-gather list */
 
 	munlock(cfg->pcor_buf, sizeof(short[16][MAXSAMPLES])); /* unlock pages in memory */
 	aligned_free((void *)cfg->pcor_buf);					 /* free allocated DMA buffer on exit */
+	for (int i = 0; i < 16; i++) {
+		apcal_lut_free(&cfg->lut235[i]);
+	}
 }
 
 short* MkDataArray(int size)
@@ -102,10 +156,21 @@ void stop_waveform(struct cblk235 *cfg)
 	output_long(cfg->nHandle, (long *)(&cfg->brd_ptr->AXI_ClearInterruptEnableRegister), (long)(0x1FFFF));
 	output_long(cfg->nHandle, (long *)(&cfg->brd_ptr->AXI_MasterEnableRegister), (long)(MasterInterruptDisable));
 	APTerminateBlockedStart(cfg->nHandle);
+	dmapoll235(cfg); // interrupts are off now
+	cfg->PendingStatus = 0;
+	for (int i = 0; i < 16; i++) {
+		cfg->shadow[i].Irq = FALSE; // so cnfgdiff235 enables them again
+	}
 }
 
 unsigned long fetch_status(struct cblk235 *cfg)
 {
+	// channel interrupts that arrived while waiting for a DMA completion
+	if (cfg->PendingStatus) {
+		unsigned long status = cfg->PendingStatus;
+		cfg->PendingStatus = 0;
+		return status;
+	}
 
 	return APBlockingStartConvert(cfg->nHandle, (long *)(&cfg->brd_ptr->AXI_MasterEnableRegister), (long)(MasterInterruptEnable), (long)(2));
 }
@@ -119,8 +184,259 @@ void refresh_interrupt(struct cblk235 *cfg, unsigned long status)
 	output_long(cfg->nHandle, (long *)(&cfg->brd_ptr->AXI_SetInterruptEnableRegister), (long)(status&0xFFFF));
 }
 
+// dma_page235 copies up to one DMA page of samples, starting at buf[cursor]
+// and wrapping at buf[n], into the page the next DMA transfer reads and
+// starts that transfer.  Runs of the waveform that already sit in that page
+// (see WaveformBuffer) are not copied
+static int dma_page235(struct cblk235 *cfg, int channel, const short *buf, uint n, uint cursor, uint samples)
+{
+	short *dst = &(*cfg->pcor_buf)[channel][cfg->DMAPingPong[channel] * (MAXSAMPLES / 2)];
+	uint done = 0, k;
+	while (done < samples) {
+		k = n - cursor;
+		if (k > samples - done) {
+			k = samples - done;
+		}
+		if (&buf[cursor] != &dst[done]) {
+			memcpy(&dst[done], &buf[cursor], k * sizeof(short));
+		}
+		done += k;
+		cursor += k;
+		if (cursor == n) {
+			cursor = 0;
+		}
+	}
+	// the FIFO takes samples in pairs, so an odd last one is output for a
+	// second period.  Odd refills end at the end of the waveform, so the pad
+	// slot is past its last sample even when the page is the waveform's own
+	if (samples & 1) {
+		dst[samples] = dst[samples - 1];
+		samples++;
+	}
+	cfg->SampleCount[channel] = samples;
+	return fifodmawro235(cfg, channel);
+}
+
+// dma_refill235 sends samples samples, starting at buf[cursor] and wrapping
+// at buf[n], to the channel's FIFO as one DMA transfer per page
+int dma_refill235(struct cblk235 *cfg, int channel, const short *buf, uint n, uint cursor, uint samples)
+{
+	int status;
+	uint k;
+	while (samples > 0) {
+		k = samples;
+		if (k > MAXSAMPLES / 2) {
+			k = MAXSAMPLES / 2;
+		}
+		status = dma_page235(cfg, channel, buf, n, cursor, k);
+		if (status != S_OK) {
+			return status;
+		}
+		cursor = (cursor + k) % n;
+		samples -= k;
+	}
+	return S_OK;
+}
+
+// set_DAC_sample_addresses points the channel's FIFO at its sample memory
+// window, by default the channel's MAXSAMPLES words
 void set_DAC_sample_addresses(struct cblk235 *cfg, int channel)
 {
-	output_long(cfg->nHandle, (long *)&cfg->brd_ptr->DAC[channel].StartAddr, (long)channel * MAXSAMPLES);
-	output_long(cfg->nHandle, (long *)&cfg->brd_ptr->DAC[channel].EndAddr, (long)channel * MAXSAMPLES + 4095);
+	uint32_t start = channel * MAXSAMPLES, size = MAXSAMPLES;
+	if (cfg->WinSize[channel]) {
+		start = cfg->WinStart[channel];
+		size = cfg->WinSize[channel];
+	}
+	output_long(cfg->nHandle, (long *)&cfg->brd_ptr->DAC[channel].StartAddr, (long)start);
+	output_long(cfg->nHandle, (long *)&cfg->brd_ptr->DAC[channel].EndAddr, (long)(start + size - 1));
+}
+
+// partition235 splits the sample memory evenly among the channels in mask
+// and points their FIFOs at their windows.  Windows are whole multiples of
+// MAXSAMPLES, so that half a window is whole DMA pages.  The other channels
+// keep their windows
+void partition235(struct cblk235 *cfg, uint32_t mask)
+{
+	uint32_t k = __builtin_popcount(mask & 0xFFFF), start = 0, size;
+	int i;
+
+	if (k == 0) {
+		return;
+	}
+	size = SAMPLEWORDS / k / MAXSAMPLES * MAXSAMPLES;
+	for (i = 0; i < 16; i++) {
+		if (mask & (1U << i)) {
+			cfg->WinStart[i] = start;
+			cfg->WinSize[i] = size;
+			start += size;
+			set_DAC_sample_addresses(cfg, i);
+		}
+	}
+}
+
+// refill_size235 is the number of samples sent to a channel's FIFO per
+// interrupt, half its window
+uint32_t refill_size235(struct cblk235 *cfg, int channel)
+{
+	if (cfg->WinSize[channel]) {
+		return cfg->WinSize[channel] / 2;
+	}
+	return MAXSAMPLES / 2;
+}
+
+// calibrate235 converts n voltages to DN for the channel at its current range.
+// cd235 does the same but only into the channel's pcor_buf
+void calibrate235(struct cblk235 *cfg, int channel, const double *volts, unsigned short *dn, size_t n)
+{
+	apcal_f64(cal235(cfg, channel), volts, dn, n);
+}
+
+void calibrate235_f32(struct cblk235 *cfg, int channel, const float *volts, unsigned short *dn, size_t n)
+{
+	apcal_f32(cal235(cfg, channel), volts, dn, n);
+}
+
+// out235 writes a straight binary code to a channel in single mode.  This is
+// fifowro235 for one sample, without going through the channel's buffer
+void out235(struct cblk235 *cfg, int channel, unsigned short code)
+{
+	uint32_t wdata;
+
+	if (cfg->opts.chan[channel].UpdateMode) { // 1 = simultaneous mode
+		wdata = SMWrite << 16;
+	} else {
+		wdata = TMWrite << 16;
+	}
+	output_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->DAC[channel].DirectAccess, (long)(wdata | code));
+	write_delay_ap(cfg->pAP, 2);
+	if (cfg->trace) {
+		aptrace_codes(cfg->trace, 1, &channel, &code);
+	}
+}
+
+// outv235 corrects a voltage for the channel at its current range and
+// writes it with out235
+void outv235(struct cblk235 *cfg, int channel, double volts)
+{
+	unsigned short code;
+
+	apcal_f64(cal235(cfg, channel), &volts, &code, 1);
+	out235(cfg, channel, code);
+}
+
+// calibrate235_dn converts n DNs spanning the channel's range to codes, as a
+// table gather if the lookup tables are in use
+void calibrate235_dn(struct cblk235 *cfg, int channel, const unsigned short *dn, unsigned short *code, size_t n)
+{
+	const unsigned short *table = lut235(cfg, channel);
+	APCAL *cal;
+
+	if (table != NULL) {
+		apcal_gather(table, dn, code, n);
+		return;
+	}
+	cal = cal235(cfg, channel);
+	apcal_dn(cal, (*cfg->pIdealCode)[cal->range][ENDPOINTLO], (*cfg->pIdealCode)[cal->range][ENDPOINTHI], dn, code, n);
+}
+
+// outdn235 writes a DN spanning the channel's range with out235
+void outdn235(struct cblk235 *cfg, int channel, unsigned short dn)
+{
+	unsigned short code;
+
+	calibrate235_dn(cfg, channel, &dn, &code, 1);
+	out235(cfg, channel, code);
+}
+
+// write_codes235 writes codes[i] to channels[i] for i < n as one batch of
+// register writes, with the write delay applied once after the last write
+static void write_codes235(struct cblk235 *cfg, int n, const int *channels, const unsigned short *codes)
+{
+	APWRITE_OP ops[16];
+	uint32_t wdata;
+	int i, ch;
+
+	for (i = 0; i < n; i++) {
+		ch = channels[i];
+		if (cfg->opts.chan[ch].UpdateMode) { // 1 = simultaneous mode
+			wdata = SMWrite << 16;
+		} else {
+			wdata = TMWrite << 16;
+		}
+		ops[i].p = (long *)&cfg->brd_ptr->DAC[ch].DirectAccess;
+		ops[i].v = (long)(wdata | codes[i]);
+		ops[i].uDelay = 0;
+	}
+	if (n > 0) {
+		ops[n - 1].uDelay = 2; // write delay
+	}
+	output_long_batch_ap(cfg->pAP, ops, (size_t)n);
+	if (cfg->trace) {
+		aptrace_codes(cfg->trace, n, channels, codes);
+	}
+}
+
+// wromulti235 corrects and writes volts[i] to channels[i] for i < n, up to
+// 16, as one batch of register writes.  This is outv235 for each channel
+void wromulti235(struct cblk235 *cfg, int n, const int *channels, const double *volts)
+{
+	unsigned short codes[16];
+	int i;
+
+	if (n > 16) {
+		n = 16;
+	}
+	for (i = 0; i < n; i++) {
+		apcal_f64(cal235(cfg, channels[i]), &volts[i], &codes[i], 1);
+	}
+	write_codes235(cfg, n, channels, codes);
+}
+
+// wromultidn235 is wromulti235 for DNs spanning the channels' ranges
+void wromultidn235(struct cblk235 *cfg, int n, const int *channels, const unsigned short *dns)
+{
+	unsigned short codes[16];
+	int i;
+
+	if (n > 16) {
+		n = 16;
+	}
+	for (i = 0; i < n; i++) {
+		calibrate235_dn(cfg, channels[i], &dns[i], &codes[i], 1);
+	}
+	write_codes235(cfg, n, channels, codes);
+}
+
+// trigger_op235 is the register write of simtrig235, for output_long_group
+APWRITE_OP trigger_op235(struct cblk235 *cfg)
+{
+	APWRITE_OP op = {(long *)&cfg->brd_ptr->SoftwareTrigger, 1, 0};
+	return op;
+}
+
+// chstatus235 reads the status registers of the 16 channels, the fast part
+// of rsts235, into status.  It writes nothing to cfg, so it may run beside
+// the service thread
+void chstatus235(struct cblk235 *cfg, uint32_t *status)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		status[i] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->DAC[i].Status);
+	}
+}
+
+// xadc235 reads the XADC temperature, VCCINT and VCCAUX registers into v:
+// the current values, then the maxima, then the minima
+void xadc235(struct cblk235 *cfg, uint32_t *v)
+{
+	v[0] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_Temperature);
+	v[1] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_VCCInt);
+	v[2] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_VCCAux);
+	v[3] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MAXTemperature);
+	v[4] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MAXVCCInt);
+	v[5] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MAXVCCAux);
+	v[6] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MINTemperature);
+	v[7] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MINVCCInt);
+	v[8] = input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->XW_MINVCCAux);
 }
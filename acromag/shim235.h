@@ -6,6 +6,8 @@ APSTATUS GetAPAddress235(int nhandle, struct mapap235** addr);
 
 unsigned long *Setup_board_corrected_buffer(struct cblk235 *cfg);
 
+int read_calibration235(struct cblk235 *cfg);
+
 void Teardown_board_corrected_buffer(struct cblk235 *cfg, unsigned long *scattermap);
 
 short* MkDataArray(int size);
@@ -14,6 +16,16 @@ void* aligned_malloc(int size, int align);
 
 void aligned_free(void *ptr);
 
+// new_cblk235 allocates a zeroed, cache aligned cblk235; free_cblk235 frees it
+// and its pIdealCode
+struct cblk235 *new_cblk235(void);
+
+void free_cblk235(struct cblk235 *cfg);
+
+short *alloc_pinned235(size_t samples);
+
+void free_pinned235(short *p, size_t samples);
+
 void enable_interrupts(struct cblk235 *cfg);
 
 void start_waveform(struct cblk235 *cfg);
@@ -26,4 +38,40 @@ void refresh_interrupt(struct cblk235 *cfg, unsigned long status);
 
 void do_DMA_transfer(struct cblk235 *cfg, int channel, uint samples, short *p1, short *p2);
 
+int dma_refill235(struct cblk235 *cfg, int channel, const short *buf, uint n, uint cursor, uint samples);
+
 void set_DAC_sample_addresses(struct cblk235 *cfg, int channel);
+
+// partition235 gives the channels in mask even shares of the sample memory as
+// their FIFOs; refill_size235 is half of a channel's share
+void partition235(struct cblk235 *cfg, uint32_t mask);
+
+uint32_t refill_size235(struct cblk235 *cfg, int channel);
+
+void calibrate235(struct cblk235 *cfg, int channel, const double *volts, unsigned short *dn, size_t n);
+
+void calibrate235_f32(struct cblk235 *cfg, int channel, const float *volts, unsigned short *dn, size_t n);
+
+// out235 writes a code to a channel in single mode, outv235 a voltage
+void out235(struct cblk235 *cfg, int channel, unsigned short code);
+
+void outv235(struct cblk235 *cfg, int channel, double volts);
+
+// calibrate235_dn converts DNs spanning the channel's range to codes, outdn235
+// writes one
+void calibrate235_dn(struct cblk235 *cfg, int channel, const unsigned short *dn, unsigned short *code, size_t n);
+
+void outdn235(struct cblk235 *cfg, int channel, unsigned short dn);
+
+// wromulti235 and wromultidn235 write up to 16 channels as one batch
+void wromulti235(struct cblk235 *cfg, int n, const int *channels, const double *volts);
+
+void wromultidn235(struct cblk235 *cfg, int n, const int *channels, const unsigned short *dns);
+
+APWRITE_OP trigger_op235(struct cblk235 *cfg);
+
+// chstatus235 reads the status registers of the 16 channels, xadc235 the 9
+// XADC registers of rsts235, without writing to cfg
+void chstatus235(struct cblk235 *cfg, uint32_t *status);
+
+void xadc235(struct cblk235 *cfg, uint32_t *v);
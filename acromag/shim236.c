@@ -2,12 +2,36 @@
 // within C to avoid making the Go type system angry
 #include "apcommon.h"
 #include "AP236.h"
+#include "aptrace.h"
+#include <stdlib.h>
+#include <string.h>
 
 APSTATUS GetAPAddress236(int nHandle, struct map236** pAddress)
 {
 	return (APSTATUS)GetAPAddress(nHandle, (long*)pAddress);
 }
 
+// new_cblk236 allocates a zeroed cblk236 starting on a cache line
+struct cblk236 *new_cblk236(void)
+{
+	void *p;
+
+	if (posix_memalign(&p, AP_CACHE_LINE, sizeof(struct cblk236)) != 0) {
+		return NULL;
+	}
+	return memset(p, 0, sizeof(struct cblk236));
+}
+
+// free_cblk236 frees a cblk236 of new_cblk236 and its ideal code table
+void free_cblk236(struct cblk236 *c_blk)
+{
+	if (c_blk == NULL) {
+		return;
+	}
+	free(c_blk->pIdealCode);
+	free(c_blk);
+}
+
 
 int Setup_board_cal(struct cblk236* c_block236)
 {
@@ -20,3 +44,93 @@ int Setup_board_cal(struct cblk236* c_block236)
 	rcc236(c_block236); /* read the calibration coef. into an array */
 	return 0;
 }
+
+// write_cor236 writes the corrected codes in cor_buf of channels[i] for i < n
+// as one batch of register writes, with the write delay applied once after the
+// last write instead of after every write; each channel has its own DAC.
+static void write_cor236(struct cblk236 *c_blk, int n, const int *channels)
+{
+	APWRITE_OP ops[8];
+	unsigned short codes[8];
+	uint32_t wdata;
+	int i, ch;
+
+	for (i = 0; i < n; i++) {
+		ch = channels[i];
+		if (c_blk->opts.chan[ch].UpdateMode) { // 1 = simultaneous mode
+			wdata = SMWrite << 16;
+		} else {
+			wdata = TMWrite << 16;
+		}
+		codes[i] = (word)(c_blk->cor_buf[ch] ^ 0x8000); // BTC to straight binary
+		wdata |= codes[i];
+		ops[i].p = (long *)&c_blk->brd_ptr->dac_reg[ch];
+		ops[i].v = (long)wdata;
+		ops[i].uDelay = 0;
+	}
+	if (n > 0) {
+		ops[n - 1].uDelay = 2; // write delay
+	}
+	output_long_batch(c_blk->nHandle, ops, (size_t)n);
+	if (c_blk->trace) {
+		aptrace_codes(c_blk->trace, n, channels, codes);
+	}
+}
+
+// wromulti236 corrects and writes volts[i] to channels[i] for i < n as one
+// batch of register writes.  This is cd236 + wro236 for each channel.
+void wromulti236(struct cblk236 *c_blk, int n, const int *channels, const double *volts)
+{
+	int i;
+
+	if (n > 8) {
+		n = 8;
+	}
+	for (i = 0; i < n; i++) {
+		cd236(c_blk, channels[i], volts[i]);
+	}
+	write_cor236(c_blk, n, channels);
+}
+
+// wromultidn236 is wromulti236 for DNs spanning the nominal output range.
+// DNs are looked up in lut236 if the tables are in use
+void wromultidn236(struct cblk236 *c_blk, int n, const int *channels, const word *dns)
+{
+	const unsigned short *table;
+	double lo, hi;
+	int i, ch, range;
+
+	if (n > 8) {
+		n = 8;
+	}
+	for (i = 0; i < n; i++) {
+		ch = channels[i];
+		table = lut236(c_blk, ch);
+		if (table != NULL) {
+			c_blk->cor_buf[ch] = (short)(table[dns[i]] ^ 0x8000); // cor_buf holds BTC data
+			continue;
+		}
+		range = c_blk->opts.chan[ch].Range & 0x7;
+		lo = (*c_blk->pIdealCode)[range][ENDPOINTLO];
+		hi = (*c_blk->pIdealCode)[range][ENDPOINTHI];
+		cd236(c_blk, ch, lo + (hi - lo) / 65535 * (double)dns[i]);
+	}
+	write_cor236(c_blk, n, channels);
+}
+
+// free_luts236 frees the DN lookup tables
+void free_luts236(struct cblk236 *c_blk)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		apcal_lut_free(&c_blk->lut236[i]);
+	}
+}
+
+// trigger_op236 is the register write of simtrig236, for output_long_group
+APWRITE_OP trigger_op236(struct cblk236 *c_blk)
+{
+	APWRITE_OP op = {(long *)&c_blk->brd_ptr->SimultaneousOutputTrigger, 1, 0};
+	return op;
+}
@@ -3,4 +3,12 @@
 #include "AP236.h"
 #endif
 APSTATUS GetAPAddress236(int nhandle, struct map236** addr);
+// new_cblk236 allocates a zeroed, cache aligned cblk236; free_cblk236 frees it
+// and its pIdealCode
+struct cblk236 *new_cblk236(void);
+void free_cblk236(struct cblk236 *c_blk);
 int Setup_board_cal(struct cblk236* c_block236);
+void wromulti236(struct cblk236 *c_blk, int n, const int *channels, const double *volts);
+void wromultidn236(struct cblk236 *c_blk, int n, const int *channels, const word *dns);
+void free_luts236(struct cblk236 *c_blk);
+APWRITE_OP trigger_op236(struct cblk236 *c_blk);
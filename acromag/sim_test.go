@@ -0,0 +1,971 @@
+package acromag_test
+
+import (
+	"fmt"
+	"io/ioutil"
+	"math"
+	"os"
+	"path/filepath"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/nasa-jpl/golaborate/acromag"
+)
+
+// the simulated boards are opened at device indices past any real board's
+const simIndex = 7
+
+func openSim235(tb testing.TB) *acromag.AP235 {
+	dac, err := acromag.NewAP235WithIO(simIndex, acromag.IOSim)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	return dac
+}
+
+func openSim236(tb testing.TB) *acromag.AP236 {
+	dac, err := acromag.NewAP236WithIO(simIndex, acromag.IOSim)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	return dac
+}
+
+// configure sets up channels for timed playback, fed by the CPU or DMA per
+// mode ("waveform", "waveform-dma"), at period ns
+func configure(tb testing.TB, dac *acromag.AP235, channels int, mode string, period uint32) {
+	dac.BeginConfig()
+	for ch := 0; ch < channels; ch++ {
+		dac.SetRange(ch, "-10,10")
+		dac.SetTriggerMode(ch, "timer")
+		dac.SetOperatingMode(ch, mode)
+	}
+	dac.SetTimerPeriod(period) // may be faster than recommended, which is not an error here
+	if err := dac.CommitConfig(); err != nil {
+		tb.Fatal(err)
+	}
+}
+
+// setupPlayback loads a looping ramp of n samples on each of channels, see
+// configure
+func setupPlayback(tb testing.TB, dac *acromag.AP235, channels int, n int, mode string, period uint32) {
+	configure(tb, dac, channels, mode, period)
+	for ch := 0; ch < channels; ch++ {
+		loadRamp(tb, dac, ch, n)
+	}
+}
+
+// loadRamp loads a looping ramp of n samples on a channel
+func loadRamp(tb testing.TB, dac *acromag.AP235, ch int, n int) {
+	if err := dac.SetWaveformRepeat(ch, 0); err != nil {
+		tb.Fatal(err)
+	}
+	buf, err := dac.WaveformBuffer(ch, n)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	for i := range buf {
+		buf[i] = uint16(i)
+	}
+	if err := dac.CommitWaveformBuffer(ch); err != nil {
+		tb.Fatal(err)
+	}
+}
+
+func TestSimOpen(t *testing.T) {
+	dac := openSim235(t)
+	defer dac.Close()
+	if dac.IOMode() != acromag.IOSim {
+		t.Errorf("expected IOMode %d, got %d", acromag.IOSim, dac.IOMode())
+	}
+	if err := dac.Output(0, 1.5); err != nil {
+		t.Error(err)
+	}
+
+	dac6 := openSim236(t)
+	defer dac6.Close()
+	if err := dac6.Output(0, 1.5); err != nil {
+		t.Error(err)
+	}
+}
+
+func TestSimOpenBoards(t *testing.T) {
+	boards, err := acromag.OpenBoards([]int{simIndex, simIndex, simIndex}, []int{simIndex, simIndex}, acromag.IOSim)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer boards.Close()
+	if len(boards.AP235) != 3 || len(boards.AP236) != 2 {
+		t.Fatalf("opened %d AP235s and %d AP236s, want 3 and 2", len(boards.AP235), len(boards.AP236))
+	}
+	for _, dac := range boards.AP235 {
+		if err := dac.Output(0, 1); err != nil {
+			t.Error(err)
+		}
+	}
+	for _, dac := range boards.AP236 {
+		if err := dac.Output(0, 1); err != nil {
+			t.Error(err)
+		}
+	}
+}
+
+func TestSimPlayback(t *testing.T) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			// at 1 us per sample the 16384 sample half FIFO of each of the two
+			// channels is refilled every 17 ms
+			setupPlayback(t, dac, 2, 10000, mode, 1024)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			time.Sleep(150 * time.Millisecond)
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			stats := dac.Stats()
+			if stats.Interrupts == 0 || stats.Samples == 0 {
+				t.Errorf("no refills during playback: %+v", stats)
+			}
+			if stats.Underflows != 0 {
+				t.Errorf("%d underflows at a rate the service thread should sustain", stats.Underflows)
+			}
+		})
+	}
+}
+
+// loadOneShot loads a waveform of n samples on a channel, played once
+func loadOneShot(tb testing.TB, dac *acromag.AP235, ch int, n int) {
+	if err := dac.SetWaveformRepeat(ch, 1); err != nil {
+		tb.Fatal(err)
+	}
+	if _, err := dac.WaveformBuffer(ch, n); err != nil {
+		tb.Fatal(err)
+	}
+	if err := dac.CommitWaveformBuffer(ch); err != nil {
+		tb.Fatal(err)
+	}
+}
+
+func TestSimOddWaveform(t *testing.T) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			// at a second per sample the FIFO does not drain during the test
+			configure(t, dac, 1, mode, 1e9)
+			loadOneShot(t, dac, 0, 1)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			if dac.Status(0).FIFOEmpty {
+				t.Error("the sample of a 1 sample waveform was not sent")
+			}
+			depth := dac.FIFODepth(0)
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+
+			// half the FIFO is sent at the start, the odd rest at the
+			// interrupt; the last sample is sent twice
+			loadOneShot(t, dac, 0, depth-1)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			deadline := time.Now().Add(time.Second)
+			for dac.Stats().Samples < uint64(depth-1-depth/2) {
+				if time.Now().After(deadline) {
+					t.Fatalf("the rest of the waveform was not sent within a second: %+v", dac.Stats())
+				}
+				time.Sleep(100 * time.Microsecond)
+			}
+			if !dac.Status(0).FIFOFull {
+				t.Error("the last sample of an odd waveform was not sent")
+			}
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+		})
+	}
+}
+
+func TestSimOneShotEnd(t *testing.T) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			// 1000 samples at 1 us each, played out within a few ms
+			configure(t, dac, 1, mode, 1024)
+			loadOneShot(t, dac, 0, 1000)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			time.Sleep(50 * time.Millisecond)
+			before := dac.Stats().Interrupts
+			time.Sleep(50 * time.Millisecond)
+			if after := dac.Stats().Interrupts; after != before {
+				t.Errorf("%d interrupts after the waveform finished", after-before)
+			}
+
+			// a swap after the end plays at once
+			buf, err := dac.StageWaveform(0, 1000)
+			if err != nil {
+				t.Fatal(err)
+			}
+			for i := range buf {
+				buf[i] = uint16(i)
+			}
+			if err := dac.SwapWaveform(0); err != nil {
+				t.Fatal(err)
+			}
+			waitSwap(t, dac, 0)
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+		})
+	}
+}
+
+func TestSimGenerator(t *testing.T) {
+	sine := acromag.Generator{Shape: "sine", Amplitude: 5, Frequency: 0.1}
+	chirp := acromag.Generator{Shape: "chirp", Amplitude: 2, Frequency: 10, StopFrequency: 1000, SweepTime: 1}
+	tones := acromag.Generator{Shape: "tones", Offset: 1, Tones: []acromag.Tone{{1, 50, 0}, {0.5, 150, 1}}}
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			configure(t, dac, 3, mode, 1024)
+			if err := dac.SetGenerator(0, sine); err != nil {
+				t.Fatal(err)
+			}
+			if err := dac.SetGenerator(1, chirp); err != nil {
+				t.Fatal(err)
+			}
+			loadRamp(t, dac, 2, 10000)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			time.Sleep(50 * time.Millisecond)
+			if err := dac.SetGenerator(0, tones); err != nil {
+				t.Error(err)
+			}
+			if err := dac.SetGenerator(2, tones); err == nil {
+				t.Error("expected an error switching a buffer channel to a generator during playback")
+			}
+			time.Sleep(50 * time.Millisecond)
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			if stats := dac.Stats(); stats.Samples == 0 || stats.Underflows != 0 {
+				t.Errorf("expected refills without underflows, got %+v", stats)
+			}
+		})
+	}
+	dac := openSim235(t)
+	defer dac.Close()
+	for _, g := range []acromag.Generator{
+		{Shape: "square"},
+		{Shape: "chirp", Frequency: 1, StopFrequency: 2},
+		{Shape: "tones"},
+		{Shape: "sine", Frequency: -1},
+	} {
+		if err := dac.SetGenerator(0, g); err == nil {
+			t.Errorf("expected an error for %+v", g)
+		}
+	}
+}
+
+func TestSimSchedule(t *testing.T) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			configure(t, dac, 2, mode, 1024)
+			var outputs []acromag.ScheduledOutput
+			for i := 0; i < 100; i++ {
+				outputs = append(outputs, acromag.ScheduledOutput{
+					At:       time.Duration(i) * time.Millisecond,
+					Channels: []int{i % 2, 1},
+					Voltages: []float64{float64(i) / 10, -float64(i) / 10},
+				})
+			}
+			if err := dac.ScheduleOutputs(outputs); err != nil {
+				t.Fatal(err)
+			}
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			if _, err := dac.StageWaveform(0, 100); err == nil {
+				t.Error("expected an error staging a waveform on a scheduled channel")
+			}
+			time.Sleep(100 * time.Millisecond)
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			if stats := dac.Stats(); stats.Samples == 0 || stats.Underflows != 0 {
+				t.Errorf("expected refills without underflows, got %+v", stats)
+			}
+		})
+	}
+	dac := openSim235(t)
+	defer dac.Close()
+	if err := dac.ScheduleOutputs([]acromag.ScheduledOutput{{Channels: []int{0}, Voltages: []float64{0}}}); err == nil {
+		t.Error("expected an error scheduling without a timer period")
+	}
+	dac.SetTimerPeriod(1024)
+	if err := dac.ScheduleOutputs([]acromag.ScheduledOutput{{Channels: []int{0}}}); err == nil {
+		t.Error("expected an error for an update without voltages")
+	}
+	if err := dac.ScheduleOutputs([]acromag.ScheduledOutput{{At: -1, Channels: []int{0}, Voltages: []float64{0}}}); err == nil {
+		t.Error("expected an error for an update before the start")
+	}
+	if err := dac.ScheduleOutputs([]acromag.ScheduledOutput{{Channels: []int{16}, Voltages: []float64{0}}}); err == nil {
+		t.Error("expected an error for a channel past the board's")
+	}
+	// channel 1 has the software trigger, so channel 0 must not be armed either
+	dac.SetTriggerMode(0, "timer")
+	outputs := []acromag.ScheduledOutput{{Channels: []int{0, 1}, Voltages: []float64{1, 1}}}
+	if err := dac.ScheduleOutputs(outputs); err == nil {
+		t.Error("expected an error for a channel with the software trigger")
+	}
+	if mode, _ := dac.GetOperatingMode(0); mode != "single" {
+		t.Errorf("a failed schedule left channel 0 in %s mode", mode)
+	}
+}
+
+func TestSimTelemetry(t *testing.T) {
+	dac := openSim235(t)
+	defer dac.Close()
+	before := dac.Stats().RegisterAccesses
+	dac.Status(3)
+	if n := dac.Stats().RegisterAccesses - before; n != 16 {
+		t.Errorf("Status without the sampler made %d register accesses, want 16", n)
+	}
+	if r := dac.Stats().RegisterRate; r != 0 {
+		t.Errorf("register rate %v without the sampler, want 0", r)
+	}
+	if _, err := dac.Telemetry(); err == nil {
+		t.Error("expected an error for telemetry without the sampler")
+	}
+	if err := dac.StartSampler(time.Millisecond, 0); err == nil {
+		t.Error("expected an error for an XADC period shorter than the status period")
+	}
+	if err := dac.StartSampler(time.Millisecond, 5*time.Millisecond); err != nil {
+		t.Fatal(err)
+	}
+	if err := dac.StartSampler(time.Millisecond, 5*time.Millisecond); err == nil {
+		t.Error("expected an error starting the sampler twice")
+	}
+	first, err := dac.Telemetry()
+	if err != nil {
+		t.Fatal(err)
+	}
+	time.Sleep(20 * time.Millisecond)
+	last, err := dac.Telemetry()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !last.Time.After(first.Time) || !last.XADCTime.After(first.XADCTime) {
+		t.Errorf("samples were not refreshed: first %v %v, last %v %v", first.Time, first.XADCTime, last.Time, last.XADCTime)
+	}
+	// the sampler reads the 16 status registers every period itself
+	if last.RegisterRate <= 0 || math.IsInf(last.RegisterRate, 0) || last.RegisterAccesses <= first.RegisterAccesses {
+		t.Errorf("unexpected register rate %v after %d accesses", last.RegisterRate, last.RegisterAccesses)
+	}
+	if r := dac.Stats().RegisterRate; r <= 0 || math.IsInf(r, 0) || math.IsNaN(r) {
+		t.Errorf("Stats register rate %v with the sampler running", r)
+	}
+	if st := dac.StatusAll(); st[3].Channel != 3 || dac.Status(3).Channel != 3 {
+		t.Errorf("unexpected status %+v", st[3])
+	}
+	dac.StopSampler()
+	if _, err := dac.Telemetry(); err == nil {
+		t.Error("expected an error for telemetry after StopSampler")
+	}
+}
+
+func TestSimTrace(t *testing.T) {
+	dir, err := ioutil.TempDir("", "aptrace")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "trace")
+	tracer, err := acromag.NewTracer(path, 1<<16, time.Millisecond)
+	if err != nil {
+		t.Fatal(err)
+	}
+	dac := openSim235(t)
+	defer dac.Close()
+	dac6 := openSim236(t)
+	defer dac6.Close()
+	if err := dac.SetTracer(tracer, 5); err != nil {
+		t.Fatal(err)
+	}
+	if err := dac6.SetTracer(tracer, 6); err != nil {
+		t.Fatal(err)
+	}
+	setupPlayback(t, dac, 1, 10000, "waveform-dma", 1024)
+	dac.OutputMultiDN16([]int{3, 2}, []uint16{7, 9})
+	dac6.OutputDN16(4, 0x8000)
+	if err := dac.StartWaveform(); err != nil {
+		t.Fatal(err)
+	}
+	time.Sleep(60 * time.Millisecond)
+	if err := dac.StopWaveform(); err != nil {
+		t.Fatal(err)
+	}
+	dac.SetTracer(nil, 0)
+	dac6.SetTracer(nil, 0)
+	if err := tracer.Close(); err != nil {
+		t.Fatal(err)
+	}
+
+	tf, err := acromag.ReadTrace(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tf.Close()
+	if tf.Dropped != 0 || len(tf.Records[0]) != 0 || uint64(len(tf.Records[1])) != tf.Written {
+		t.Fatalf("unexpected trace of %d records, %d dropped", tf.Written, tf.Dropped)
+	}
+	kinds := map[[2]int]int{}
+	for _, r := range tf.Records[1] {
+		kinds[[2]int{int(r.Board), int(r.Kind)}]++
+		switch {
+		case r.Board == 5 && r.Kind == acromag.TraceOutput && r.N == 2:
+			if r.Mask != 0xC {
+				t.Errorf("output of channels 3 and 2 recorded with mask %#x", r.Mask)
+			}
+		case r.Board == 5 && r.Kind == acromag.TraceRefill:
+			if r.Mask != 1 || r.Count == 0 {
+				t.Errorf("unexpected refill %+v", r)
+			}
+		case r.Board == 6 && r.Kind == acromag.TraceOutput:
+			if r.Mask != 1<<4 || r.N != 1 {
+				t.Errorf("unexpected AP236 output %+v", r)
+			}
+		}
+	}
+	for _, k := range [][2]int{{5, acromag.TraceOutput}, {5, acromag.TraceConfig}, {5, acromag.TraceRefill},
+		{5, acromag.TraceInterrupt}, {6, acromag.TraceOutput}} {
+		if kinds[k] == 0 {
+			t.Errorf("no records of kind %d of board %d in %v", k[1], k[0], kinds)
+		}
+	}
+}
+
+func TestSimTraceDrops(t *testing.T) {
+	dir, err := ioutil.TempDir("", "aptrace")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "trace")
+	tracer, err := acromag.NewTracer(path, 2*acromag.TraceRing, time.Hour)
+	if err != nil {
+		t.Fatal(err)
+	}
+	dac := openSim236(t)
+	defer dac.Close()
+	if err := dac.SetTracer(tracer, 6); err != nil {
+		t.Fatal(err)
+	}
+	// the ring is not flushed before it fills, so the last 10 are dropped
+	const dropped = 10
+	for i := 0; i < acromag.TraceRing+dropped; i++ {
+		dac.OutputDN16(0, uint16(i))
+	}
+	tracer.Flush()
+	dac.OutputDN16(0, 1)
+	dac.SetTracer(nil, 0)
+	if err := tracer.Close(); err != nil {
+		t.Fatal(err)
+	}
+
+	tf, err := acromag.ReadTrace(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tf.Close()
+	recs := tf.Records[1]
+	if tf.Dropped != dropped || len(recs) != acromag.TraceRing+1 {
+		t.Fatalf("trace of %d records, %d dropped, want %d and %d", len(recs), tf.Dropped, acromag.TraceRing+1, dropped)
+	}
+	for i, r := range recs[:acromag.TraceRing] {
+		if r.Seq != uint64(i) {
+			t.Fatalf("record %d has sequence %d", i, r.Seq)
+		}
+	}
+	if last := recs[acromag.TraceRing].Seq; last != acromag.TraceRing+dropped {
+		t.Errorf("record after the drops has sequence %d, want %d", last, acromag.TraceRing+dropped)
+	}
+}
+
+// waitSwap waits for the swap of a channel to be taken
+func waitSwap(tb testing.TB, dac *acromag.AP235, ch int) {
+	deadline := time.Now().Add(time.Second)
+	for dac.SwapPending(ch) {
+		if time.Now().After(deadline) {
+			tb.Fatal("swap not taken within a second")
+		}
+		time.Sleep(100 * time.Microsecond)
+	}
+}
+
+func TestSimSwap(t *testing.T) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		t.Run(mode, func(t *testing.T) {
+			dac := openSim235(t)
+			defer dac.Close()
+			if _, err := dac.StageWaveform(0, 100); err == nil {
+				t.Error("expected an error staging a waveform while stopped")
+			}
+			setupPlayback(t, dac, 2, 10000, mode, 1024)
+			if err := dac.StartWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			for i, n := range []int{6001, 20000, 3000} {
+				buf, err := dac.StageWaveform(0, n)
+				if err != nil {
+					t.Fatal(err)
+				}
+				for j := range buf {
+					buf[j] = uint16(j * i)
+				}
+				if err := dac.SwapWaveform(0); err != nil {
+					t.Fatal(err)
+				}
+				if _, err := dac.StageWaveform(0, n); err != acromag.ErrSwapPending && dac.SwapPending(0) {
+					t.Errorf("expected ErrSwapPending staging over a pending swap, got %v", err)
+				}
+				waitSwap(t, dac, 0)
+			}
+			if err := dac.SwapWaveform(0); err == nil {
+				t.Error("expected an error swapping without a staged waveform")
+			}
+			if err := dac.StopWaveform(); err != nil {
+				t.Fatal(err)
+			}
+			if stats := dac.Stats(); stats.Swaps != 3 || stats.Underflows != 0 {
+				t.Errorf("expected 3 swaps without underflows, got %+v", stats)
+			}
+		})
+	}
+}
+
+// cd235 is the conversion of Acromag's cd235 for one sample: half away from
+// zero, NaN clipping high, two's complement code to straight binary
+func cd235(gain, offset, cliplo, cliphi, v float64) uint16 {
+	f := float64(gain*v) + offset // no fused multiply-add, as in C
+	if f < 0 {
+		f -= 0.5
+	} else {
+		f += 0.5
+	}
+	if !(f <= cliphi) {
+		f = cliphi
+	}
+	if f < cliplo {
+		f = cliplo
+	}
+	return uint16(int16(f)) ^ 0x8000
+}
+
+// calibrationInputs returns volts for a channel spanning past its range, with
+// NaN, infinities and voltages whose codes are exactly halfway between two
+func calibrationInputs(gain, offset float64) (volts []float64, ties int) {
+	volts = []float64{math.NaN(), math.Inf(1), math.Inf(-1), 1e9, -1e9, 0, math.Copysign(0, -1)}
+	for i := 0; i < 2000; i++ {
+		volts = append(volts, -25+50*float64(i)/1999)
+	}
+	for k := -32767.5; k < 32767; k += 257 {
+		v := (k - offset) / gain
+		for j := 0; j < 64 && float64(gain*v)+offset != k; j++ {
+			if float64(gain*v)+offset < k {
+				v = math.Nextafter(v, math.Inf(1))
+			} else {
+				v = math.Nextafter(v, math.Inf(-1))
+			}
+		}
+		if float64(gain*v)+offset == k {
+			volts = append(volts, v, math.NaN())
+			ties++
+		}
+	}
+	return volts, ties
+}
+
+func TestSimCalibrateKernels(t *testing.T) {
+	dac := openSim235(t)
+	defer dac.Close()
+	defer acromag.CalibrationKernel(-1)
+	if err := dac.SetRange(1, "0,10"); err != nil {
+		t.Fatal(err)
+	}
+	for level, name := range []string{"scalar", "sse4.1", "avx2"} {
+		t.Run(name, func(t *testing.T) {
+			if acromag.CalibrationKernel(level) != level {
+				t.Skipf("the CPU has no %s", name)
+			}
+			for ch := 0; ch < 2; ch++ {
+				gain, offset, lo, hi := acromag.CalibrationRecord(dac, ch)
+				volts, ties := calibrationInputs(gain, offset)
+				if ties == 0 {
+					t.Fatalf("channel %d: no voltages land halfway between codes", ch)
+				}
+				f32 := make([]float32, len(volts))
+				for i, v := range volts {
+					f32[i] = float32(v)
+				}
+				dn := make([]uint16, len(volts))
+				// every alignment of the SIMD blocks to the samples
+				for skip := 0; skip < 8; skip++ {
+					dac.CalibrateFloat64(ch, volts[skip:], dn)
+					for i, v := range volts[skip:] {
+						if want := cd235(gain, offset, lo, hi, v); dn[i] != want {
+							t.Fatalf("channel %d: %v V is %#04x, cd235 makes %#04x", ch, v, dn[i], want)
+						}
+					}
+					dac.CalibrateFloat32(ch, f32[skip:], dn)
+					for i, v := range f32[skip:] {
+						if want := cd235(gain, offset, lo, hi, float64(v)); dn[i] != want {
+							t.Fatalf("channel %d: %v V (float32) is %#04x, cd235 makes %#04x", ch, v, dn[i], want)
+						}
+					}
+				}
+			}
+		})
+	}
+}
+
+func TestSimCalibrateBounds(t *testing.T) {
+	dac := openSim235(t)
+	defer dac.Close()
+	volts, dn := make([]float64, 4), make([]uint16, 4)
+	for _, c := range []struct {
+		name string
+		call func()
+	}{
+		{"short float64 output", func() { dac.CalibrateFloat64(0, volts, dn[:3]) }},
+		{"short float32 output", func() { dac.CalibrateFloat32(0, make([]float32, 4), dn[:3]) }},
+		{"short DN output", func() { dac.CalibrateDN16(0, dn, dn[:3]) }},
+		{"channel -1", func() { dac.CalibrateFloat64(-1, volts, dn) }},
+		{"channel 16", func() { dac.CalibrateDN16(16, dn, dn) }},
+	} {
+		func() {
+			defer func() {
+				if recover() == nil {
+					t.Errorf("%s did not panic", c.name)
+				}
+			}()
+			c.call()
+		}()
+	}
+	dac.CalibrateFloat64(15, volts, dn[:4]) // an output of just the length is enough
+}
+
+func BenchmarkCalibrateFloat64(b *testing.B) {
+	dac := openSim235(b)
+	defer dac.Close()
+	volts := make([]float64, acromag.MAXSAMPLES)
+	dn := make([]uint16, acromag.MAXSAMPLES)
+	for i := range volts {
+		volts[i] = float64(i%200)/10 - 10
+	}
+	b.SetBytes(int64(len(volts) * 8))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		dac.CalibrateFloat64(0, volts, dn)
+	}
+}
+
+func BenchmarkCalibrateDN16(b *testing.B) {
+	for _, lut := range []bool{false, true} {
+		b.Run(fmt.Sprintf("lut=%v", lut), func(b *testing.B) {
+			dac := openSim235(b)
+			defer dac.Close()
+			if err := dac.SetDNTable(lut); err != nil {
+				b.Fatal(err)
+			}
+			dn := make([]uint16, acromag.MAXSAMPLES)
+			codes := make([]uint16, acromag.MAXSAMPLES)
+			for i := range dn {
+				dn[i] = uint16(i * 16)
+			}
+			b.SetBytes(int64(len(dn) * 2))
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				dac.CalibrateDN16(0, dn, codes)
+			}
+		})
+	}
+}
+
+// BenchmarkFIFOFeed is the cost per sample of sending a channel's first half
+// FIFO, 32768 samples, by CPU writes or DMA
+func BenchmarkFIFOFeed(b *testing.B) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		b.Run(mode, func(b *testing.B) {
+			dac := openSim235(b)
+			defer dac.Close()
+			// the timer is slow enough that the thread has nothing to refill
+			setupPlayback(b, dac, 1, acromag.MAXSAMPLES, mode, 1<<30)
+			half := dac.FIFODepth(0) / 2
+			b.ResetTimer()
+			start := time.Now()
+			for i := 0; i < b.N; i++ {
+				dac.StartWaveform()
+				dac.StopWaveform()
+			}
+			b.ReportMetric(float64(time.Since(start).Nanoseconds())/float64(b.N*half), "ns/sample")
+		})
+	}
+}
+
+// BenchmarkCommitConfig is the latency of reconfiguring all channels as one
+// transaction, alternating between two configurations so every commit has
+// changes to write
+func BenchmarkCommitConfig(b *testing.B) {
+	dac := openSim235(b)
+	defer dac.Close()
+	ranges := []string{"-10,10", "0,10"}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		dac.BeginConfig()
+		for ch := 0; ch < 16; ch++ {
+			dac.SetRange(ch, ranges[i%2])
+			dac.SetOverRange(ch, i%2 == 0)
+		}
+		if err := dac.CommitConfig(); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// BenchmarkOutput is the cost of a single sample written directly, with the
+// 2 us write delay spun rather than slept
+func BenchmarkOutput(b *testing.B) {
+	dac := openSim235(b)
+	defer dac.Close()
+	if err := dac.SetWriteDelayMode(acromag.DelaySpin); err != nil {
+		b.Fatal(err)
+	}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		dac.Output(i&15, 1.25)
+	}
+}
+
+// BenchmarkSustainedPlayback plays looping waveforms on a number of channels
+// with a timer faster than the service thread can keep up with, so the rate
+// reached is the rate the thread sustains.  An op is one sample sent after
+// the first half FIFOs.  DMA transfers take no time in the simulation, so
+// with DMA the rate is that of the timer, one sample per 32 ns per channel
+func BenchmarkSustainedPlayback(b *testing.B) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		for _, channels := range []int{1, 2, 4, 8, 16} {
+			b.Run(fmt.Sprintf("%s/channels=%d", mode, channels), func(b *testing.B) {
+				dac := openSim235(b)
+				defer dac.Close()
+				setupPlayback(b, dac, channels, acromag.MAXSAMPLES, mode, 32)
+				if err := dac.StartWaveform(); err != nil {
+					b.Fatal(err)
+				}
+				b.ResetTimer()
+				start := time.Now()
+				first := dac.Stats().Samples
+				for dac.Stats().Samples-first < uint64(b.N) {
+					time.Sleep(100 * time.Microsecond)
+				}
+				sent := dac.Stats().Samples - first
+				elapsed := time.Since(start).Seconds()
+				b.StopTimer()
+				dac.StopWaveform() // the underflows make this an error
+				b.ReportMetric(float64(sent)/elapsed, "samples/s")
+				b.ReportMetric(float64(sent)/elapsed/float64(channels), "samples/s/channel")
+			})
+		}
+	}
+}
+
+// BenchmarkGenerator is BenchmarkSustainedPlayback with every channel
+// synthesizing a sum of tones, the costliest shape per sample
+func BenchmarkGenerator(b *testing.B) {
+	gen := acromag.Generator{Shape: "tones", Tones: []acromag.Tone{{1, 1e3, 0}, {1, 3e3, 0}, {1, 5e3, 0}, {1, 7e3, 0}}}
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		for _, channels := range []int{1, 16} {
+			b.Run(fmt.Sprintf("%s/channels=%d", mode, channels), func(b *testing.B) {
+				dac := openSim235(b)
+				defer dac.Close()
+				configure(b, dac, channels, mode, 32)
+				for ch := 0; ch < channels; ch++ {
+					if err := dac.SetGenerator(ch, gen); err != nil {
+						b.Fatal(err)
+					}
+				}
+				if err := dac.StartWaveform(); err != nil {
+					b.Fatal(err)
+				}
+				b.ResetTimer()
+				start := time.Now()
+				first := dac.Stats().Samples
+				for dac.Stats().Samples-first < uint64(b.N) {
+					time.Sleep(100 * time.Microsecond)
+				}
+				sent := dac.Stats().Samples - first
+				elapsed := time.Since(start).Seconds()
+				b.StopTimer()
+				dac.StopWaveform()
+				b.ReportMetric(float64(sent)/elapsed, "samples/s")
+			})
+		}
+	}
+}
+
+// BenchmarkSwapWaveform is the time from SwapWaveform to the swap being
+// taken, for a 4096 sample waveform played at 1 us per sample.  The thread
+// takes a swap at the first refill that reaches the end of a period, so this
+// is at most one refill period, 32768 samples or 33 ms here
+func BenchmarkSwapWaveform(b *testing.B) {
+	for _, mode := range []string{"waveform", "waveform-dma"} {
+		b.Run(mode, func(b *testing.B) {
+			dac := openSim235(b)
+			defer dac.Close()
+			setupPlayback(b, dac, 1, 4096, mode, 1024)
+			if err := dac.StartWaveform(); err != nil {
+				b.Fatal(err)
+			}
+			defer dac.StopWaveform()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				buf, err := dac.StageWaveform(0, 4096)
+				if err != nil {
+					b.Fatal(err)
+				}
+				for j := range buf {
+					buf[j] = uint16(j + i)
+				}
+				if err := dac.SwapWaveform(0); err != nil {
+					b.Fatal(err)
+				}
+				for dac.SwapPending(0) {
+					time.Sleep(10 * time.Microsecond)
+				}
+			}
+		})
+	}
+}
+
+// openGroup opens an AP235 and two AP236s as a 32 channel group, all in
+// simultaneous output mode
+func openGroup(tb testing.TB) (*acromag.BoardGroup, func()) {
+	dac5 := openSim235(tb)
+	dac6a, dac6b := openSim236(tb), openSim236(tb)
+	for ch := 0; ch < 16; ch++ {
+		dac5.SetTriggerMode(ch, "software")
+		dac5.SetOutputSimultaneous(ch, true)
+	}
+	for ch := 0; ch < 8; ch++ {
+		dac6a.SetOutputSimultaneous(ch, true)
+		dac6b.SetOutputSimultaneous(ch, true)
+	}
+	g, err := acromag.NewBoardGroup(dac5, dac6a, dac6b)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	return g, func() {
+		dac5.Close()
+		dac6a.Close()
+		dac6b.Close()
+	}
+}
+
+func TestSimGroup(t *testing.T) {
+	g, done := openGroup(t)
+	defer done()
+	if g.Channels() != 32 {
+		t.Fatalf("expected 32 channels, got %d", g.Channels())
+	}
+	if err := g.OutputMulti([]int{0, 15, 16, 31}, []float64{1, 2, 3, 4}); err != nil {
+		t.Fatal(err)
+	}
+	stats := g.Stats()
+	if stats.Updates != 1 || len(stats.TriggerOffsetsNs) != 3 {
+		t.Errorf("expected one update triggering three boards, got %+v", stats)
+	}
+	if err := g.OutputDN16(20, 1000); err != nil {
+		t.Fatal(err)
+	}
+	if stats = g.Stats(); len(stats.TriggerOffsetsNs) != 1 || stats.SkewNs != 0 {
+		t.Errorf("expected an update of one board without skew, got %+v", stats)
+	}
+	if err := g.Output(32, 0); err == nil {
+		t.Error("expected an error for a channel past the group")
+	}
+}
+
+func TestSimGroupConcurrent(t *testing.T) {
+	dac5, dac6 := openSim235(t), openSim236(t)
+	defer dac5.Close()
+	defer dac6.Close()
+	for ch := 0; ch < 8; ch++ {
+		dac5.SetTriggerMode(ch, "software")
+		dac5.SetOutputSimultaneous(ch, true)
+		dac6.SetOutputSimultaneous(ch, true)
+	}
+	g, err := acromag.NewBoardGroup(dac5, dac6)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// the members written to on their own while the group updates them
+	// wait for the group's trigger rather than interleave with it
+	var wg sync.WaitGroup
+	errs := make(chan error, 3)
+	for _, f := range []func() error{
+		func() error { return g.OutputMultiDN16([]int{0, 16}, []uint16{1, 2}) },
+		func() error { return dac5.OutputMultiDN16([]int{0, 1}, []uint16{3, 4}) },
+		func() error { return dac6.OutputMulti([]int{0}, []float64{1}) },
+	} {
+		wg.Add(1)
+		go func(f func() error) {
+			defer wg.Done()
+			for i := 0; i < 1000; i++ {
+				if err := f(); err != nil {
+					errs <- err
+					return
+				}
+			}
+		}(f)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Error(err)
+	}
+	if n := g.Stats().Updates; n != 1000 {
+		t.Errorf("%d group updates, want 1000", n)
+	}
+}
+
+// BenchmarkGroupOutput updates all channels of a three board group
+func BenchmarkGroupOutput(b *testing.B) {
+	g, done := openGroup(b)
+	defer done()
+	channels := make([]int, g.Channels())
+	volts := make([]float64, g.Channels())
+	for i := range channels {
+		channels[i] = i
+		volts[i] = float64(i) / 4
+	}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := g.OutputMulti(channels, volts); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.ReportMetric(float64(g.Stats().MaxSkewNs), "max-skew-ns")
+}
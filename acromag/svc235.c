@@ -0,0 +1,760 @@
+// svc235 contains the waveform service thread of the AP235
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "apcommon.h"
+#include "AP235.h"
+#include "shim235.h"
+#include "svc235.h"
+#include "aptrace.h"
+
+#define SVC_RING 64   // events, a power of two
+#define SVC_BATCH 256 // register writes per output_long_batch_ap call
+#define SVC_STACK_PREFAULT (64 * 1024) // bytes of stack touched before servicing
+
+// svcring is a single producer (the thread), single consumer (Go) ring
+struct svcring
+{
+	atomic_uint head; // next slot to write, owned by the producer
+	atomic_uint tail; // next slot to read, owned by the consumer
+	struct svcevent ev[SVC_RING];
+};
+
+// svcwave is the playback state of one channel, owned by the thread
+// while it runs
+struct svcwave
+{
+	short *buf;
+	size_t n;
+	size_t cursor; // index into buf of the next sample to send
+	size_t left;   // samples left to send, unless loop
+	int loop;      // repeat until stopped
+	int source;    // SVC_BUFFER, or what buf, the channel's refill buffer, is synthesized from
+	int fresh;     // nothing of buf was sent yet
+};
+
+// sources of a channel's samples
+#define SVC_BUFFER 0    // its waveform
+#define SVC_GENERATOR 1 // its svcgen
+#define SVC_SCHEDULE 2  // its svcsched
+
+// svcswap is a waveform handed to the thread by svc235_swap to replace a
+// channel's at the end of its current period
+struct svcswap
+{
+	short *buf;
+	size_t n;
+	unsigned repeat;
+	atomic_int posted; // set by the control API once the above are written, cleared by the thread once it took them
+};
+
+// svcgen is the generator of a channel whose samples are synthesized into
+// a buffer of one refill just before it is sent.  svc235_switch publishes
+// next under a sequence lock; the thread takes it at the start of a refill
+struct svcgen
+{
+	APGENSTATE state; // owned by the thread while it runs
+	APGEN next;       // written by the control API
+	atomic_uint seq;  // odd while next is being written
+	unsigned taken;   // seq of the last next taken, owned by the thread
+	short *buf;       // pinned refill buffer, also of a svcsched
+	size_t size;      // samples of buf
+};
+
+// svcsched is the schedule of a channel whose samples are expanded from its
+// steps into the svcgen's buffer just before they are sent
+struct svcsched
+{
+	const struct svcstep *step;
+	size_t n;
+	size_t next;          // index of the next step to take effect
+	unsigned long long k; // tick of the next sample
+	short hold;           // code until the next step
+};
+
+// svccounters is svcstats as the thread keeps it; it is the only writer
+struct svccounters
+{
+	atomic_ullong interrupts, samples, underflows, dma_timeouts, errors, swaps;
+	atomic_ullong latency[SVC_HIST], duration[SVC_HIST], batch[SVC_HIST];
+};
+
+struct svc235
+{
+	struct cblk235 *cfg;
+	pthread_t thread;
+	int running;	  // touched by the control API only
+	atomic_int stop;  // set by the control API, read by the thread
+	atomic_uint lost; // events dropped because the ring was full
+	struct svcring events;
+	struct svcwave wave[16];
+	struct svcgen gen[16];
+	struct svcsched sched[16];
+	struct svcswap swap[16];
+	struct svccounters stats;
+	struct timespec woke; // when fetch_status last returned, owned by the thread
+	uint32_t underflowed; // channels last seen underflowed, owned by the thread
+	atomic_uint idle;     // channels whose interrupt the thread left off, written by the thread
+	struct aptrace *trace; // refills and interrupts are recorded in, NULL when not tracing
+};
+
+// bump adds d to a counter only the thread writes, without a locked add
+static void bump(atomic_ullong *c, unsigned long long d)
+{
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + d, memory_order_relaxed);
+}
+
+// record counts v in its histogram bucket
+static void record(atomic_ullong *hist, unsigned long long v)
+{
+	int i = v ? 63 - __builtin_clzll(v) : 0;
+	bump(&hist[i < SVC_HIST ? i : SVC_HIST - 1], 1);
+}
+
+static unsigned long long since(const struct timespec *t0, const struct timespec *t1)
+{
+	return (unsigned long long)((t1->tv_sec - t0->tv_sec) * 1000000000LL + (t1->tv_nsec - t0->tv_nsec));
+}
+
+static int push(struct svcring *r, struct svcevent ev)
+{
+	unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (head - tail == SVC_RING) {
+		return 0;
+	}
+	r->ev[head & (SVC_RING - 1)] = ev;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+	return 1;
+}
+
+static int pop(struct svcring *r, struct svcevent *ev)
+{
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+	if (head == tail) {
+		return 0;
+	}
+	*ev = r->ev[tail & (SVC_RING - 1)];
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+struct svc235 *svc235_new(struct cblk235 *cfg)
+{
+	struct svc235 *svc = calloc(1, sizeof(struct svc235));
+	if (svc == NULL) {
+		return NULL;
+	}
+	svc->cfg = cfg;
+	return svc;
+}
+
+void svc235_free(struct svc235 *svc)
+{
+	int i;
+
+	if (svc->running) {
+		svc235_stop(svc);
+	}
+	for (i = 0; i < 16; i++) {
+		if (svc->gen[i].buf != NULL) {
+			free_pinned235(svc->gen[i].buf, svc->gen[i].size);
+		}
+	}
+	free(svc);
+}
+
+// install makes buf the waveform of a channel, from its start
+static void install(struct svc235 *svc, int channel, short *buf, size_t n, unsigned repeat)
+{
+	struct cblk235 *cfg = svc->cfg;
+	struct svcwave *w = &svc->wave[channel];
+
+	w->buf = buf;
+	w->n = n;
+	w->cursor = 0;
+	w->loop = repeat == 0;
+	w->left = n * repeat;
+	w->source = SVC_BUFFER;
+	w->fresh = 1;
+
+	// fifowro235 wraps current_ptr from tail_ptr back to head_ptr
+	cfg->head_ptr[channel] = buf;
+	cfg->tail_ptr[channel] = buf + n;
+	cfg->current_ptr[channel] = buf;
+}
+
+void svc235_load(struct svc235 *svc, int channel, short *buf, size_t n, unsigned repeat)
+{
+	atomic_store(&svc->swap[channel].posted, 0); // a swap not taken before the stop is dropped
+	install(svc, channel, buf, n, repeat);
+}
+
+int svc235_swap(struct svc235 *svc, int channel, short *buf, size_t n, unsigned repeat)
+{
+	struct svcswap *p = &svc->swap[channel];
+
+	if (atomic_load_explicit(&p->posted, memory_order_acquire)) {
+		return 0;
+	}
+	p->buf = buf;
+	p->n = n;
+	p->repeat = repeat;
+	atomic_store_explicit(&p->posted, 1, memory_order_release);
+	// a channel that finished playing has its interrupt off, see park; the
+	// fence pairs with the thread's, so one of them turns it back on
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&svc->idle, memory_order_relaxed) & (1U << channel)) {
+		output_long_ap(svc->cfg->pAP, (long *)&svc->cfg->brd_ptr->AXI_SetInterruptEnableRegister, (long)(1U << channel));
+	}
+	return 1;
+}
+
+int svc235_swap_pending(struct svc235 *svc, int channel)
+{
+	return atomic_load_explicit(&svc->swap[channel].posted, memory_order_acquire);
+}
+
+// cpu_fed is true if the channel's FIFO is written by the CPU, a pair of
+// samples at a time
+static int cpu_fed(struct svc235 *svc, int channel)
+{
+	return svc->cfg->opts.chan[channel].OpMode != DAC_FIFO_DMA;
+}
+
+// take_swap installs the waveform posted by svc235_swap, if any, once the
+// channel's current waveform is at the end of a period or finished.  The
+// last sample of an odd length waveform fed by the CPU is left out, as it
+// would share its pair with the new waveform
+static void take_swap(struct svc235 *svc, int channel)
+{
+	struct svcwave *w = &svc->wave[channel];
+	struct svcswap *p = &svc->swap[channel];
+	int end;
+
+	if (!atomic_load_explicit(&p->posted, memory_order_acquire)) {
+		return;
+	}
+	end = !w->fresh && (w->cursor == 0 || (cpu_fed(svc, channel) && w->n - w->cursor == 1));
+	if (!end && (w->loop || w->left != 0)) {
+		return;
+	}
+	install(svc, channel, p->buf, p->n, p->repeat);
+	atomic_store_explicit(&p->posted, 0, memory_order_release);
+	bump(&svc->stats.swaps, 1);
+}
+
+// synthesize loads a channel with its refill buffer, allocated as needed,
+// for samples synthesized from source
+static APSTATUS synthesize(struct svc235 *svc, int channel, int source)
+{
+	struct svcgen *g = &svc->gen[channel];
+	size_t n = refill_size235(svc->cfg, channel);
+
+	if (g->size < n) {
+		if (g->buf != NULL) {
+			free_pinned235(g->buf, g->size);
+		}
+		g->buf = alloc_pinned235(n);
+		g->size = g->buf != NULL ? n : 0;
+		if (g->buf == NULL) {
+			return E_OUT_OF_MEMORY;
+		}
+	}
+	svc235_load(svc, channel, g->buf, n, 0);
+	svc->wave[channel].source = source;
+	return S_OK;
+}
+
+APSTATUS svc235_generate(struct svc235 *svc, int channel, const APGEN *gen)
+{
+	struct cblk235 *cfg = svc->cfg;
+	struct svcgen *g = &svc->gen[channel];
+
+	apgen_init(&g->state, gen, cal235(cfg, channel), cfg->TimerDivider * 32e-9);
+	g->taken = atomic_load(&g->seq); // anything published before is stale
+	return synthesize(svc, channel, SVC_GENERATOR);
+}
+
+APSTATUS svc235_schedule(struct svc235 *svc, int channel, const struct svcstep *steps, size_t n)
+{
+	struct svcsched *s = &svc->sched[channel];
+
+	s->step = steps;
+	s->n = n;
+	s->next = 0;
+	s->k = 0;
+	s->hold = steps[0].code;
+	return synthesize(svc, channel, SVC_SCHEDULE);
+}
+
+// expand writes the next n samples of a schedule to out, holding each step's
+// code until the next
+static void expand(struct svcsched *s, short *out, size_t n)
+{
+	size_t j = 0, m, i;
+
+	while (j < n) {
+		while (s->next < s->n && s->step[s->next].tick <= s->k) {
+			s->hold = s->step[s->next++].code;
+		}
+		m = n - j;
+		if (s->next < s->n && s->step[s->next].tick - s->k < m) {
+			m = (size_t)(s->step[s->next].tick - s->k);
+		}
+		for (i = 0; i < m; i++) {
+			out[j + i] = s->hold;
+		}
+		j += m;
+		s->k += m;
+	}
+}
+
+void svc235_switch(struct svc235 *svc, int channel, const APGEN *gen)
+{
+	struct svcgen *g = &svc->gen[channel];
+	unsigned seq = atomic_load_explicit(&g->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&g->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	g->next = *gen;
+	atomic_store_explicit(&g->seq, seq + 2, memory_order_release);
+}
+
+// take switches a generator to the one last published by svc235_switch, if
+// there is a new one that is not being written.  One caught mid-write is
+// taken at the next refill
+static void take(struct svcgen *g)
+{
+	unsigned seq = atomic_load_explicit(&g->seq, memory_order_acquire);
+	APGEN next;
+
+	if (seq == g->taken || (seq & 1)) {
+		return;
+	}
+	next = g->next;
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&g->seq, memory_order_relaxed) != seq) {
+		return;
+	}
+	apgen_set(&g->state, &next);
+	g->taken = seq;
+}
+
+// next is the number of samples of the channel's next refill, from the
+// waveform swapped in if one was posted and the current one is at the end of
+// a period
+static size_t next(struct svc235 *svc, int channel)
+{
+	struct svcwave *w = &svc->wave[channel];
+	size_t n;
+
+	if (w->source == SVC_BUFFER) {
+		take_swap(svc, channel);
+	}
+	if (w->buf == NULL || (!w->loop && w->left == 0)) {
+		return 0;
+	}
+	n = refill_size235(svc->cfg, channel);
+	if (!w->loop && n > w->left) {
+		n = w->left;
+	}
+	if (svc235_swap_pending(svc, channel) && n > w->n - w->cursor) {
+		n = w->n - w->cursor; // stop at the end of the period for the swap
+		if (cpu_fed(svc, channel)) {
+			n &= ~(size_t)1;
+		}
+	}
+	return n;
+}
+
+// prepare is next, with the samples of a generated or scheduled channel
+// synthesized into its buffer
+static size_t prepare(struct svc235 *svc, int channel)
+{
+	struct svcwave *w = &svc->wave[channel];
+	struct svcgen *g = &svc->gen[channel];
+	size_t n = next(svc, channel), k;
+
+	if (n == 0 || w->source == SVC_BUFFER) {
+		return n;
+	}
+	k = w->n - w->cursor < n ? w->n - w->cursor : n;
+	if (w->source == SVC_SCHEDULE) {
+		expand(&svc->sched[channel], &w->buf[w->cursor], k);
+		expand(&svc->sched[channel], w->buf, n - k);
+		return n;
+	}
+	take(g);
+	apgen_run(&g->state, (unsigned short *)&w->buf[w->cursor], k);
+	apgen_run(&g->state, (unsigned short *)w->buf, n - k);
+	return n;
+}
+
+// finished is true if the channel has nothing left to send: its waveform
+// played to the end and no swap waits to replace it.  Generators and
+// schedules never finish
+static int finished(struct svc235 *svc, int channel)
+{
+	struct svcwave *w = &svc->wave[channel];
+
+	return (w->buf == NULL || (!w->loop && w->left == 0)) && !svc235_swap_pending(svc, channel);
+}
+
+// park turns the interrupts of the finished channels of mask off, as their
+// FIFOs stay below half full and would interrupt again at once.  A swap
+// posted for one of them turns its interrupt back on.  The shadow registers
+// are left as they are, StopWaveform resets them
+static void park(struct svc235 *svc, uint32_t mask, uint32_t done)
+{
+	struct cblk235 *cfg = svc->cfg;
+	uint32_t was = atomic_load_explicit(&svc->idle, memory_order_relaxed), posted = 0;
+	int i;
+
+	if (done == 0 && (was & mask) == 0) {
+		return;
+	}
+	if (done) {
+		output_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->AXI_ClearInterruptEnableRegister, (long)done);
+	}
+	done |= was & ~mask;
+	atomic_store_explicit(&svc->idle, done, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst); // pairs with svc235_swap's
+	for (i = 0; i < 16; i++) {
+		if ((done & (1U << i)) && svc235_swap_pending(svc, i)) {
+			posted |= 1U << i;
+		}
+	}
+	if (posted) {
+		output_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->AXI_SetInterruptEnableRegister, (long)posted);
+	}
+}
+
+// advance moves the channel's cursor past n samples that were sent
+static void advance(struct svc235 *svc, int channel, size_t n)
+{
+	struct svcwave *w = &svc->wave[channel];
+
+	w->cursor = (w->cursor + n) % w->n;
+	w->fresh = 0;
+	if (!w->loop) {
+		w->left -= n;
+	}
+}
+
+static void report(struct svc235 *svc, struct svcevent ev)
+{
+	if (ev.status == S_OK) {
+		return;
+	}
+	bump(&svc->stats.errors, 1);
+	if (ev.status == E_DMA_TIMEOUT) {
+		bump(&svc->stats.dma_timeouts, 1);
+	}
+	if (!push(&svc->events, ev)) {
+		atomic_fetch_add(&svc->lost, 1);
+	}
+}
+
+// write_tail writes the odd last sample of a refill fed by the CPU as a pair
+// of itself, the FIFO taking no single samples.  The sample is output for one
+// more period, which only delays the end of a finished waveform, as the
+// output keeps its last sample anyway; a swap takes no odd refills, see
+// take_swap
+static void write_tail(struct cblk235 *cfg, int channel, short sample)
+{
+	uint32_t wdata = (uint16_t)sample;
+
+	output_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->DAC[channel].Fifo, (long)(wdata | wdata << 16));
+}
+
+APSTATUS svc235_transfer(struct svc235 *svc, int channel, size_t *sent)
+{
+	struct cblk235 *cfg = svc->cfg;
+	struct svcwave *w = &svc->wave[channel];
+	APSTATUS status = S_OK;
+	size_t n = prepare(svc, channel);
+
+	if (sent) {
+		*sent = 0;
+	}
+	if (n == 0) {
+		return S_OK;
+	}
+	if (svc->trace) {
+		aptrace_event(svc->trace, APTRACE_REFILL, 1U << channel, 0, (unsigned)n, (unsigned short)w->buf[w->cursor]);
+	}
+	if (cfg->opts.chan[channel].OpMode == DAC_FIFO_DMA) {
+		status = dma_refill235(cfg, channel, w->buf, (uint)w->n, (uint)w->cursor, (uint)n);
+	} else {
+		// fifowro235 writes SampleCount / 2 samples, rounded down to pairs,
+		// continuing from (and advancing) current_ptr
+		cfg->SampleCount[channel] = (uint32_t)(n * 2);
+		fifowro235(cfg, channel);
+		if (n & 1) {
+			write_tail(cfg, channel, w->buf[(w->cursor + n - 1) % w->n]);
+		}
+	}
+	advance(svc, channel, n);
+	cfg->current_ptr[channel] = w->buf + w->cursor;
+	if (sent && status == S_OK) {
+		*sent = n;
+	}
+	return status;
+}
+
+void service_pending235(struct svc235 *svc, unsigned long status)
+{
+	struct cblk235 *cfg = svc->cfg;
+	APWRITE_OP ops[SVC_BATCH];
+	size_t nops = 0, n[16] = {0}, left[16] = {0}, pos[16], more, sent;
+	uint32_t pending = (uint32_t)(status & 0xFFFF), wdata, under = 0, done = 0;
+	unsigned long long total = 0;
+	struct timespec t0, t1;
+	struct svcwave *w;
+	int i;
+
+	// count channels that underflowed since they were last serviced
+	for (i = 0; i < 16; i++) {
+		if ((pending & (1U << i)) &&
+			(input_long_ap(cfg->pAP, (long *)&cfg->brd_ptr->DAC[i].Status) & (1 << 3))) {
+			under |= 1U << i;
+		}
+	}
+	bump(&svc->stats.underflows, __builtin_popcount(under & ~svc->underflowed));
+	svc->underflowed = (svc->underflowed & ~pending) | under;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	// DMA fed channels first, so the engine runs while the others are written
+	for (i = 0; i < 16; i++) {
+		if (!(pending & (1U << i))) {
+			continue;
+		}
+		if (cfg->opts.chan[i].OpMode == DAC_FIFO_DMA) {
+			report(svc, (struct svcevent){i, svc235_transfer(svc, i, &sent)});
+			total += sent;
+		} else {
+			n[i] = prepare(svc, i);
+			left[i] = n[i];
+			pos[i] = svc->wave[i].cursor;
+		}
+	}
+
+	// one pair per CPU fed channel per round, so that all of them fill
+	// at the same pace.  The FIFO takes packed pairs, see fifowro235; an odd
+	// last sample is paired with itself, as in write_tail
+	do {
+		more = 0;
+		for (i = 0; i < 16; i++) {
+			if (left[i] == 0) {
+				continue;
+			}
+			w = &svc->wave[i];
+			wdata = (uint16_t)w->buf[pos[i]]; // sample lo
+			if (--left[i] != 0) {
+				pos[i] = (pos[i] + 1) % w->n;
+				left[i]--;
+			}
+			wdata |= (uint32_t)(uint16_t)w->buf[pos[i]] << 16; // sample hi
+			pos[i] = (pos[i] + 1) % w->n;
+			ops[nops].p = (long *)&cfg->brd_ptr->DAC[i].Fifo;
+			ops[nops].v = (long)wdata;
+			ops[nops].uDelay = 0;
+			if (++nops == SVC_BATCH) {
+				output_long_batch_ap(cfg->pAP, ops, nops);
+				nops = 0;
+			}
+			more |= left[i];
+		}
+	} while (more);
+	for (i = 0; i < 16; i++) {
+		total += n[i];
+		if (n[i]) {
+			if (svc->trace) {
+				aptrace_event(svc->trace, APTRACE_REFILL, 1U << i, 0, (unsigned)n[i],
+					(unsigned short)svc->wave[i].buf[svc->wave[i].cursor]);
+			}
+			advance(svc, i, n[i]);
+			cfg->current_ptr[i] = svc->wave[i].buf + svc->wave[i].cursor;
+		}
+		if ((pending & (1U << i)) && finished(svc, i)) {
+			done |= 1U << i;
+		}
+	}
+
+	// acknowledge and re-enable the interrupts with the last of the writes,
+	// but those of the finished channels
+	if (nops + 2 > SVC_BATCH) {
+		output_long_batch_ap(cfg->pAP, ops, nops);
+		nops = 0;
+	}
+	ops[nops].p = (long *)&cfg->brd_ptr->AXI_InterruptAcknowledgeRegister;
+	ops[nops].v = (long)pending;
+	ops[nops++].uDelay = 0;
+	ops[nops].p = (long *)&cfg->brd_ptr->AXI_SetInterruptEnableRegister;
+	ops[nops].v = (long)(pending & ~done);
+	ops[nops++].uDelay = 0;
+	output_long_batch_ap(cfg->pAP, ops, nops);
+	park(svc, pending, done);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (svc->trace) {
+		aptrace_event(svc->trace, APTRACE_IRQ, pending, under, (unsigned)total, 0);
+	}
+	bump(&svc->stats.interrupts, 1);
+	bump(&svc->stats.samples, total);
+	record(svc->stats.batch, total);
+	record(svc->stats.duration, since(&t0, &t1));
+	if (svc->woke.tv_sec || svc->woke.tv_nsec) {
+		record(svc->stats.latency, since(&svc->woke, &t0));
+	}
+}
+
+// prefault touches the thread's stack and every page of the waveforms, so
+// the first refills do not take page faults
+static void prefault(struct svc235 *svc)
+{
+	volatile char stack[SVC_STACK_PREFAULT];
+	volatile short sink;
+	size_t i, j;
+
+	memset((char *)stack, 0, sizeof(stack));
+	for (i = 0; i < 16; i++) {
+		for (j = 0; j < svc->wave[i].n; j += 4096 / sizeof(short)) {
+			sink = svc->wave[i].buf[j];
+		}
+	}
+	(void)sink;
+}
+
+static void *run(void *arg)
+{
+	struct svc235 *svc = arg;
+	struct cblk235 *cfg = svc->cfg;
+	unsigned long status;
+
+	prefault(svc);
+	APServiceThread(cfg->nHandle);
+	enable_interrupts(cfg);
+	while (!atomic_load(&svc->stop)) {
+		// fetch_status blocks until an interrupt or APTerminateBlockedStart
+		status = fetch_status(cfg);
+		clock_gettime(CLOCK_MONOTONIC, &svc->woke);
+		if (status == 0 || atomic_load(&svc->stop)) {
+			break;
+		}
+		service_pending235(svc, status);
+	}
+	return NULL;
+}
+
+APSTATUS svc235_start(struct svc235 *svc, int cpu, int priority)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	cpu_set_t set;
+	size_t i;
+	int err;
+
+	if (svc->running) {
+		return ERROR;
+	}
+	atomic_store(&svc->stop, 0);
+	atomic_store(&svc->lost, 0);
+	atomic_store(&svc->idle, 0); // stop_waveform turned the interrupts off
+	// the thread's own state and the waveforms stay resident; pcor_buf and
+	// the pinned buffers are locked already, so this rarely does anything
+	mlock(svc, sizeof(*svc));
+	for (i = 0; i < 16; i++) {
+		if (svc->wave[i].buf != NULL) {
+			mlock(svc->wave[i].buf, svc->wave[i].n * sizeof(short));
+		}
+	}
+	pthread_attr_init(&attr);
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+	if (priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+	err = pthread_create(&svc->thread, &attr, run, svc);
+	pthread_attr_destroy(&attr);
+	if (err == EPERM) {
+		return E_NOT_PERMITTED;
+	}
+	if (err) {
+		return ERROR;
+	}
+	svc->running = 1;
+	return S_OK;
+}
+
+void svc235_trace(struct svc235 *svc, struct aptrace *t)
+{
+	svc->trace = t;
+}
+
+void svc235_stop(struct svc235 *svc)
+{
+	struct timespec deadline;
+
+	if (!svc->running) {
+		return;
+	}
+	atomic_store(&svc->stop, 1);
+	// the thread may be refilling rather than blocked when the first
+	// termination is sent, so keep terminating until it has exited
+	for (;;) {
+		APTerminateBlockedStart(svc->cfg->nHandle);
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += 10000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		if (pthread_timedjoin_np(svc->thread, NULL, &deadline) != ETIMEDOUT) {
+			break;
+		}
+	}
+	svc->running = 0;
+}
+
+int svc235_event(struct svc235 *svc, struct svcevent *ev)
+{
+	return pop(&svc->events, ev);
+}
+
+unsigned svc235_lost(struct svc235 *svc)
+{
+	return atomic_load(&svc->lost);
+}
+
+void svc235_stats(struct svc235 *svc, struct svcstats *stats)
+{
+	struct svccounters *c = &svc->stats;
+	int i;
+
+	stats->interrupts = atomic_load_explicit(&c->interrupts, memory_order_relaxed);
+	stats->samples = atomic_load_explicit(&c->samples, memory_order_relaxed);
+	stats->underflows = atomic_load_explicit(&c->underflows, memory_order_relaxed);
+	stats->dma_timeouts = atomic_load_explicit(&c->dma_timeouts, memory_order_relaxed);
+	stats->errors = atomic_load_explicit(&c->errors, memory_order_relaxed);
+	stats->swaps = atomic_load_explicit(&c->swaps, memory_order_relaxed);
+	for (i = 0; i < SVC_HIST; i++) {
+		stats->latency[i] = atomic_load_explicit(&c->latency[i], memory_order_relaxed);
+		stats->duration[i] = atomic_load_explicit(&c->duration[i], memory_order_relaxed);
+		stats->batch[i] = atomic_load_explicit(&c->batch[i], memory_order_relaxed);
+	}
+}
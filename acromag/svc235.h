@@ -0,0 +1,131 @@
+// svc235 is the waveform service thread of the AP235.  It waits for the
+// channel FIFO interrupts and refills the FIFOs from the waveform buffers
+// without taking the Go side's mutex; the control API and the thread only
+// share the stop flag and the event ring.
+#ifndef SVC235_H
+#define SVC235_H
+
+#ifndef DEVICE_NAME
+#include "apcommon.h"
+#include "AP235.h"
+#endif
+#include "apgen.h"
+
+// svc235 is opaque to Go; cgo does not translate the atomics inside
+struct svc235;
+
+// svcevent is a failed transfer reported by the service thread
+struct svcevent
+{
+	int channel;
+	int status; // APSTATUS
+};
+
+// SVC_HIST is the number of buckets of the svcstats histograms.  Bucket i
+// counts values v with 2^i <= v < 2^(i+1); bucket 0 also counts zeros and the
+// last bucket everything above its range
+#define SVC_HIST 32
+
+// svcstats is a snapshot of the service thread's counters since svc235_new
+struct svcstats
+{
+	unsigned long long interrupts;         // interrupts serviced
+	unsigned long long samples;            // samples sent to the FIFOs
+	unsigned long long underflows;         // times a serviced channel was found underflowed
+	unsigned long long dma_timeouts;       // DMA transfers that did not complete
+	unsigned long long errors;             // failed transfers, dma_timeouts included
+	unsigned long long swaps;              // waveforms swapped in, see svc235_swap
+	unsigned long long latency[SVC_HIST];  // ns from the thread waking to its first refill write
+	unsigned long long duration[SVC_HIST]; // ns from the first refill write to the acknowledge
+	unsigned long long batch[SVC_HIST];    // samples sent per interrupt
+};
+
+struct svc235 *svc235_new(struct cblk235 *cfg);
+
+// svc235_trace records the refills and interrupts the thread services in t,
+// or stops recording if t is NULL.  Only while the thread is stopped
+void svc235_trace(struct svc235 *svc, struct aptrace *t);
+
+void svc235_free(struct svc235 *svc);
+
+// svc235_load sets the waveform of a channel and rewinds it.  The waveform is
+// played repeat times back to back, or until stopped if repeat is zero.  Only
+// while the thread is stopped
+void svc235_load(struct svc235 *svc, int channel, short *buf, size_t n, unsigned repeat);
+
+// svc235_swap hands buf to the thread to replace a channel's waveform at the
+// end of its current period, or at once if it has finished playing.  It
+// does not wait for the thread and may be called while it runs; buf must
+// stay valid until svc235_swap_pending is zero, after which the old waveform
+// is no longer read.  Zero is returned, and nothing done, if the previous
+// swap was not taken yet.  A swap not taken before the thread stops is
+// dropped by the next svc235_load.  Not for channels set up by
+// svc235_generate
+int svc235_swap(struct svc235 *svc, int channel, short *buf, size_t n, unsigned repeat);
+
+// svc235_swap_pending is nonzero while a swap of the channel waits for the
+// thread to take it
+int svc235_swap_pending(struct svc235 *svc, int channel);
+
+// svc235_generate plays gen on a channel until stopped, synthesizing each
+// refill as it is sent, instead of a waveform.  The channel's correction and
+// the timer period are fixed at the call.  Only while the thread is stopped
+// and after partition235; E_OUT_OF_MEMORY is returned if the refill buffer
+// cannot be allocated
+APSTATUS svc235_generate(struct svc235 *svc, int channel, const APGEN *gen);
+
+// svcstep is a change of the output of a scheduled channel
+struct svcstep
+{
+	unsigned long long tick; // timer ticks from the start of playback
+	short code;              // code from that tick on
+};
+
+// svc235_schedule plays a schedule of n steps, in order of tick, on a
+// channel until stopped.  The channel outputs the first step's code up to
+// it and holds the last's after it.  Each refill is expanded from the steps
+// as it is sent, so steps far apart cost no memory.  steps must stay valid
+// until the thread is stopped.  Only while the thread is stopped and after
+// partition235; E_OUT_OF_MEMORY is returned if the refill buffer cannot be
+// allocated
+APSTATUS svc235_schedule(struct svc235 *svc, int channel, const struct svcstep *steps, size_t n);
+
+// svc235_switch switches a channel set up by svc235_generate to gen from its
+// next refill, keeping its time (see apgen_set).  It does not wait for the
+// thread and may be called while it runs; a switch made before the last is
+// taken replaces it
+void svc235_switch(struct svc235 *svc, int channel, const APGEN *gen);
+
+// svc235_transfer sends the next part of a channel's waveform to the board,
+// and the number of samples sent to *sent unless it is NULL; none are counted
+// as sent if the transfer failed.  Only while the thread is stopped; the
+// thread calls it itself otherwise
+APSTATUS svc235_transfer(struct svc235 *svc, int channel, size_t *sent);
+
+// service_pending235 refills the FIFOs of the channels pending in status in
+// one pass, interleaving the CPU fed channels' writes in batches, then
+// acknowledges and re-enables their interrupts with a single batch.  The
+// thread calls it for every interrupt
+void service_pending235(struct svc235 *svc, unsigned long status);
+
+// svc235_start starts the thread, pinned to cpu if cpu >= 0 and scheduled
+// SCHED_FIFO at priority if priority > 0.  The waveforms are locked in memory
+// and prefaulted by the thread before it services the first interrupt.
+// E_NOT_PERMITTED is returned if the process may not use SCHED_FIFO
+APSTATUS svc235_start(struct svc235 *svc, int cpu, int priority);
+
+// svc235_stop stops the thread and waits for it to exit
+void svc235_stop(struct svc235 *svc);
+
+// svc235_event pops the oldest event into ev, returning zero if there is none
+int svc235_event(struct svc235 *svc, struct svcevent *ev);
+
+// svc235_lost is the number of events dropped because the ring was full
+unsigned svc235_lost(struct svc235 *svc);
+
+// svc235_stats copies the counters into stats.  It does not take a lock and
+// may be called at any time; each counter is read atomically, the set of them
+// is not
+void svc235_stats(struct svc235 *svc, struct svcstats *stats);
+
+#endif
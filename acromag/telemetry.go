@@ -0,0 +1,157 @@
+package acromag
+
+/*
+#include "apcommon.h"
+#include "AP235.h"
+#include "shim235.h"
+*/
+import "C"
+import (
+	"errors"
+	"fmt"
+	"time"
+)
+
+// Telemetry is a sample of the status registers of an AP235, see StartSampler
+type Telemetry struct {
+	// Time is when Channels were read
+	Time time.Time `json:"time"`
+
+	// Channels is the status of each channel
+	Channels [16]ChannelStatus `json:"channels"`
+
+	// RegisterAccesses is the number of register reads and writes made to
+	// the board as of Time, and RegisterRate their rate since the previous
+	// sample, 0 for the first
+	RegisterAccesses uint64  `json:"register_accesses"`
+	RegisterRate     float64 `json:"register_rate"`
+
+	// XADCTime is when the FPGA temperature and supplies were read
+	XADCTime time.Time `json:"xadc_time"`
+
+	// Temperature of the FPGA in degrees C, with its extremes since power up
+	Temperature    float64 `json:"temperature"`
+	MaxTemperature float64 `json:"max_temperature"`
+	MinTemperature float64 `json:"min_temperature"`
+
+	// VCCInt and VCCAux are the FPGA supplies in volts, with their extremes
+	// since power up
+	VCCInt    float64 `json:"vcc_int"`
+	MaxVCCInt float64 `json:"max_vcc_int"`
+	MinVCCInt float64 `json:"min_vcc_int"`
+	VCCAux    float64 `json:"vcc_aux"`
+	MaxVCCAux float64 `json:"max_vcc_aux"`
+	MinVCCAux float64 `json:"min_vcc_aux"`
+}
+
+// xadcTemperature and xadcSupply convert the 10 bit XADC readings of Acromag's
+// examples to degrees C and volts
+func xadcTemperature(v C.uint32_t) float64 {
+	return float64((v>>6)&0x3FF)*503.975/1024 - 273.15
+}
+
+func xadcSupply(v C.uint32_t) float64 {
+	return float64((v>>6)&0x3FF) / 1024 * 3
+}
+
+// sample reads the channel status registers into t, and the XADC block as
+// well if xadc is true.  t holds the previous sample, if any
+func (dac *AP235) sample(t *Telemetry, xadc bool) {
+	var regs [16]C.uint32_t
+	last, accesses := t.Time, t.RegisterAccesses
+	t.Time = time.Now()
+	C.chstatus235(dac.cfg, &regs[0])
+	for i, stat := range regs {
+		t.Channels[i] = channelStatus(i, uint32(stat))
+	}
+	t.RegisterAccesses = uint64(C.APRegisterAccesses(dac.cfg.nHandle))
+	if dt := t.Time.Sub(last).Seconds(); !last.IsZero() && dt > 0 {
+		t.RegisterRate = float64(t.RegisterAccesses-accesses) / dt
+	}
+	if !xadc {
+		return
+	}
+	var x [9]C.uint32_t
+	t.XADCTime = time.Now()
+	C.xadc235(dac.cfg, &x[0])
+	t.Temperature, t.VCCInt, t.VCCAux = xadcTemperature(x[0]), xadcSupply(x[1]), xadcSupply(x[2])
+	t.MaxTemperature, t.MaxVCCInt, t.MaxVCCAux = xadcTemperature(x[3]), xadcSupply(x[4]), xadcSupply(x[5])
+	t.MinTemperature, t.MinVCCInt, t.MinVCCAux = xadcTemperature(x[6]), xadcSupply(x[7]), xadcSupply(x[8])
+}
+
+// StartSampler starts a goroutine that reads the channel status registers
+// every period and the FPGA temperature and supplies every xadcPeriod, and
+// publishes each sample for Status, StatusAll and Telemetry to read without
+// touching the board or taking the DAC's lock.  The sampler reads registers
+// only, so it runs beside waveform playback.  A first sample is taken before
+// returning.
+//
+// the error is non-nil if the sampler is running already or the periods are
+// not allowed
+func (dac *AP235) StartSampler(period, xadcPeriod time.Duration) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.stopSampler != nil {
+		return errors.New("AP235 telemetry sampler is already running")
+	}
+	if period <= 0 || xadcPeriod < period {
+		return fmt.Errorf("sampler periods %v and %v are not allowed, the XADC period must be at least the status period", period, xadcPeriod)
+	}
+	t := new(Telemetry)
+	dac.sample(t, true)
+	dac.telemetry.Store(t)
+	dac.stopSampler = make(chan struct{})
+	dac.samplerDone = make(chan struct{})
+	go dac.runSampler(*t, period, xadcPeriod, dac.stopSampler, dac.samplerDone)
+	return nil
+}
+
+// runSampler samples until stop is closed, then closes done.  Every sample is
+// a new Telemetry, so a reader of the last one never sees it change
+func (dac *AP235) runSampler(last Telemetry, period, xadcPeriod time.Duration, stop, done chan struct{}) {
+	defer close(done)
+	tick := time.NewTicker(period)
+	defer tick.Stop()
+	for {
+		select {
+		case <-stop:
+			return
+		case <-tick.C:
+		}
+		t := new(Telemetry)
+		*t = last
+		dac.sample(t, time.Since(last.XADCTime) >= xadcPeriod)
+		dac.telemetry.Store(t)
+		last = *t
+	}
+}
+
+// StopSampler stops the telemetry sampler, if it is running, after which
+// Status and StatusAll read the board again
+func (dac *AP235) StopSampler() {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.stopSampler == nil {
+		return
+	}
+	close(dac.stopSampler)
+	<-dac.samplerDone // the sampler does not take the lock
+	dac.stopSampler, dac.samplerDone = nil, nil
+	dac.telemetry.Store((*Telemetry)(nil))
+}
+
+// snapshot returns the latest sample, nil if the sampler is not running
+func (dac *AP235) snapshot() *Telemetry {
+	t, _ := dac.telemetry.Load().(*Telemetry)
+	return t
+}
+
+// Telemetry returns the latest sample of the telemetry sampler.  The error is
+// non-nil if the sampler is not running
+func (dac *AP235) Telemetry() (Telemetry, error) {
+	t := dac.snapshot()
+	if t == nil {
+		return Telemetry{}, errors.New("AP235 telemetry sampler is not running, see StartSampler")
+	}
+	return *t, nil
+}
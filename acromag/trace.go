@@ -0,0 +1,417 @@
+package acromag
+
+/*
+#include "apcommon.h"
+#include "AP235.h"
+#include "svc235.h"
+#include "aptrace.h"
+*/
+import "C"
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"os"
+	"reflect"
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+// Kinds of TraceRecord
+const (
+	// TraceOutput is codes written to the outputs of the channels of Mask,
+	// lowest channel first for a single write and in the order written for a
+	// batch: Codes[i] went to the i-th channel written
+	TraceOutput = C.APTRACE_OUTPUT
+
+	// TraceConfig is the registers of the channels of Mask configured
+	TraceConfig = C.APTRACE_CONFIG
+
+	// TraceRefill is Count samples sent to the FIFO of the channel of Mask,
+	// Codes[0] the first of them
+	TraceRefill = C.APTRACE_REFILL
+
+	// TraceInterrupt is an interrupt of the channels of Mask serviced, with
+	// Count samples sent and Status the channels found underflowed
+	TraceInterrupt = C.APTRACE_IRQ
+)
+
+// TraceRecord is one record of a trace, laid out as struct aptrace_rec so a
+// trace file is an array of them
+type TraceRecord struct {
+	// Ns is the CLOCK_MONOTONIC time of the record
+	Ns uint64
+
+	// Seq is the index of the record among those made by its producer,
+	// dropped ones included: the service thread for TraceRefill and
+	// TraceInterrupt, the control API, serialized by the DAC's lock, for the
+	// others.  A gap is records dropped because the ring was full
+	Seq uint64
+
+	// Board is the number given to SetTracer
+	Board uint16
+
+	// Kind is one of TraceOutput, TraceConfig, TraceRefill, TraceInterrupt
+	Kind uint8
+
+	// N is the number of Codes used
+	N uint8
+
+	Mask   uint32
+	Status uint32
+	Count  uint32
+	Codes  [16]uint16
+}
+
+// the record and the ring's layout must agree
+var _ [unsafe.Sizeof(TraceRecord{}) - C.sizeof_struct_aptrace_rec]byte
+var _ [C.sizeof_struct_aptrace_rec - unsafe.Sizeof(TraceRecord{})]byte
+
+// traceRing is the capacity in records of the rings of a board
+const traceRing = 1 << 14
+
+// A trace file is a 64 byte header then a fixed number of records.  Record i
+// of the trace is at slot i modulo that number, so a full file holds the
+// latest of them.  The header, little endian, is
+//
+//	[8]byte  traceMagic
+//	uint32   record size, 64
+//	uint32   records the file holds
+//	uint64   records written, updated at each flush
+//	uint64   records dropped by the rings, updated at each flush
+const traceHeader = 64
+
+var traceMagic = [8]byte{'A', 'P', 'T', 'R', 'A', 'C', 'E', '1'}
+
+// TraceStats are the counters of a Tracer
+type TraceStats struct {
+	// Records is the number of records written to the file
+	Records uint64 `json:"records"`
+
+	// Dropped is the number of records the boards' rings had no room for
+	Dropped uint64 `json:"dropped"`
+}
+
+// Tracer moves the records of the boards traced with SetTracer from their
+// rings to a memory mapped trace file, see ReadTrace
+type Tracer struct {
+	mu      sync.Mutex
+	f       *os.File
+	mem     []byte
+	recs    []TraceRecord // over mem, after the header
+	rings   []*C.struct_aptrace
+	written uint64
+	dropped uint64 // of rings detached already
+	closed  bool
+
+	stop chan struct{}
+	done chan struct{}
+}
+
+// NewTracer creates the trace file at path holding records records, and
+// flushes the rings of the boards attached to it every flush
+func NewTracer(path string, records int, flush time.Duration) (*Tracer, error) {
+	if records < 1 || flush <= 0 {
+		return nil, fmt.Errorf("trace of %d records flushed every %v is not allowed", records, flush)
+	}
+	f, err := os.OpenFile(path, os.O_RDWR|os.O_CREATE|os.O_TRUNC, 0644)
+	if err != nil {
+		return nil, err
+	}
+	size := traceHeader + records*C.sizeof_struct_aptrace_rec
+	if err = f.Truncate(int64(size)); err != nil {
+		f.Close()
+		return nil, err
+	}
+	mem, err := syscall.Mmap(int(f.Fd()), 0, size, syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	if err != nil {
+		f.Close()
+		return nil, err
+	}
+	copy(mem, traceMagic[:])
+	binary.LittleEndian.PutUint32(mem[8:], C.sizeof_struct_aptrace_rec)
+	binary.LittleEndian.PutUint32(mem[12:], uint32(records))
+	t := &Tracer{
+		f:    f,
+		mem:  mem,
+		recs: traceRecords(mem[traceHeader:]),
+		stop: make(chan struct{}),
+		done: make(chan struct{}),
+	}
+	go t.run(flush)
+	return t, nil
+}
+
+// traceRecords is a view of the records of b
+func traceRecords(b []byte) []TraceRecord {
+	var out []TraceRecord
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&out))
+	hdr.Data = uintptr(unsafe.Pointer(&b[0]))
+	hdr.Len = len(b) / C.sizeof_struct_aptrace_rec
+	hdr.Cap = hdr.Len
+	return out
+}
+
+func (t *Tracer) run(flush time.Duration) {
+	defer close(t.done)
+	tick := time.NewTicker(flush)
+	defer tick.Stop()
+	for {
+		select {
+		case <-t.stop:
+			return
+		case <-tick.C:
+		}
+		t.mu.Lock()
+		t.flush()
+		t.mu.Unlock()
+	}
+}
+
+// flush drains the rings into the file, with the lock held
+func (t *Tracer) flush() {
+	dropped := t.dropped
+	for _, r := range t.rings {
+		t.drain(r)
+		dropped += uint64(C.aptrace_dropped(r))
+	}
+	atomic.StoreUint64((*uint64)(unsafe.Pointer(&t.mem[24])), dropped)
+	atomic.StoreUint64((*uint64)(unsafe.Pointer(&t.mem[16])), t.written)
+}
+
+// drain moves the records of a ring to the file, in place
+func (t *Tracer) drain(r *C.struct_aptrace) {
+	for {
+		slot := int(t.written % uint64(len(t.recs)))
+		room := len(t.recs) - slot
+		n := int(C.aptrace_drain(r, (*C.struct_aptrace_rec)(unsafe.Pointer(&t.recs[slot])), C.size_t(room)))
+		t.written += uint64(n)
+		if n < room {
+			return
+		}
+	}
+}
+
+// attach adds rings to those flushed
+func (t *Tracer) attach(rings ...*C.struct_aptrace) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if !t.closed {
+		t.rings = append(t.rings, rings...)
+	}
+}
+
+// detach removes rings from those flushed, after moving the last of their
+// records to the file; they may be freed afterwards
+func (t *Tracer) detach(rings ...*C.struct_aptrace) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if t.closed {
+		return
+	}
+	for _, r := range rings {
+		for i := range t.rings {
+			if t.rings[i] == r {
+				t.drain(r)
+				t.dropped += uint64(C.aptrace_dropped(r))
+				t.rings = append(t.rings[:i], t.rings[i+1:]...)
+				break
+			}
+		}
+	}
+	t.flush()
+}
+
+// Stats returns the counters of the tracer, Records as of its last flush
+func (t *Tracer) Stats() TraceStats {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	out := TraceStats{Records: t.written, Dropped: t.dropped}
+	for _, r := range t.rings {
+		out.Dropped += uint64(C.aptrace_dropped(r))
+	}
+	return out
+}
+
+// Close flushes the rings a last time and closes the file.  Boards still
+// attached keep recording into their rings, which fill and drop, until
+// SetTracer(nil, 0) or Close of the board
+func (t *Tracer) Close() error {
+	close(t.stop)
+	<-t.done
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	t.flush()
+	t.closed = true
+	t.rings = nil
+	t.recs = nil
+	err := syscall.Munmap(t.mem)
+	t.mem = nil
+	if err2 := t.f.Sync(); err == nil {
+		err = err2
+	}
+	if err2 := t.f.Close(); err == nil {
+		err = err2
+	}
+	return err
+}
+
+// TraceFile is a trace file mapped for reading, see ReadTrace
+type TraceFile struct {
+	mem []byte
+
+	// Records are the records of the file in the order they were written,
+	// as views of the mapping: Records[0] holds the older ones if the file
+	// wrapped around, Records[1] the newer.  Each flush writes the rings one
+	// after the other, so the records are in time order per producer; sort
+	// by Ns for the order across them
+	Records [2][]TraceRecord
+
+	// Written and Dropped are the counters of the header
+	Written uint64
+	Dropped uint64
+}
+
+// ReadTrace maps the trace file at path for reading without copying it.  The
+// file may be that of a running Tracer; the records are those of its last
+// flush
+func ReadTrace(path string) (*TraceFile, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+	fi, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	if fi.Size() < traceHeader+C.sizeof_struct_aptrace_rec {
+		return nil, fmt.Errorf("%s is too short for a trace file", path)
+	}
+	mem, err := syscall.Mmap(int(f.Fd()), 0, int(fi.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return nil, err
+	}
+	var magic [8]byte
+	copy(magic[:], mem)
+	capacity := int(binary.LittleEndian.Uint32(mem[12:]))
+	if magic != traceMagic || binary.LittleEndian.Uint32(mem[8:]) != C.sizeof_struct_aptrace_rec ||
+		traceHeader+capacity*C.sizeof_struct_aptrace_rec > len(mem) {
+		syscall.Munmap(mem)
+		return nil, errors.New(path + " is not a trace file")
+	}
+	tf := &TraceFile{
+		mem:     mem,
+		Written: atomic.LoadUint64((*uint64)(unsafe.Pointer(&mem[16]))),
+		Dropped: atomic.LoadUint64((*uint64)(unsafe.Pointer(&mem[24]))),
+	}
+	recs := traceRecords(mem[traceHeader : traceHeader+capacity*C.sizeof_struct_aptrace_rec])
+	if tf.Written <= uint64(capacity) {
+		tf.Records[1] = recs[:tf.Written]
+	} else {
+		split := int(tf.Written % uint64(capacity))
+		tf.Records[0], tf.Records[1] = recs[split:], recs[:split]
+	}
+	return tf, nil
+}
+
+// Close unmaps the file; the Records are invalid afterwards
+func (tf *TraceFile) Close() error {
+	tf.Records = [2][]TraceRecord{}
+	err := syscall.Munmap(tf.mem)
+	tf.mem = nil
+	return err
+}
+
+// SetTracer records every output, configuration, refill and interrupt of
+// the DAC in t as the given board number, or stops recording if t is nil.
+// The records are made from the output and refill paths without locks into
+// rings of the board, which t empties into its file.
+//
+// the error is non-nil if the DAC is playing back or a ring cannot be allocated
+func (dac *AP235) SetTracer(t *Tracer, board int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	if dac.playingBack {
+		return errors.New("AP235 cannot change tracer during playback")
+	}
+	dac.untrace()
+	if t == nil {
+		return nil
+	}
+	ctl := C.aptrace_new(C.uint(board), traceRing)
+	svc := C.aptrace_new(C.uint(board), traceRing)
+	if ctl == nil || svc == nil {
+		C.aptrace_free(ctl)
+		C.aptrace_free(svc)
+		return errors.New("unable to allocate the trace rings")
+	}
+	t.attach(ctl, svc)
+	dac.cfg.trace = ctl
+	C.svc235_trace(dac.svc, svc)
+	dac.tracer, dac.traceSvc = t, svc
+	return nil
+}
+
+// untrace detaches the rings of the DAC from its tracer and frees them, with
+// the lock held and the service thread stopped
+func (dac *AP235) untrace() {
+	if dac.tracer == nil {
+		return
+	}
+	ctl := dac.cfg.trace
+	dac.cfg.trace = nil
+	if dac.svc != nil { // nil once Close freed it
+		C.svc235_trace(dac.svc, nil)
+	}
+	dac.tracer.detach(ctl, dac.traceSvc)
+	C.aptrace_free(ctl)
+	C.aptrace_free(dac.traceSvc)
+	dac.tracer, dac.traceSvc = nil, nil
+}
+
+// traceConfig records the configuration of the channels of mask
+func traceConfig(r *C.struct_aptrace, mask uint32) {
+	if r != nil {
+		C.aptrace_event(r, C.APTRACE_CONFIG, C.uint(mask), 0, 0, 0)
+	}
+}
+
+// SetTracer records every output and configuration of the DAC in t as the
+// given board number, or stops recording if t is nil.  The records are made
+// from the output path, under the DAC's lock, into a ring of the board,
+// which t empties into its file.
+//
+// the error is non-nil if the ring cannot be allocated
+func (dac *AP236) SetTracer(t *Tracer, board int) error {
+	dac.Lock()
+	defer dac.Unlock()
+	dac.untrace()
+	if t == nil {
+		return nil
+	}
+	ctl := C.aptrace_new(C.uint(board), traceRing)
+	if ctl == nil {
+		return errors.New("unable to allocate the trace ring")
+	}
+	t.attach(ctl)
+	dac.cfg.trace = ctl
+	dac.tracer = t
+	return nil
+}
+
+// untrace detaches the ring of the DAC from its tracer and frees it, with the
+// lock held
+func (dac *AP236) untrace() {
+	if dac.tracer == nil {
+		return
+	}
+	ctl := dac.cfg.trace
+	dac.cfg.trace = nil
+	dac.tracer.detach(ctl)
+	C.aptrace_free(ctl)
+	dac.tracer = nil
+}
@@ -2,6 +2,7 @@ package acromag
 
 /*
 #include "apcommon.h"
+#include "apcal.h"
 */
 import "C"
 import (
@@ -11,6 +12,49 @@ import (
 	"strings"
 )
 
+// PlaybackStats are counters of waveform playback on an AP235.  Bucket i of
+// the histograms counts values v with 2^i <= v < 2^(i+1); bucket 0 also counts
+// zeros and the last bucket everything larger
+type PlaybackStats struct {
+	// Interrupts is the number of interrupts serviced
+	Interrupts uint64 `json:"interrupts"`
+
+	// Samples is the number of samples sent to the FIFOs
+	Samples uint64 `json:"samples"`
+
+	// Underflows is the number of times a serviced channel was found
+	// with its FIFO underflowed
+	Underflows uint64 `json:"underflows"`
+
+	// DMATimeouts is the number of DMA transfers that did not complete
+	DMATimeouts uint64 `json:"dma_timeouts"`
+
+	// TransferErrors is the number of failed transfers, DMATimeouts included
+	TransferErrors uint64 `json:"transfer_errors"`
+
+	// Swaps is the number of staged waveforms swapped in during playback
+	Swaps uint64 `json:"swaps"`
+
+	// RegisterAccesses is the number of register reads and writes since the
+	// board was opened
+	RegisterAccesses uint64 `json:"register_accesses"`
+
+	// RegisterRate is the register accesses per second over the last period
+	// of the telemetry sampler, 0 if it is not running; see StartSampler
+	RegisterRate float64 `json:"register_rate"`
+
+	// LatencyNs is the time from the service thread waking to its first
+	// refill write
+	LatencyNs [32]uint64 `json:"latency_ns"`
+
+	// DurationNs is the time from the first refill write of an interrupt
+	// to its acknowledge
+	DurationNs [32]uint64 `json:"duration_ns"`
+
+	// SamplesPerInterrupt is the number of samples sent per interrupt
+	SamplesPerInterrupt [32]uint64 `json:"samples_per_interrupt"`
+}
+
 // OutputScale is the output scale of the DAC at power up or clear
 type OutputScale int
 
@@ -20,9 +64,18 @@ type OutputRange int
 // TriggerMode is a triggering mode
 type TriggerMode int
 
+// DMAWaitMode is a way of waiting for an AP235 DMA transfer to complete
+type DMAWaitMode int
+
 // OperatingMode is a mode of operating the DAC for a given channel
 type OperatingMode int
 
+// IOMode is the way register accesses reach the board
+type IOMode int
+
+// DelayMode is the way the settling delay after a register write is waited out
+type DelayMode int
+
 const (
 	// ZeroScale represents a power up zero scale signal.
 	// if the DAC is configured to -10 to 10V,
@@ -83,6 +136,11 @@ const (
 	// it is incompatible with the software triggering mode.
 	OperatingWaveform OperatingMode = 2 // from ap235.h
 
+	// OperatingWaveformDMA is waveform output with the FIFO fed by the board's
+	// scatter-gather DMA engine instead of by the CPU.  It is needed to reach
+	// the rated update rate on many channels at once.
+	OperatingWaveformDMA OperatingMode = 4 // from ap235.h
+
 	// MAXSAMPLES is the maximum number of samples in the buffer of a single
 	// channel.  It is repeated from AP235.h to avoid an unnecessary CFFI call
 	MAXSAMPLES = 4096
@@ -91,6 +149,48 @@ const (
 	MaxXferSize = MAXSAMPLES / 2
 )
 
+const (
+	// IOSyscall performs one read() or write() on the device node per register
+	// access.  This is the access mode of the Acromag example software.
+	IOSyscall IOMode = 0 // from apcommon.h
+
+	// IOMapped maps the board registers into the process and accesses them
+	// with plain loads and stores, avoiding a syscall per register.
+	// If the driver does not support mmap, the board is opened in IOSyscall mode
+	IOMapped IOMode = 1 // from apcommon.h
+
+	// IOSim opens a simulated board instead of a device node, so the package
+	// can be exercised and benchmarked without hardware or the driver.  The
+	// simulated AP235 drains its FIFOs at the timer rate and raises the FIFO
+	// and DMA interrupts; its calibration is ideal
+	IOSim IOMode = 2 // from apcommon.h
+)
+
+const (
+	// DelaySleep sleeps (usleep) after each write that needs a delay.
+	// A 2 us sleep is a scheduler wakeup, typically 50-100 us on Linux.
+	// This is the behavior of the Acromag example software
+	DelaySleep DelayMode = 0 // from apcommon.h
+
+	// DelaySpin busy-waits on the monotonic clock after each write that
+	// needs a delay, occupying the core for only as long as the delay
+	DelaySpin DelayMode = 1 // from apcommon.h
+
+	// DelayCoalesce busy-waits once at the end of a batch of writes
+	// (e.g. OutputMulti), for the longest delay of the batch
+	DelayCoalesce DelayMode = 2 // from apcommon.h
+)
+
+const (
+	// DMAWaitPoll polls the DMA status register until the transfer is
+	// complete, without sleeping.  A transfer takes microseconds
+	DMAWaitPoll DMAWaitMode = 0 // from AP235.h
+
+	// DMAWaitInterrupt sleeps until the board raises its DMA complete
+	// interrupt, freeing the core at the cost of the interrupt latency
+	DMAWaitInterrupt DMAWaitMode = 1 // from AP235.h
+)
+
 var (
 	// ErrSimultaneousOutput is generated when a device in simultaneous output mode is issued
 	// an Output command that is accepted for next flush but not executed.
@@ -112,6 +212,15 @@ var (
 	// to a channel configured for waveform playback
 	ErrIncompatibleWaveform = errors.New("single output commands are not possible when channel is configured for waveform playback")
 
+	// ErrNotSimultaneous is generated when a BoardGroup is asked to write to a
+	// channel that is not in simultaneous output mode, which would not wait
+	// for the group's trigger
+	ErrNotSimultaneous = errors.New("board group channels must be in simultaneous output mode")
+
+	// ErrSwapPending is generated when a waveform is staged or swapped on a
+	// channel whose previous swap the service thread has not taken yet
+	ErrSwapPending = errors.New("the previous waveform swap of the channel has not been taken yet")
+
 	// IdealCode is the array from drvr236.c L60-L85
 	// its inner elements, by index:
 	// 0 - zero value DN, straight binary
@@ -168,6 +277,9 @@ var (
 		0x8006: "NOT INITIALIZED", // Pmc not initialized
 		0x8007: "NOT IMPLEMENTED", // func is not implemented
 		0x8008: "NO INTERRUPTS",   // unable to handle interrupts
+		0x8009: "DMA TIMEOUT",     // DMA transfer did not complete
+		0x800A: "DMA NOT IDLE",    // DMA engine not idle after reset
+		0x800B: "NOT PERMITTED",   // real-time scheduling not permitted
 		0x0000: "OK",              // no true error
 	}
 )
@@ -221,6 +333,27 @@ func FormatOutputRange(o OutputRange) string {
 	}
 }
 
+// outputRangeMinMax is the low and high voltage of each OutputRange
+var outputRangeMinMax = [...][2]float64{
+	TenVSymm:    {-10, 10},
+	TenVPos:     {0, 10},
+	FiveVSymm:   {-5, 5},
+	FiveVPos:    {0, 5},
+	N2_5To7_5V:  {-2.5, 7.5},
+	ThreeVSymm:  {-3, 3},
+	SixteenVPos: {0, 16},
+	TwentyVPos:  {0, 20},
+}
+
+// MinMax returns the low and high voltage of the range, 0, 0 if it is invalid.
+// This is RangeToMinMax(FormatOutputRange(o)) without parsing
+func (o OutputRange) MinMax() (float64, float64) {
+	if o < 0 || int(o) >= len(outputRangeMinMax) {
+		return 0, 0
+	}
+	return outputRangeMinMax[o][0], outputRangeMinMax[o][1]
+}
+
 // RangeToMinMax converts a range string, <min,max> to floats.
 // the input is assumed to be well formed; 0,0 is returned for badly formed inputs,
 // or a panic occurs for inputs not containing a 0
@@ -263,25 +396,29 @@ func FormatTriggerMode(t TriggerMode) string {
 }
 
 // ValidateOperatingMode checks that an operating mode is valid
-// s is a member of {'single', 'waveform'}
+// s is a member of {'single', 'waveform', 'waveform-dma'}
 func ValidateOperatingMode(s string) (OperatingMode, error) {
 	switch s {
 	case "single":
 		return OperatingSingle, nil
 	case "waveform":
 		return OperatingWaveform, nil
+	case "waveform-dma":
+		return OperatingWaveformDMA, nil
 	default:
-		return -1, errors.New("operating mode must be a member of {single, waveform}")
+		return -1, errors.New("operating mode must be a member of {single, waveform, waveform-dma}")
 	}
 }
 
-// FormatOperatingMode formats the operating mode to either single or waveform.
+// FormatOperatingMode formats the operating mode to single, waveform, or waveform-dma.
 func FormatOperatingMode(o OperatingMode) string {
 	switch o {
 	case OperatingSingle:
 		return "single"
 	case OperatingWaveform:
 		return "waveform"
+	case OperatingWaveformDMA:
+		return "waveform-dma"
 	default:
 		return ""
 	}
@@ -337,3 +474,9 @@ func cMkCopyOfIdealData(idealCodes [8][7]float64) *[8][7]C.double {
 	}
 	return cArr
 }
+
+// calibrationKernel forces the SIMD level of the volts to codes kernels and
+// returns the level in use, see apcal_simd
+func calibrationKernel(level int) int {
+	return int(C.apcal_simd(C.int(level)))
+}
@@ -1,6 +1,9 @@
 
 #include "apcommon.h"
 #include "AP235.h"
+#include <time.h>
+
+#define FIFO_BATCH	256	/* packed FIFO writes per output_long_batch() call */
 
 /*
 {+D}
@@ -42,6 +45,8 @@
 
   DATE	     BY	    PURPOSE
   --------  ----    ------------------------------------------------
+	     JPL    FIFO writes are submitted in batches with output_long_batch()
+	     JPL    register accesses go through c_blk->pAP, no handle lookups
 
 {-D}
 */
@@ -65,6 +70,8 @@ void fifowro235(struct cblk235 *c_blk, int channel)
 */
 
 uint32_t wdata, cnt;
+APWRITE_OP ops[FIFO_BATCH];	/* FIFO writes waiting to be submitted */
+size_t nops = 0;
 
 /*
     ENTRY POINT OF ROUTINE:
@@ -75,6 +82,7 @@ uint32_t wdata, cnt;
    {
      /* write half the number of samples from the buffer into the channel FIFO */
      /* pack two 16 bit samples into a 32 bit value to increase data throughput when writing to the DAC */
+     /* the packed values are submitted FIFO_BATCH at a time with output_long_batch() */
      for(cnt = (c_blk->SampleCount[channel] >> 2); cnt; cnt--)
      {
         wdata = (uint32_t)(*c_blk->current_ptr[channel]++ & 0xFFFF);	/* sample lo */
@@ -87,8 +95,17 @@ uint32_t wdata, cnt;
         if(c_blk->current_ptr[channel] >= c_blk->tail_ptr[channel])
            c_blk->current_ptr[channel] = c_blk->head_ptr[channel];
 
-        output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[channel].Fifo, (long)wdata);
+        ops[nops].p = (long*)&c_blk->brd_ptr->DAC[channel].Fifo;
+        ops[nops].v = (long)wdata;
+        ops[nops].uDelay = 0;
+        if( ++nops == FIFO_BATCH )
+        {
+           output_long_batch_ap( c_blk->pAP, ops, nops );
+           nops = 0;
+        }
      }
+     if( nops )
+        output_long_batch_ap( c_blk->pAP, ops, nops );
    }
    else		/* Single value DAC Direct Access */
    {
@@ -99,9 +116,9 @@ uint32_t wdata, cnt;
 
       wdata |= (word)*c_blk->head_ptr[channel]; /* append data to the shift register update command */
 
-      output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, wdata );
+      output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->DAC[channel].DirectAccess, wdata );
 
-      usleep((useconds_t) 2);	/* write delay */
+      write_delay_ap( c_blk->pAP, 2 );	/* write delay */
    }
 }
 
@@ -134,6 +151,7 @@ uint32_t wdata, cnt;
 			    Channel to write to.
 
     MODULE TYPE:    int
+			S_OK, E_DMA_TIMEOUT or E_DMA_NOT_IDLE
 
     I/O RESOURCES:
 
@@ -141,12 +159,16 @@ uint32_t wdata, cnt;
 	RESOURCES:
 
     MODULES
-	CALLED:
+	CALLED:	    dmawait235
 
     REVISIONS:
 
   DATE	     BY	    PURPOSE
   --------  ----    ------------------------------------------------
+	     JPL    returns a status, waits for a running transfer before starting the next
+		    one instead of polling after, ping-pong state moved to the c_blk,
+		    the data descriptor transfers c_blk->SampleCount[channel] samples
+	     JPL    interrupt on complete in DMA_WAIT_IRQ mode
 
 {-D}
 */
@@ -162,19 +184,17 @@ uint32_t wdata, cnt;
 */
 
 
-void fifodmawro235(struct cblk235 *c_blk, int channel)
+int fifodmawro235(struct cblk235 *c_blk, int channel)
 {
 
 /*
     Declare local data areas
 */
 
-    int i;
     uint32_t lValue;
     struct mapap235* pAPCard;/* board pointer */
     /* internal & external address pointers to the transfer descriptor list used by scatter-gather DMA */
     struct scatterAP235list *IxSGLPtr, *ExSGLPtr;
-    static unsigned int pingpong[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }; /* pingpong buffer toggle flags */
 
 /*
     ENTRY POINT OF ROUTINE:
@@ -190,11 +210,15 @@ void fifodmawro235(struct cblk235 *c_blk, int channel)
     /*   --------------------------------------------  */
     /* On board Scatter-gather list for DMA from system memory to board channel FIFO registers */
 
-    output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMAControlRegister, DMAReset );	/* Reset device */
+    /* the engine is shared by all channels, the previous transfer must finish before the reset */
+    if( c_blk->DMABusy && dmawait235(c_blk) )
+      return(E_DMA_TIMEOUT);
+
+    output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAControlRegister, DMAReset );	/* Reset device */
 
     pAPCard = (struct mapap235*)NULL;	/* force address to be zero for board internal address pointer */
 
-    if(pingpong[channel]) /* based on the pingpong flag set up the first or second page scatter list address pointers */
+    if(c_blk->DMAPingPong[channel]) /* based on the pingpong flag set up the first or second page scatter list address pointers */
     {
       /* second page scatter list external address pointer */
       ExSGLPtr = (struct scatterAP235list *)((byte*)&c_blk->brd_ptr->CHAN[channel].sptrlo.NxtDescPtrLo);
@@ -210,42 +234,154 @@ void fifodmawro235(struct cblk235 *c_blk, int channel)
     }
 
     /* initialize (zero) status member of the DMA Descriptor list for translation reg addr Lo */
-    output_long( c_blk->nHandle, (long*)&ExSGLPtr[0].Status, 0);
+    output_long_ap( c_blk->pAP, (long*)&ExSGLPtr[0].Status, 0);
 
     /* initialize (zero) status member of the DMA Descriptor list for translation reg addr Hi */
-    output_long( c_blk->nHandle, (long*)&ExSGLPtr[1].Status, 0);
+    output_long_ap( c_blk->pAP, (long*)&ExSGLPtr[1].Status, 0);
 
     /* initialize (zero) status member of the DMA Descriptor list for the page data transfer */
-    output_long( c_blk->nHandle, (long*)&ExSGLPtr[2].Status, 0);
+    output_long_ap( c_blk->pAP, (long*)&ExSGLPtr[2].Status, 0);
+
+    /* bytes to transfer for the page data, samples are written in pairs to the FIFO */
+    output_long_ap( c_blk->pAP, (long*)&ExSGLPtr[2].Control, (long)((c_blk->SampleCount[channel] & ~1) * sizeof(short)));
 
     /* Verify device idle */
-    lValue = input_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMAStatusRegister );
-    if( lValue & DMATransferComplete)
-    {
-      /* set control register, scatter-gather DMA mode and DMA Key Hole Write */
-      output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMAControlRegister, 0x2A);
+    lValue = input_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAStatusRegister );
+    if( (lValue & DMATransferComplete) == 0 )
+      return(E_DMA_NOT_IDLE);
+
+    /* set control register, scatter-gather DMA mode and DMA Key Hole Write */
+    /* and the interrupt on complete when the completion is waited for with an interrupt */
+    if( c_blk->DMAWaitMode == DMA_WAIT_IRQ )
+      output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAControlRegister, 0x2A | DMAInterruptOnCompleteEnabled);
+    else
+      output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAControlRegister, 0x2A);
+
+    /* CDMA Descriptor Pointer Register the internal address of the scatter/gather list start address */
+    output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMADescriptorPointerRegister, (long)IxSGLPtr );
+
+    /* CDMA Tail Descriptor Pointer Register the internal address of the scatter/gather list end address - the write also starts the DMA transfer */
+    output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMATailDescriptorPointerRegister, (long)((byte *)IxSGLPtr) + 0x80);
+
+    c_blk->DMAPingPong[channel] ^= 1; /* update the pingpong buffer toggle flag - set/clear as needed */
+    c_blk->DMABusy = TRUE;	/* completion is checked before the next transfer, see dmawait235 */
+    return(S_OK);
+}
+
+
+
+/*
+{+D}
+    SYSTEM:	    Library Software
+
+    FILENAME:	    wro235.c
+
+    MODULE NAME:    dmawait235, dmapoll235 - wait for the DMA transfer in progress.
+
+    VERSION:	    A
+
+    CREATION DATE:  10/14/26
+
+    CODED BY:	    JPL
+
+    ABSTRACT:	    This module waits for the board's DMA engine to complete the
+		    transfer started by fifodmawro235.
+
+    CALLING
+	SEQUENCE:   dmawait235(c_blk);
+		    dmapoll235(c_blk);
+		    where:
+			c_blk (prt)
+			    pointer to configuration structure.
+
+    MODULE TYPE:    int
+			S_OK or E_DMA_TIMEOUT
+
+    REVISIONS:
+
+  DATE	     BY	    PURPOSE
+  --------  ----    ------------------------------------------------
+	     JPL    added the DMA_WAIT_IRQ completion mode, dmapoll235
+
+{-D}
+*/
 
-      /* CDMA Descriptor Pointer Register the internal address of the scatter/gather list start address */
-      output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMADescriptorPointerRegister, (long)IxSGLPtr );
 
-      /* CDMA Tail Descriptor Pointer Register the internal address of the scatter/gather list end address - the write also starts the DMA transfer */
-      output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMATailDescriptorPointerRegister, (long)((byte *)IxSGLPtr) + 0x80);
+/*
+    MODULES FUNCTIONAL DETAILS:
+
+    In DMA_WAIT_POLL mode (dmapoll235) the status register is polled without
+    sleeping, a page transfer takes microseconds.  The poll is bounded by
+    DMATIMEOUT_NS on the monotonic clock rather than a count of tries.
+
+    In DMA_WAIT_IRQ mode the transfer was started with the interrupt on
+    complete enabled and the calling thread sleeps in APBlockingStartConvert
+    until the interrupt arrives.  Channel FIFO interrupts that arrive during
+    the wait are saved in c_blk->PendingStatus for fetch_status.  The blocking
+    wait has no timeout of its own; it ends with E_DMA_TIMEOUT when it is
+    terminated by APTerminateBlockedStart (stop_waveform).
+*/
+
+
+int dmawait235(struct cblk235 *c_blk)
+{
+    uint32_t pending;
 
-      pingpong[channel] ^= 1; /* update the pingpong buffer toggle flag - set/clear as needed */
+    if( !c_blk->DMABusy )
+      return(S_OK);
 
-      for(i = 0; i < DMAMAX_TRIES; i++ ) /* wait for DMA transfer to complete (device idle) or timeout */
+    if( c_blk->DMAWaitMode != DMA_WAIT_IRQ )
+      return(dmapoll235(c_blk));
+
+    /* the interrupt may already have been raised, the IOC flag stays set until acknowledged */
+    while( (input_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAStatusRegister ) & DMATransferComplete) == 0 )
+    {
+      output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->AXI_SetInterruptEnableRegister, DMAInterruptEnable );
+      pending = APBlockingStartConvert( c_blk->nHandle, (long*)&c_blk->brd_ptr->AXI_MasterEnableRegister,
+					(long)MasterInterruptEnable, (long)2 );
+      if( pending == 0 )	/* wait terminated */
       {
-         usleep(20);
-         lValue = input_long(c_blk->nHandle, (long*)&c_blk->brd_ptr->CDMAStatusRegister );
-         if( lValue & DMATransferComplete )/* Transfer Complete? */
-             break;
+        c_blk->DMABusy = FALSE;
+        return(E_DMA_TIMEOUT);
       }
 
-      if( i >= DMAMAX_TRIES )
-          printf("\nDMA timeout!\n");
-     }
-     else
-          printf("\nDevice not idle status = %X\n",lValue);
+      c_blk->PendingStatus |= pending & 0xFFFF;	/* channel FIFO interrupts, for fetch_status */
+      if( pending & DMAInterruptPending )
+        break;
+    }
+
+    /* acknowledge the completion at the engine (IOC flag, write 1 to clear) and at the interrupt controller */
+    output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAStatusRegister, DMAInterruptOnCompleteEnabled );
+    output_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->AXI_InterruptAcknowledgeRegister, DMAInterruptPending );
+    c_blk->DMABusy = FALSE;
+    return(S_OK);
+}
+
+
+int dmapoll235(struct cblk235 *c_blk)
+{
+    struct timespec start, now;
+    long elapsed;
+
+    if( !c_blk->DMABusy )
+      return(S_OK);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while( (input_long_ap( c_blk->pAP, (long*)&c_blk->brd_ptr->CDMAStatusRegister ) & DMATransferComplete) == 0 )
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      elapsed = (now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec);
+      if( elapsed > DMATIMEOUT_NS )
+      {
+        c_blk->DMABusy = FALSE;	/* give up on it, the next fifodmawro235 resets the engine */
+        return(E_DMA_TIMEOUT);
+      }
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+    c_blk->DMABusy = FALSE;
+    return(S_OK);
 }
 
 
@@ -43,6 +43,7 @@
 
   DATE	  BY	    PURPOSE
 -------  ----	------------------------------------------------
+	  JPL	    write delay follows the board's write delay mode
 
 {-D}
 */
@@ -85,7 +86,7 @@ uint32_t wdata;
 /*printf("Wro236 %X %X\n", data, wdata);*/
 
   output_long( c_blk->nHandle, (long*)&c_blk->brd_ptr->dac_reg[channel], wdata );
-  usleep((useconds_t) 2);	/* write delay */
+  write_delay( c_blk->nHandle, 2 );	/* write delay */
 }
 
 
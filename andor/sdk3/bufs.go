@@ -5,33 +5,44 @@ package sdk3
 #cgo LDFLAGS: -L/usr/local/lib -latcore -latutility
 #include <stdlib.h>
 #include <atcore.h>
-#include <shim.h>
 
 */
 import "C"
-import "unsafe"
+import (
+	"unsafe"
 
-// buffer is an 8-byte aligned block of memory owned by C used for image readout
+	"github.com/nasa-jpl/golaborate/pinned"
+)
+
+// buffer is a page aligned, page locked block of memory outside of the Go heap
+// used for image readout.  The memory comes from pinned.Default and goes back
+// to it, so reallocating for a new AOI recycles the buffers of an earlier one
 type buffer struct {
-	// cptrhead points to the head of the
-	// alloc, which may not be 8-byte aligned
-	// cptr points to the 8-byte aligned position
-	// for the andor SDK's usages
+	// mem is the memory of the buffer, cptr its head for the andor SDK's
+	// usages
+	mem       []byte
 	cptr      *C.AT_U8
 	cptrsize  C.int
 	size      int
 	allocated bool
 }
 
-func (b *buffer) Alloc(nbytes int) {
-	b.cptr = (*C.AT_U8)(C.aligned_malloc2(C.int(nbytes), 8))
+func (b *buffer) Alloc(nbytes int) error {
+	mem, err := pinned.Default.Get(nbytes)
+	if err != nil {
+		return err
+	}
+	b.mem = mem
+	b.cptr = (*C.AT_U8)(unsafe.Pointer(&mem[0]))
 	b.cptrsize = C.int(nbytes)
 	b.size = nbytes
 	b.allocated = true
-	return
+	return nil
 }
 
 func (b *buffer) Free() {
-	C.aligned_free2(unsafe.Pointer(b.cptr))
+	pinned.Default.Put(b.mem)
+	b.mem = nil
+	b.cptr = nil
 	b.allocated = false
 }
@@ -202,20 +202,28 @@ func (c *Camera) Close() error {
 
 // Allocate creates the buffer that will be populated by the SDK
 // it should be called at init, and whenever the AOI or encoding changes
-// AT_Flush is called to ensure stale buffers are not held by the SDK
+// AT_Flush is called first to ensure stale buffers are not held by the SDK
+// when they are returned to the pool
 func (c *Camera) Allocate() error {
 	sze, err := c.ImageSizeBytes()
 	if err != nil {
 		return err
 	}
+	err = c.Flush()
+	if err != nil {
+		return err
+	}
 
 	for i := 0; i < nbufs; i++ {
 		if c.bufs[i].allocated {
 			c.bufs[i].Free()
 		}
-		c.bufs[i].Alloc(sze)
+		err = c.bufs[i].Alloc(sze)
+		if err != nil {
+			return err
+		}
 	}
-	return c.Flush()
+	return nil
 }
 
 // ImageSizeBytes is the size of the image buffer in bytes.  This function
@@ -1,2 +0,0 @@
-void *aligned_malloc2(int size, int align);
-void aligned_free2(void *ptr);
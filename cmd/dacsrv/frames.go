@@ -0,0 +1,198 @@
+package main
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"log"
+	"math/bits"
+	"net"
+	"net/http"
+	"runtime"
+	"sync/atomic"
+)
+
+// A frame is one UDP datagram updating any of the first 16 channels of a DAC
+// at once.  Its layout, little endian, is
+//
+//	uint32 sequence number, incremented by one per frame by the client
+//	uint16 channel mask, bit n set if channel n is updated
+//	uint16 flags, frameResync or zero
+//	uint16 DN of each channel in the mask, lowest channel first
+//
+// The DNs are those of OutputDN16.  Frames with a sequence number at or
+// before the last applied are stale (duplicated or reordered by the network)
+// and dropped; a gap in the numbers counts the frames lost.  The numbers wrap,
+// and are compared over half their range.  Frames are dropped while the DAC
+// is locked over HTTP (/lock)
+const frameHeader = 8
+
+// frameResync flags a frame whose sequence number is taken as is, stale or
+// not.  A client sets it on its first frames after it (re)starts numbering,
+// so that it is not dropped until it passes the numbers of its previous run
+const frameResync = 1
+
+// maxFrame is the largest frame, a DN for each of 16 channels
+const maxFrame = frameHeader + 16*2
+
+// multiDN16 is a DAC that writes many channels in one batch
+type multiDN16 interface {
+	OutputMultiDN16([]int, []uint16) error
+}
+
+// lockable is the lock SetupHTTP puts in front of a DAC
+type lockable interface {
+	Locked() bool
+}
+
+// FrameStats are the counters of a FrameServer
+type FrameStats struct {
+	// Frames is the number of datagrams received
+	Frames uint64 `json:"frames"`
+
+	// Applied is the number of frames written to the DAC
+	Applied uint64 `json:"applied"`
+
+	// Lost is the number of frames skipped over by the sequence numbers
+	Lost uint64 `json:"lost"`
+
+	// Stale is the number of frames dropped for their sequence number
+	Stale uint64 `json:"stale"`
+
+	// Malformed is the number of datagrams that are not a frame
+	Malformed uint64 `json:"malformed"`
+
+	// Errors is the number of frames the DAC refused
+	Errors uint64 `json:"errors"`
+
+	// Locked is the number of frames dropped because the DAC was locked
+	Locked uint64 `json:"locked"`
+
+	// Resyncs is the number of frames applied with frameResync set
+	Resyncs uint64 `json:"resyncs"`
+
+	// Sequence is the sequence number of the last applied frame
+	Sequence uint32 `json:"sequence"`
+}
+
+// FrameServer applies binary update frames received over UDP to a DAC,
+// without the HTTP stack in between
+type FrameServer struct {
+	// stats are updated by the receiving goroutine only and read
+	// atomically; first for the alignment of the 64 bit counters
+	stats FrameStats
+
+	dac  multiDN16
+	lock lockable
+	conn *net.UDPConn
+
+	// started is false until the first frame is applied; chans and dns are
+	// the frame being applied.  All three belong to the receiving goroutine
+	started bool
+	chans   [16]int
+	dns     [16]uint16
+}
+
+// ServeFrames listens for frames on addr (e.g. ":8236") and applies them to
+// dac until the process exits, unless lock is locked.  The DAC must be safe
+// to drive from the HTTP handlers at the same time
+func ServeFrames(addr string, dac multiDN16, lock lockable) (*FrameServer, error) {
+	udp, err := net.ResolveUDPAddr("udp", addr)
+	if err != nil {
+		return nil, err
+	}
+	conn, err := net.ListenUDP("udp", udp)
+	if err != nil {
+		return nil, err
+	}
+	s := &FrameServer{dac: dac, lock: lock, conn: conn}
+	go s.run()
+	return s, nil
+}
+
+// run receives and applies frames.  Nothing in the loop allocates
+func (s *FrameServer) run() {
+	var buf [maxFrame + 1]byte // one more, so oversized datagrams are seen
+	// the goroutine spends its life blocked in the read; keeping it on its
+	// thread saves a handoff between threads per frame
+	runtime.LockOSThread()
+	for {
+		n, err := s.conn.Read(buf[:])
+		if err != nil {
+			log.Println("frame server stopped:", err)
+			return
+		}
+		s.apply(buf[:n])
+	}
+}
+
+// apply checks one datagram and writes it to the DAC if it is a frame newer
+// than the last applied
+func (s *FrameServer) apply(b []byte) {
+	atomic.AddUint64(&s.stats.Frames, 1)
+	if len(b) < frameHeader {
+		atomic.AddUint64(&s.stats.Malformed, 1)
+		return
+	}
+	seq := binary.LittleEndian.Uint32(b[0:])
+	mask := binary.LittleEndian.Uint16(b[4:])
+	flags := binary.LittleEndian.Uint16(b[6:])
+	k := bits.OnesCount16(mask)
+	if k == 0 || len(b) != frameHeader+2*k || flags&^frameResync != 0 {
+		atomic.AddUint64(&s.stats.Malformed, 1)
+		return
+	}
+	if s.lock != nil && s.lock.Locked() {
+		atomic.AddUint64(&s.stats.Locked, 1)
+		return
+	}
+	last := atomic.LoadUint32(&s.stats.Sequence)
+	if flags&frameResync != 0 {
+		atomic.AddUint64(&s.stats.Resyncs, 1)
+	} else if d := seq - last; s.started && (d == 0 || d >= 1<<31) {
+		atomic.AddUint64(&s.stats.Stale, 1)
+		return
+	} else if s.started && d > 1 {
+		atomic.AddUint64(&s.stats.Lost, uint64(d-1))
+	}
+	s.started = true
+	atomic.StoreUint32(&s.stats.Sequence, seq)
+
+	k = 0
+	for ch := 0; ch < 16; ch++ {
+		if mask&(1<<uint(ch)) != 0 {
+			s.chans[k] = ch
+			s.dns[k] = binary.LittleEndian.Uint16(b[frameHeader+2*k:])
+			k++
+		}
+	}
+	if err := s.dac.OutputMultiDN16(s.chans[:k], s.dns[:k]); err != nil {
+		atomic.AddUint64(&s.stats.Errors, 1)
+		return
+	}
+	atomic.AddUint64(&s.stats.Applied, 1)
+}
+
+// Stats returns a snapshot of the counters
+func (s *FrameServer) Stats() FrameStats {
+	return FrameStats{
+		Frames:    atomic.LoadUint64(&s.stats.Frames),
+		Applied:   atomic.LoadUint64(&s.stats.Applied),
+		Lost:      atomic.LoadUint64(&s.stats.Lost),
+		Stale:     atomic.LoadUint64(&s.stats.Stale),
+		Malformed: atomic.LoadUint64(&s.stats.Malformed),
+		Errors:    atomic.LoadUint64(&s.stats.Errors),
+		Locked:    atomic.LoadUint64(&s.stats.Locked),
+		Resyncs:   atomic.LoadUint64(&s.stats.Resyncs),
+		Sequence:  atomic.LoadUint32(&s.stats.Sequence),
+	}
+}
+
+// ServeHTTP reports the counters as JSON
+func (s *FrameServer) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	w.Header().Set("Content-Type", "application/json")
+	err := json.NewEncoder(w).Encode(s.Stats())
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusInternalServerError)
+		return
+	}
+}
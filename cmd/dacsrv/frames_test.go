@@ -0,0 +1,141 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"testing"
+)
+
+// recordingDAC keeps the last frame written to it
+type recordingDAC struct {
+	chans []int
+	dns   []uint16
+	fail  bool
+}
+
+func (d *recordingDAC) OutputMultiDN16(chans []int, dns []uint16) error {
+	if d.fail {
+		return errors.New("channel in waveform mode")
+	}
+	d.chans = append(d.chans[:0], chans...)
+	d.dns = append(d.dns[:0], dns...)
+	return nil
+}
+
+type flag bool
+
+func (f *flag) Locked() bool { return bool(*f) }
+
+// frame encodes a frame of the DNs of the channels in mask
+func frame(seq uint32, mask uint16, dns ...uint16) []byte {
+	b := make([]byte, frameHeader+2*len(dns))
+	binary.LittleEndian.PutUint32(b[0:], seq)
+	binary.LittleEndian.PutUint16(b[4:], mask)
+	for i, dn := range dns {
+		binary.LittleEndian.PutUint16(b[frameHeader+2*i:], dn)
+	}
+	return b
+}
+
+func TestFrameMask(t *testing.T) {
+	d := &recordingDAC{}
+	s := &FrameServer{dac: d}
+	s.apply(frame(1, 1<<15|1<<2|1, 10, 20, 30))
+	want := []int{0, 2, 15}
+	if len(d.chans) != 3 || d.chans[0] != want[0] || d.chans[1] != want[1] || d.chans[2] != want[2] {
+		t.Fatalf("channels %v, want %v", d.chans, want)
+	}
+	if d.dns[0] != 10 || d.dns[1] != 20 || d.dns[2] != 30 {
+		t.Errorf("DNs %v, want [10 20 30]", d.dns)
+	}
+	if st := s.Stats(); st.Applied != 1 || st.Sequence != 1 {
+		t.Errorf("unexpected stats %+v", st)
+	}
+}
+
+func TestFrameSequence(t *testing.T) {
+	d := &recordingDAC{}
+	s := &FrameServer{dac: d}
+	for _, seq := range []uint32{
+		0xFFFFFFFE, // the first frame sets the sequence, whatever it is
+		0xFFFFFFFF,
+		0xFFFFFFFF, // duplicate
+		1,          // wraps, skipping 0
+		0xFFFFFFFF, // reordered over the wrap
+		4,          // skips 2 and 3
+		0x80000004, // half the range ahead is behind
+	} {
+		s.apply(frame(seq, 1, uint16(seq)))
+	}
+	st := s.Stats()
+	if st.Applied != 4 || st.Stale != 3 || st.Lost != 3 || st.Sequence != 4 {
+		t.Errorf("expected 4 applied, 3 stale and 3 lost at 4, got %+v", st)
+	}
+	if d.dns[0] != 4 {
+		t.Errorf("last DN written is %d, want 4", d.dns[0])
+	}
+}
+
+func TestFrameMalformed(t *testing.T) {
+	d := &recordingDAC{}
+	s := &FrameServer{dac: d}
+	padded := frame(1, 1, 5)
+	padded[6] = 2 // a flag other than frameResync
+	for _, b := range [][]byte{
+		nil,
+		frame(1, 1, 5)[:frameHeader-1],
+		frame(1, 0),              // no channels
+		frame(1, 3, 5),           // one DN short
+		frame(1, 1, 5, 6),        // one DN over
+		padded,                   // unknown flag
+		make([]byte, maxFrame+1), // oversized
+	} {
+		s.apply(b)
+	}
+	if st := s.Stats(); st.Malformed != 7 || st.Applied != 0 || st.Frames != 7 {
+		t.Errorf("expected 7 malformed, got %+v", st)
+	}
+	// malformed frames do not advance the sequence
+	s.apply(frame(1, 1, 5))
+	if st := s.Stats(); st.Applied != 1 || st.Stale != 0 {
+		t.Errorf("a frame after malformed ones was not applied, %+v", st)
+	}
+}
+
+func TestFrameResync(t *testing.T) {
+	d := &recordingDAC{}
+	s := &FrameServer{dac: d}
+	for seq := uint32(1000); seq < 1003; seq++ {
+		s.apply(frame(seq, 1, uint16(seq)))
+	}
+	// the client restarts its numbers at 0, flagging its first frames
+	restart := frame(0, 1, 7)
+	restart[6] = frameResync
+	s.apply(frame(0, 1, 6)) // unflagged, stale
+	s.apply(restart)
+	s.apply(frame(1, 1, 8))
+	st := s.Stats()
+	if st.Applied != 5 || st.Stale != 1 || st.Resyncs != 1 || st.Lost != 0 || st.Sequence != 1 {
+		t.Errorf("expected 5 applied, 1 stale and 1 resync at 1, got %+v", st)
+	}
+	if d.dns[0] != 8 {
+		t.Errorf("last DN written is %d, want 8", d.dns[0])
+	}
+}
+
+func TestFrameLockedAndErrors(t *testing.T) {
+	d := &recordingDAC{}
+	locked := flag(true)
+	s := &FrameServer{dac: d, lock: &locked}
+	s.apply(frame(1, 1, 5))
+	if st := s.Stats(); st.Locked != 1 || st.Applied != 0 || d.chans != nil {
+		t.Errorf("a frame reached a locked DAC, %+v", st)
+	}
+	locked = false
+	s.apply(frame(1, 1, 5)) // not stale, the locked one was never applied
+	d.fail = true
+	s.apply(frame(2, 1, 6))
+	if st := s.Stats(); st.Applied != 1 || st.Errors != 1 || st.Sequence != 2 {
+		t.Errorf("expected 1 applied and 1 refused, got %+v", st)
+	}
+}
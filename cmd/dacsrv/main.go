@@ -22,103 +22,106 @@ var (
 )
 
 // SetupAP235 initializes the AP235 hardware to a pre-configured and safe condition
-func SetupAP235() (*acromag.AP235, error) {
-	dac, err := acromag.NewAP235(0)
-	if err != nil {
-		return dac, err
-	}
+func SetupAP235(dac *acromag.AP235) error {
+	var err error
+	// stage the settings so each channel is reset and written once
+	dac.BeginConfig()
 	for _, ch := range channels {
 		err = dac.SetClearVoltage(ch, acromag.MidScale)
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetPowerUpVoltage(ch, acromag.MidScale)
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetRange(ch, "-10,10")
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetOverRange(ch, false)
 		if err != nil {
-			return dac, err
+			return err
 		}
 
 		err = dac.SetOutputSimultaneous(ch, false)
 		if err != nil {
-			return dac, err
+			return err
 		}
 
 		// this means output glitches if the FIFO is emptied
 		// instead of playback stopping
 		err = dac.SetClearOnUnderflow(ch, false)
 		if err != nil {
-			return dac, err
+			return err
 		}
+	}
+	dac.CommitConfig()
 
-		// lastly, power up the DAC channel
+	// lastly, power up the DAC channels
+	for _, ch := range channels {
 		err = dac.Output(ch, 0)
 		if err != nil {
-			return dac, err
+			return err
 		}
 	}
 
 	ch2 := []int{0, 1, 2} // JM channels, special bootup
+	dac.BeginConfig()
 	dac.SetTriggerDirection(false)
 	for _, ch := range ch2 {
 		dac.SetTriggerMode(ch, "timer")
 		dac.SetClearOnUnderflow(ch, true)
 	}
-	return dac, err
+	dac.CommitConfig()
+	return err
 }
 
 // SetupAP236 initializes the AP236 hardware to a pre-configured and safe condition
-func SetupAP236() (*acromag.AP236, error) {
-	dac, err := acromag.NewAP236(0)
-	if err != nil {
-		return dac, err
-	}
+func SetupAP236(dac *acromag.AP236) error {
+	var err error
 	for _, ch := range channels {
 		err = dac.SetClearVoltage(ch, acromag.MidScale)
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetPowerUpVoltage(ch, acromag.MidScale)
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetRange(ch, "-10,10")
 		if err != nil {
-			return dac, err
+			return err
 		}
 		err = dac.SetOverRange(ch, false)
 		if err != nil {
-			return dac, err
+			return err
 		}
 
 		err = dac.SetOutputSimultaneous(ch, false)
 		if err != nil {
-			return dac, err
+			return err
 		}
 
 		// lastly, power up the DAC channel
 		err = dac.Output(ch, 0)
 		if err != nil {
-			return dac, err
+			return err
 		}
 	}
-	return dac, err
+	return err
 }
 
-// SetupHTTP creates a new chi router that exposes an interface to the DAC
-func SetupHTTP(dac daq.DAC) chi.Router {
+// SetupHTTP creates a new chi router that exposes an interface to the DAC,
+// behind a lock (/lock) that is returned for the other ways in to honor
+func SetupHTTP(dac daq.DAC) (chi.Router, *locker.Locker) {
 	httpD := daq.NewHTTPDAC(dac)
 	lock := locker.New()
 	locker.Inject(httpD, lock)
 	r := chi.NewRouter()
+	r.Use(lock.Check)
 	httpD.RouteTable.Bind(r)
-	return r
+	return r, lock
 }
 
 // LoadWaveform loads a waveform into system memory, for on-demand copying into
@@ -140,15 +143,39 @@ func LoadWaveform(dac *acromag.AP235, name string, period time.Duration) error {
 	return nil
 }
 
+// serveFrames starts a FrameServer for a DAC and adds its statistics route
+func serveFrames(dac multiDN16, lock lockable, r chi.Router, addr, name string) {
+	frames, err := ServeFrames(addr, dac, lock)
+	if err != nil {
+		log.Println("Error listening for binary update frames; UDP access to", name, "will not be configured", err)
+		return
+	}
+	r.Get("/frames/stats", frames.ServeHTTP)
+	log.Println(name, "binary update frames available via UDP at", addr)
+}
+
 func main() {
 	root := chi.NewRouter()
 	root.Use(middleware.Logger)
-	log.Println("connecting to AP235 (waveform DAC).  If the program is hanging, the driver has glitched;\n reboot the computer")
-	ap235, err := SetupAP235()
+	log.Println("connecting to AP235 (waveform DAC) and AP236 (non-waveform DAC).  If the program is hanging, the driver has glitched;\n reboot the computer")
+	// the boards are opened side by side, the slow flash reads of one do
+	// not wait for the other's
+	boards, err := acromag.OpenBoards([]int{0}, []int{0}, acromag.IOSyscall)
 	if err != nil {
+		log.Println("Error opening boards, hardware may be missing", err)
+	}
+	var (
+		ap235 *acromag.AP235
+		ap236 *acromag.AP236
+	)
+	if len(boards.AP235) > 0 {
+		ap235 = boards.AP235[0]
+		err = SetupAP235(ap235)
+	}
+	if ap235 == nil || err != nil {
 		log.Println("Error configuring AP235, hardware may be missing; remote access to AP235 will not be configured", err)
 	} else {
-		r235 := SetupHTTP(ap235)
+		r235, lock235 := SetupHTTP(ap235)
 		root.Mount("/ap235/", r235)
 		r235.Post("/load-waveform", func(w http.ResponseWriter, r *http.Request) {
 			type msg struct {
@@ -169,15 +196,19 @@ func main() {
 			w.WriteHeader(http.StatusOK)
 		})
 		log.Println("AP235 available via HTTP at /ap235")
+		serveFrames(ap235, lock235, r235, ":8235", "AP235")
 	}
-	log.Println("connecting to AP236 (non-waveform DAC).  If the program is hanging, the driver has glitched;\n reboot the computer")
-	ap236, err := SetupAP236()
-	if err != nil {
+	if len(boards.AP236) > 0 {
+		ap236 = boards.AP236[0]
+		err = SetupAP236(ap236)
+	}
+	if ap236 == nil || err != nil {
 		log.Println("Error configuring AP236, hardware may be missing; remote access to AP236 will not be configured", err)
 	} else {
-		r236 := SetupHTTP(ap236)
+		r236, lock236 := SetupHTTP(ap236)
 		root.Mount("/ap236/", r236)
 		log.Println("AP236 available via HTTP at /ap236")
+		serveFrames(ap236, lock236, r236, ":8236", "AP236")
 	}
 	ch := make(chan os.Signal, 1)
 	signal.Notify(ch, syscall.SIGABRT, syscall.SIGTERM)
@@ -5,10 +5,14 @@
 package daq
 
 import (
+	"encoding/binary"
 	"encoding/csv"
 	"encoding/json"
+	"errors"
+	"fmt"
 	"go/types"
 	"io"
+	"math"
 	"net/http"
 	"strconv"
 
@@ -303,7 +307,7 @@ type channelTriggerMode struct {
 }
 
 // SetOperatingMode configures the operating mode of a DAC between "single"
-// and "waveform" modes
+// and "waveform" modes, or "waveform-dma" for DACs that support it
 func SetOperatingMode(d WaveformDAC) http.HandlerFunc {
 	return func(w http.ResponseWriter, r *http.Request) {
 		var input channelOpMode
@@ -423,6 +427,170 @@ func StopWaveform(d WaveformDAC) http.HandlerFunc {
 	}
 }
 
+// BufferedWaveformDAC is a WaveformDAC whose waveforms are written in place
+// into the buffers they are played from, as those of the AP235
+type BufferedWaveformDAC interface {
+	WaveformDAC
+
+	// WaveformBuffer returns a writable view of a number of samples (codes)
+	// for the waveform of a channel
+	WaveformBuffer(int, int) ([]uint16, error)
+
+	// CommitWaveformBuffer marks the view for playback
+	CommitWaveformBuffer(int) error
+
+	// CalibrateFloat64 and CalibrateFloat32 convert volts to codes for a
+	// channel
+	CalibrateFloat64(int, []float64, []uint16)
+	CalibrateFloat32(int, []float32, []uint16)
+}
+
+// HTTPBufferedWaveform adds the binary waveform upload route to the table
+func HTTPBufferedWaveform(iface BufferedWaveformDAC, table generichttp.RouteTable) {
+	table[generichttp.MethodPath{Method: http.MethodPost, Path: "/playback/upload/binary"}] = UploadWaveformBinary(iface)
+}
+
+// formats of a binary waveform section
+const (
+	// BinaryFloat64 is little endian float64 volts
+	BinaryFloat64 = 0
+
+	// BinaryFloat32 is little endian float32 volts
+	BinaryFloat32 = 1
+
+	// BinaryCode is little endian uint16 codes, played as-is
+	BinaryCode = 2
+)
+
+// binaryChunk is the number of samples decoded at a time
+const binaryChunk = 4096
+
+// MaxBinaryChannel is the highest channel a binary waveform section may be for
+const MaxBinaryChannel = 15
+
+// MaxBinarySamples is the most samples a binary waveform section may have.
+// The waveform buffer of a section is allocated, and page locked by the
+// AP235, from its header before any sample arrives, so the limit bounds the
+// memory one request takes: 32 MiB of codes per channel by default
+var MaxBinarySamples = 1 << 24
+
+// badUpload is an error in the upload itself rather than of the DAC
+type badUpload struct{ error }
+
+// UploadWaveformBinary is an HTTP interface to LoadBinary.  Errors in the
+// body are reported as 400, errors of the DAC as 500
+func UploadWaveformBinary(d BufferedWaveformDAC) http.HandlerFunc {
+	return func(w http.ResponseWriter, r *http.Request) {
+		defer r.Body.Close()
+		err := LoadBinary(d, r.Body)
+		if err != nil {
+			code := http.StatusInternalServerError
+			if errors.As(err, &badUpload{}) {
+				code = http.StatusBadRequest
+			}
+			http.Error(w, err.Error(), code)
+			return
+		}
+		w.WriteHeader(http.StatusOK)
+	}
+}
+
+// LoadBinary populates the waveform tables of a DAC from a stream of binary
+// sections, one per channel.  Each is an 8 byte little endian header:
+//
+//	uint16 channel
+//	uint8  format, BinaryFloat64, BinaryFloat32 or BinaryCode
+//	uint8  zero
+//	uint32 number of samples
+//
+// followed by the samples.  Sections for a channel past MaxBinaryChannel or of
+// more than MaxBinarySamples samples are refused before any memory is taken
+// for them.  The samples are decoded and calibrated a chunk
+// at a time straight into the channel's waveform buffer, so the memory used
+// beyond the buffers does not depend on the length of the waveforms.  Each
+// channel is committed once its section is complete.  r is not closed
+func LoadBinary(d BufferedWaveformDAC, r io.Reader) error {
+	var (
+		hdr   [8]byte
+		raw   = make([]byte, binaryChunk*8)
+		f64   []float64
+		f32   []float32
+		width int
+	)
+	for {
+		_, err := io.ReadFull(r, hdr[:])
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return badUpload{fmt.Errorf("reading section header: %w", err)}
+		}
+		channel := int(binary.LittleEndian.Uint16(hdr[0:]))
+		format := hdr[2]
+		n := int(binary.LittleEndian.Uint32(hdr[4:]))
+		switch format {
+		case BinaryFloat64:
+			width = 8
+			if f64 == nil {
+				f64 = make([]float64, binaryChunk)
+			}
+		case BinaryFloat32:
+			width = 4
+			if f32 == nil {
+				f32 = make([]float32, binaryChunk)
+			}
+		case BinaryCode:
+			width = 2
+		default:
+			return badUpload{fmt.Errorf("channel %d: unknown sample format %d", channel, format)}
+		}
+		if hdr[3] != 0 || n == 0 {
+			return badUpload{fmt.Errorf("channel %d: malformed section header %x", channel, hdr)}
+		}
+		if channel > MaxBinaryChannel {
+			return badUpload{fmt.Errorf("channel %d does not exist", channel)}
+		}
+		if n > MaxBinarySamples {
+			return badUpload{fmt.Errorf("channel %d: %d samples is more than the limit of %d", channel, n, MaxBinarySamples)}
+		}
+		buf, err := d.WaveformBuffer(channel, n)
+		if err != nil {
+			return fmt.Errorf("channel %d: %w", channel, err)
+		}
+		for off := 0; off < n; {
+			m := n - off
+			if m > binaryChunk {
+				m = binaryChunk
+			}
+			b := raw[:m*width]
+			if _, err := io.ReadFull(r, b); err != nil {
+				return badUpload{fmt.Errorf("channel %d: reading samples %d-%d of %d: %w", channel, off, off+m, n, err)}
+			}
+			dst := buf[off : off+m]
+			switch format {
+			case BinaryFloat64:
+				for i := range dst {
+					f64[i] = math.Float64frombits(binary.LittleEndian.Uint64(b[8*i:]))
+				}
+				d.CalibrateFloat64(channel, f64[:m], dst)
+			case BinaryFloat32:
+				for i := range dst {
+					f32[i] = math.Float32frombits(binary.LittleEndian.Uint32(b[4*i:]))
+				}
+				d.CalibrateFloat32(channel, f32[:m], dst)
+			case BinaryCode:
+				for i := range dst {
+					dst[i] = binary.LittleEndian.Uint16(b[2*i:])
+				}
+			}
+			off += m
+		}
+		if err := d.CommitWaveformBuffer(channel); err != nil {
+			return fmt.Errorf("channel %d: %w", channel, err)
+		}
+	}
+}
+
 // Timer describes a clock
 type Timer interface {
 	SetTimerPeriod(uint32) error
@@ -642,6 +810,30 @@ func LoadCSVFloats(d TimerDAC, r io.Reader, periodNano uint32) error {
 	return nil
 }
 
+// Instrumented is a device that keeps runtime statistics
+type Instrumented interface {
+	// Instrumentation returns a snapshot of the statistics that can be
+	// encoded as JSON
+	Instrumentation() interface{}
+}
+
+// HTTPInstrumented adds a route for the statistics of a device to a table
+func HTTPInstrumented(iface Instrumented, table generichttp.RouteTable) {
+	table[generichttp.MethodPath{Method: http.MethodGet, Path: "/stats"}] = Stats(iface)
+}
+
+// Stats returns an HTTP handlerfunc that will report the statistics of a device
+func Stats(i Instrumented) http.HandlerFunc {
+	return func(w http.ResponseWriter, r *http.Request) {
+		w.Header().Set("Content-Type", "application/json")
+		err := json.NewEncoder(w).Encode(i.Instrumentation())
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusInternalServerError)
+			return
+		}
+	}
+}
+
 // HTTPDAC is a type that allows setting up a DAC satisfying any combination
 // of the interfaces in this package to an HTTP interface
 type HTTPDAC struct {
@@ -664,9 +856,15 @@ func NewHTTPDAC(d DAC) HTTPDAC {
 	if wd, ok := (d).(WaveformDAC); ok {
 		HTTPWaveform(wd, rt)
 	}
+	if bd, ok := (d).(BufferedWaveformDAC); ok {
+		HTTPBufferedWaveform(bd, rt)
+	}
 	if t, ok := (d).(Timer); ok {
 		HTTPTimer(t, rt)
 	}
+	if i, ok := (d).(Instrumented); ok {
+		HTTPInstrumented(i, rt)
+	}
 	w.RouteTable = rt
 	return w
 }
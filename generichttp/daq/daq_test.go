@@ -0,0 +1,153 @@
+package daq_test
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"math"
+	"net/http"
+	"net/http/httptest"
+	"testing"
+
+	"github.com/nasa-jpl/golaborate/generichttp/daq"
+)
+
+// bufferedDAC records the waveforms of LoadBinary; volts are converted to
+// codes as v*100
+type bufferedDAC struct {
+	daq.WaveformDAC
+
+	buf       [16][]uint16
+	committed [16]bool
+	allocs    int
+
+	// failAlloc and failCommit make the calls error
+	failAlloc, failCommit bool
+}
+
+func (d *bufferedDAC) WaveformBuffer(channel, n int) ([]uint16, error) {
+	d.allocs++
+	if d.failAlloc {
+		return nil, errors.New("out of memory")
+	}
+	d.buf[channel] = make([]uint16, n)
+	return d.buf[channel], nil
+}
+
+func (d *bufferedDAC) CommitWaveformBuffer(channel int) error {
+	if d.failCommit {
+		return errors.New("incompatible trigger mode")
+	}
+	d.committed[channel] = true
+	return nil
+}
+
+func (d *bufferedDAC) CalibrateFloat64(channel int, volts []float64, dn []uint16) {
+	for i, v := range volts {
+		dn[i] = uint16(v * 100)
+	}
+}
+
+func (d *bufferedDAC) CalibrateFloat32(channel int, volts []float32, dn []uint16) {
+	for i, v := range volts {
+		dn[i] = uint16(v * 100)
+	}
+}
+
+// section encodes a section header followed by samples, each of which is a
+// float64, float32 or uint16 per format
+func section(channel uint16, format uint8, n uint32, samples ...float64) []byte {
+	var b bytes.Buffer
+	binary.Write(&b, binary.LittleEndian, channel)
+	b.Write([]byte{format, 0})
+	binary.Write(&b, binary.LittleEndian, n)
+	for _, s := range samples {
+		switch format {
+		case daq.BinaryFloat64:
+			binary.Write(&b, binary.LittleEndian, math.Float64bits(s))
+		case daq.BinaryFloat32:
+			binary.Write(&b, binary.LittleEndian, math.Float32bits(float32(s)))
+		default:
+			binary.Write(&b, binary.LittleEndian, uint16(s))
+		}
+	}
+	return b.Bytes()
+}
+
+func TestLoadBinaryFormats(t *testing.T) {
+	long := make([]float64, 10000) // more than one chunk
+	for i := range long {
+		long[i] = float64(i%600) / 100
+	}
+	var body []byte
+	body = append(body, section(0, daq.BinaryFloat64, uint32(len(long)), long...)...)
+	body = append(body, section(3, daq.BinaryFloat32, 3, 0.5, 1.25, 2)...)
+	body = append(body, section(15, daq.BinaryCode, 2, 0xFFFF, 7)...)
+	d := &bufferedDAC{}
+	if err := daq.LoadBinary(d, bytes.NewReader(body)); err != nil {
+		t.Fatal(err)
+	}
+	for i, v := range long {
+		if d.buf[0][i] != uint16(v*100) {
+			t.Fatalf("float64 sample %d is %d, want %d", i, d.buf[0][i], uint16(v*100))
+		}
+	}
+	if want := []uint16{50, 125, 200}; !equal(d.buf[3], want) {
+		t.Errorf("float32 samples are %v, want %v", d.buf[3], want)
+	}
+	if want := []uint16{0xFFFF, 7}; !equal(d.buf[15], want) {
+		t.Errorf("codes are %v, want %v", d.buf[15], want)
+	}
+	if !d.committed[0] || !d.committed[3] || !d.committed[15] || d.committed[1] {
+		t.Errorf("unexpected commits %v", d.committed)
+	}
+}
+
+func equal(a, b []uint16) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	for i := range a {
+		if a[i] != b[i] {
+			return false
+		}
+	}
+	return true
+}
+
+func TestUploadWaveformBinaryStatus(t *testing.T) {
+	padded := section(0, daq.BinaryCode, 1, 1)
+	padded[3] = 1
+	cases := []struct {
+		name   string
+		body   []byte
+		dac    bufferedDAC
+		status int
+		allocs int
+	}{
+		{name: "empty", body: nil, status: http.StatusOK},
+		{name: "short header", body: section(0, daq.BinaryCode, 1, 1)[:5], status: http.StatusBadRequest},
+		{name: "short samples", body: section(0, daq.BinaryFloat64, 3, 1, 2), status: http.StatusBadRequest, allocs: 1},
+		{name: "unknown format", body: section(0, 3, 1, 1), status: http.StatusBadRequest},
+		{name: "padding", body: padded, status: http.StatusBadRequest},
+		{name: "no samples", body: section(0, daq.BinaryCode, 0), status: http.StatusBadRequest},
+		{name: "channel 16", body: section(16, daq.BinaryCode, 1, 1), status: http.StatusBadRequest},
+		{name: "too long", body: section(0, daq.BinaryCode, uint32(daq.MaxBinarySamples+1)), status: http.StatusBadRequest},
+		{name: "allocation", body: section(0, daq.BinaryCode, 1, 1), dac: bufferedDAC{failAlloc: true}, status: http.StatusInternalServerError, allocs: 1},
+		{name: "commit", body: section(0, daq.BinaryCode, 1, 1), dac: bufferedDAC{failCommit: true}, status: http.StatusInternalServerError, allocs: 1},
+	}
+	for _, c := range cases {
+		t.Run(c.name, func(t *testing.T) {
+			d := c.dac
+			r := httptest.NewRequest(http.MethodPost, "/playback/upload/binary", bytes.NewReader(c.body))
+			w := httptest.NewRecorder()
+			daq.UploadWaveformBinary(&d)(w, r)
+			if w.Code != c.status {
+				t.Errorf("status %d, want %d: %s", w.Code, c.status, w.Body.String())
+			}
+			if d.allocs != c.allocs {
+				t.Errorf("%d waveform buffers taken, want %d", d.allocs, c.allocs)
+			}
+		})
+	}
+}
@@ -0,0 +1,283 @@
+/*Package pinned is a pool of page locked buffers outside of the Go heap, for
+memory handed to C drivers for DMA or long lived readout.
+
+Buffers are mapped straight from the kernel, pre-faulted and locked in memory
+when they are first made, and kept on per size class free lists when returned,
+so a buffer of a size seen before is recycled without a system call or a page
+fault.  Being outside of the Go heap, they may be kept by C code for as long as
+they are not returned to the pool.
+
+The sizes are rounded up to a class of at most a quarter more pages, and the
+buffers start on a page boundary.  Linux only.
+*/
+package pinned
+
+import (
+	"errors"
+	"fmt"
+	"math/bits"
+	"reflect"
+	"sync"
+	"syscall"
+	"unsafe"
+)
+
+const (
+	// hugePage is the size of the huge pages huge pools map, the x86-64 and
+	// arm64 default
+	hugePage = 2 << 20
+)
+
+var pageSize = syscall.Getpagesize()
+
+// ErrForeign is the panic value of Put with a buffer that is not the pool's
+var ErrForeign = errors.New("pinned: buffer not from this pool")
+
+// Stats are the counters of a Pool
+type Stats struct {
+	// Mapped is the number of bytes mapped by the pool, in use or free
+	Mapped uint64 `json:"mapped"`
+
+	// InUse is the number of bytes handed out and not yet returned
+	InUse uint64 `json:"in_use"`
+
+	// Gets is the number of buffers handed out, Recycled how many of those
+	// came from a free list
+	Gets     uint64 `json:"gets"`
+	Recycled uint64 `json:"recycled"`
+
+	// Unlocked is the number of buffers the kernel refused to lock, most
+	// often for RLIMIT_MEMLOCK.  They are used all the same
+	Unlocked uint64 `json:"unlocked"`
+
+	// Huge is the number of buffers backed by huge pages
+	Huge uint64 `json:"huge"`
+}
+
+// block is one mapping of the pool
+type block struct {
+	mem   []byte
+	class int // size in bytes
+	used  bool
+}
+
+// Pool is a set of free lists of page locked buffers.  The zero value is not
+// usable, see New.  A Pool is safe for concurrent use
+type Pool struct {
+	mu    sync.Mutex
+	huge  bool
+	free  map[int][]*block
+	owned map[uintptr]*block
+	stats Stats
+
+	// freeLimit is the most bytes kept on the free lists, 0 for no limit
+	freeLimit uint64
+}
+
+// New returns an empty pool.  If huge is true, buffers of 2 MiB or more are
+// backed by huge pages where the kernel has them reserved
+// (/proc/sys/vm/nr_hugepages), else by transparent huge pages where enabled
+func New(huge bool) *Pool {
+	return &Pool{
+		huge:  huge,
+		free:  make(map[int][]*block),
+		owned: make(map[uintptr]*block),
+	}
+}
+
+// DefaultFreeLimit is the free limit of Default, see SetFreeLimit
+const DefaultFreeLimit = 256 << 20
+
+// Default is the pool of the process, shared by the drivers that use this
+// package so their buffers are recycled among each other.  Its free limit is
+// DefaultFreeLimit
+var Default = func() *Pool {
+	p := New(false)
+	p.SetFreeLimit(DefaultFreeLimit)
+	return p
+}()
+
+// SetFreeLimit bounds the bytes kept on the free lists by Put: a buffer that
+// would take the free ones past n bytes is unmapped rather than kept.  Zero, the default of New, keeps every buffer.  Reserve and the
+// buffers already free are not affected
+func (p *Pool) SetFreeLimit(n uint64) {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	p.freeLimit = n
+}
+
+// class is the size in bytes of the buffers n bytes are taken from: a whole
+// number of pages, with four classes per doubling
+func class(n int) int {
+	pages := (n + pageSize - 1) / pageSize
+	if pages < 1 {
+		pages = 1
+	}
+	if e := bits.Len(uint(pages - 1)); e > 3 {
+		step := 1 << uint(e-3)
+		pages = (pages + step - 1) / step * step
+	}
+	return pages * pageSize
+}
+
+// mapBlock maps, pre-faults and locks a buffer of size bytes
+func (p *Pool) mapBlock(size int) (*block, error) {
+	const anon = syscall.MAP_PRIVATE | syscall.MAP_ANONYMOUS | syscall.MAP_POPULATE
+	var (
+		mem  []byte
+		err  error
+		huge bool
+	)
+	if p.huge && size >= hugePage {
+		length := (size + hugePage - 1) / hugePage * hugePage
+		mem, err = syscall.Mmap(-1, 0, length, syscall.PROT_READ|syscall.PROT_WRITE, anon|syscall.MAP_HUGETLB)
+		if err == nil {
+			mem, huge = mem[:size], true
+		}
+	}
+	if mem == nil {
+		mem, err = syscall.Mmap(-1, 0, size, syscall.PROT_READ|syscall.PROT_WRITE, anon)
+		if err != nil {
+			return nil, fmt.Errorf("pinned: unable to map %d bytes: %w", size, err)
+		}
+		if p.huge && size >= hugePage {
+			// advisory; the populated pages are folded as the kernel gets to them
+			syscall.Madvise(mem, syscall.MADV_HUGEPAGE)
+		}
+	}
+	if syscall.Mlock(mem) != nil {
+		p.stats.Unlocked++
+	}
+	if huge {
+		p.stats.Huge++
+	}
+	p.stats.Mapped += uint64(size)
+	return &block{mem: mem, class: size}, nil
+}
+
+// Get returns a page locked buffer of n bytes.  Its capacity is that of its
+// size class; the contents are zero if newly mapped and left as they were if
+// recycled.  The buffer must be returned with Put once nothing, Go or C,
+// refers to it
+func (p *Pool) Get(n int) ([]byte, error) {
+	if n < 1 {
+		return nil, fmt.Errorf("pinned: buffer size %d is not allowed", n)
+	}
+	size := class(n)
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	var b *block
+	if l := p.free[size]; len(l) > 0 {
+		b = l[len(l)-1]
+		l[len(l)-1] = nil
+		p.free[size] = l[:len(l)-1]
+		p.stats.Recycled++
+	} else {
+		var err error
+		b, err = p.mapBlock(size)
+		if err != nil {
+			return nil, err
+		}
+		p.owned[uintptr(unsafe.Pointer(&b.mem[0]))] = b
+	}
+	b.used = true
+	p.stats.Gets++
+	p.stats.InUse += uint64(size)
+	return b.mem[:n], nil
+}
+
+// Put returns a buffer of Get, sliced to any length, to its free list.  It
+// panics with ErrForeign if buf does not start at a buffer of the pool, or
+// was returned already
+func (p *Pool) Put(buf []byte) {
+	if cap(buf) == 0 {
+		panic(ErrForeign)
+	}
+	addr := uintptr(unsafe.Pointer(&buf[:1][0]))
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	b, ok := p.owned[addr]
+	if !ok || !b.used {
+		panic(ErrForeign)
+	}
+	b.used = false
+	p.stats.InUse -= uint64(b.class)
+	if p.freeLimit != 0 && p.stats.Mapped-p.stats.InUse > p.freeLimit {
+		p.unmap(b)
+		return
+	}
+	p.free[b.class] = append(p.free[b.class], b)
+}
+
+// unmap releases a block that is not in use
+func (p *Pool) unmap(b *block) {
+	delete(p.owned, uintptr(unsafe.Pointer(&b.mem[0])))
+	p.stats.Mapped -= uint64(b.class)
+	syscall.Munmap(b.mem[:cap(b.mem)])
+}
+
+// Reserve maps count buffers of n bytes onto the free list ahead of their use,
+// so the first Gets do not fault in pages either
+func (p *Pool) Reserve(n, count int) error {
+	if n < 1 {
+		return fmt.Errorf("pinned: buffer size %d is not allowed", n)
+	}
+	size := class(n)
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	for i := 0; i < count; i++ {
+		b, err := p.mapBlock(size)
+		if err != nil {
+			return err
+		}
+		p.owned[uintptr(unsafe.Pointer(&b.mem[0]))] = b
+		p.free[size] = append(p.free[size], b)
+	}
+	return nil
+}
+
+// Trim unmaps the free buffers of the pool
+func (p *Pool) Trim() {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	for size, l := range p.free {
+		for _, b := range l {
+			p.unmap(b)
+		}
+		delete(p.free, size)
+	}
+}
+
+// Stats returns a snapshot of the counters of the pool
+func (p *Pool) Stats() Stats {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return p.stats
+}
+
+// Uint16s is Get for n samples of 16 bits
+func (p *Pool) Uint16s(n int) ([]uint16, error) {
+	b, err := p.Get(2 * n)
+	if err != nil {
+		return nil, err
+	}
+	var out []uint16
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&out))
+	hdr.Data = uintptr(unsafe.Pointer(&b[0]))
+	hdr.Len = n
+	hdr.Cap = cap(b) / 2
+	return out, nil
+}
+
+// PutUint16s is Put for a buffer of Uint16s
+func (p *Pool) PutUint16s(buf []uint16) {
+	if cap(buf) == 0 {
+		panic(ErrForeign)
+	}
+	var b []byte
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&b))
+	hdr.Data = uintptr(unsafe.Pointer(&buf[:1][0]))
+	hdr.Len = 1
+	hdr.Cap = 2 * cap(buf)
+	p.Put(b)
+}
@@ -0,0 +1,100 @@
+package pinned_test
+
+import (
+	"testing"
+
+	"github.com/nasa-jpl/golaborate/pinned"
+)
+
+func TestPoolRecycles(t *testing.T) {
+	p := pinned.New(false)
+	a, err := p.Get(10000)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(a) != 10000 || cap(a) < 10000 {
+		t.Fatalf("got len %d cap %d, want len 10000", len(a), cap(a))
+	}
+	for i := range a {
+		a[i] = byte(i)
+	}
+	p.Put(a[:1])
+	b, err := p.Get(9000) // same class
+	if err != nil {
+		t.Fatal(err)
+	}
+	if &a[0] != &b[0] {
+		t.Error("a buffer of the same class was not recycled")
+	}
+	s := p.Stats()
+	if s.Gets != 2 || s.Recycled != 1 || s.InUse != uint64(cap(b)) || s.Mapped != uint64(cap(b)) {
+		t.Errorf("unexpected stats %+v", s)
+	}
+	p.Put(b)
+	p.Trim()
+	if s := p.Stats(); s.Mapped != 0 || s.InUse != 0 {
+		t.Errorf("trim left %+v", s)
+	}
+}
+
+func TestPoolReserveAndUint16s(t *testing.T) {
+	p := pinned.New(true)
+	if err := p.Reserve(1<<21, 2); err != nil {
+		t.Fatal(err)
+	}
+	a, err := p.Uint16s(1 << 20)
+	if err != nil {
+		t.Fatal(err)
+	}
+	b, err := p.Uint16s(1 << 20)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if s := p.Stats(); s.Recycled != 2 {
+		t.Errorf("reserved buffers were not used, %+v", s)
+	}
+	a[len(a)-1], b[0] = 1, 2
+	p.PutUint16s(a)
+	p.PutUint16s(b)
+	defer func() {
+		if recover() != pinned.ErrForeign {
+			t.Error("returning a buffer twice did not panic with ErrForeign")
+		}
+	}()
+	p.PutUint16s(a)
+}
+
+func TestPoolFreeLimit(t *testing.T) {
+	p := pinned.New(false)
+	p.SetFreeLimit(1 << 20)
+	a, err := p.Get(1 << 20)
+	if err != nil {
+		t.Fatal(err)
+	}
+	b, err := p.Get(1 << 20)
+	if err != nil {
+		t.Fatal(err)
+	}
+	p.Put(a)
+	p.Put(b) // past the limit
+	if s := p.Stats(); s.Mapped != 1<<20 || s.InUse != 0 {
+		t.Errorf("expected one buffer kept, got %+v", s)
+	}
+	if _, err := p.Get(1 << 20); err != nil {
+		t.Fatal(err)
+	}
+	if s := p.Stats(); s.Recycled != 1 {
+		t.Errorf("the kept buffer was not recycled, %+v", s)
+	}
+}
+
+func BenchmarkPoolGetPut(b *testing.B) {
+	p := pinned.New(false)
+	for i := 0; i < b.N; i++ {
+		buf, err := p.Get(4 << 20)
+		if err != nil {
+			b.Fatal(err)
+		}
+		p.Put(buf)
+	}
+}
@@ -6,6 +6,7 @@ import (
 	"go/types"
 	"net/http"
 	"strings"
+	"sync/atomic"
 
 	"github.com/go-chi/chi"
 	"github.com/nasa-jpl/golaborate/generichttp"
@@ -38,7 +39,9 @@ type ManipulableLock interface {
 // Locker is a type which behaves like a sync.Mutex without the blocking,
 // and holds a list of routes (Goji patterns) to not protext
 type Locker struct {
-	isLocked bool
+	// isLocked is 1 when locked, accessed atomically as the lock is checked
+	// from any goroutine
+	isLocked int32
 
 	// DoNotProtect is a list of paths not to apply the lock to
 	DoNotProtect []string
@@ -51,17 +54,17 @@ func New() *Locker {
 
 // Lock the locker
 func (l *Locker) Lock() {
-	l.isLocked = true
+	atomic.StoreInt32(&l.isLocked, 1)
 }
 
 // Unlock the locker
 func (l *Locker) Unlock() {
-	l.isLocked = false
+	atomic.StoreInt32(&l.isLocked, 0)
 }
 
 // Locked returns true if the locker is locked
 func (l *Locker) Locked() bool {
-	return l.isLocked
+	return atomic.LoadInt32(&l.isLocked) == 1
 }
 
 // Check is an HTTP middleware that returns http.StatusLocked if Locked() is true, otherwise passes down the line
@@ -148,7 +151,7 @@ func (al *AxisLocker) Check(next http.Handler) http.Handler {
 			al.locked[axis] = New()
 			locked = al.locked[axis]
 		}
-		if locked.isLocked {
+		if locked.Locked() {
 			// check if the path is protected
 			protected := true
 			url := r.URL.Path